@@ -0,0 +1,331 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "storage.h"
+
+const char *archiveFilePath = "archive.dat";
+
+Archiver archiver = {-1, .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER,
+                     .written = PTHREAD_COND_INITIALIZER};
+
+// restoreArchivedOrder counts an archived order into the sales totals. An order that is still in memory
+// was archived after the checkpoint it was loaded from, so it leaves memory again. One archived before the
+// checkpoint, with checkpointed set, isn't looked for.
+bool restoreArchivedOrder(const ArchiveRecord *record, const ArchiveItemRecord items[], bool checkpointed) {
+    Order *live = checkpointed ? NULL : findOrder(record->id);
+    if (live != NULL && live->orderStatus != WAITING) {
+        pthread_mutex_lock(&salesLock);
+        recordOrder(&sales, live, -1);
+        pthread_mutex_unlock(&salesLock);
+        unlinkOrder(live);
+    }
+
+    Order order;
+    memset(&order, 0, sizeof(order));
+    order.id = record->id;
+    order.cashierId = record->cashierId;
+    order.paymentType = record->paymentType;
+    order.orderStatus = record->orderStatus;
+    initOrderItems(&order);
+    if (!growOrderItems(&order, record->itemCount)) return false;
+    for (int i = 0; i < record->itemCount; i++) {
+        order.items[order.itemCount++] = (Item) {
+            items[i].id, items[i].stockId, items[i].quantity, items[i].price, NULL
+        };
+        reserveIds(ITEM_ID, items[i].id);
+    }
+    reserveIds(ORDER_ID, order.id);
+
+    pthread_mutex_lock(&salesLock);
+    recordOrder(&sales, &order, 1);
+    recordOrder(&archivedSales, &order, 1);
+    pthread_mutex_unlock(&salesLock);
+    freeOrderItems(&order);
+    return true;
+}
+
+// validateArchive checks the header of a mapped archive
+bool validateArchive(const MappedFile *file) {
+    const ArchiveFileHeader *header = (const ArchiveFileHeader *) file->data;
+    return file->size >= sizeof(ArchiveFileHeader) && memcmp(header->magic, "CRAR", 4) == 0 &&
+           header->version == ARCHIVE_VERSION && header->recordSize == sizeof(ArchiveRecord) &&
+           header->itemRecordSize == sizeof(ArchiveItemRecord);
+}
+
+// nextArchiveRecord reads the record at offset and moves offset past it. It returns false at the end of the
+// archive or at a torn record, which offset is then left on.
+bool nextArchiveRecord(const MappedFile *file, size_t *offset, ArchiveRecord *record,
+                       const ArchiveItemRecord **items) {
+    if (*offset + sizeof(ArchiveRecord) > file->size) return false;
+    memcpy(record, file->data + *offset, sizeof(ArchiveRecord));
+    if (record->itemCount < 0 || record->size > file->size - *offset ||
+        record->size != sizeof(ArchiveRecord) + (uint64_t) record->itemCount * sizeof(ArchiveItemRecord))
+        return false;
+    const char *data = file->data + *offset;
+    if (checksumData(2166136261U, data + 2 * sizeof(uint32_t), record->size - 2 * sizeof(uint32_t)) !=
+        record->checksum)
+        return false;
+    *items = (const ArchiveItemRecord *) (data + sizeof(ArchiveRecord));
+    *offset += record->size;
+    return true;
+}
+
+// readArchive streams the archive into the sales totals without keeping its orders, and opens it for appending.
+// A torn record at the end (a crash in the middle of an append) is cut off like one in the journal.
+bool readArchive() {
+    MappedFile file;
+    if (!mapFile(archiveFilePath, &file)) return openArchive();
+
+    if (!validateArchive(&file)) {
+        fprintf(stderr, "%s: bad archive header\n", archiveFilePath);
+        unmapFile(&file);
+        return false;
+    }
+
+    size_t validLength = sizeof(ArchiveFileHeader);
+    const uint64_t checkpointed = ((const ArchiveFileHeader *) file.data)->checkpointed;
+    ArchiveRecord record;
+    const ArchiveItemRecord *items;
+    while (1) {
+        const bool beforeCheckpoint = validLength < checkpointed;
+        if (!nextArchiveRecord(&file, &validLength, &record, &items)) break;
+        if (record.paymentType < 0 || record.paymentType >= PAYMENT_TYPE_COUNT || record.orderStatus < 0 ||
+            record.orderStatus >= ORDER_STATUS_COUNT) {
+            fprintf(stderr, "%s: order %d has an unknown payment type or status\n", archiveFilePath, record.id);
+            unmapFile(&file);
+            return false;
+        }
+        if (!restoreArchivedOrder(&record, items, beforeCheckpoint)) {
+            fprintf(stderr, "%s: out of memory\n", archiveFilePath);
+            unmapFile(&file);
+            return false;
+        }
+    }
+    if (validLength < file.size) {
+        fprintf(stderr, "%s: dropped %zu bytes of a torn record\n", archiveFilePath, file.size - validLength);
+    }
+    unmapFile(&file);
+
+#ifdef _WIN32
+    const int fd = open(archiveFilePath, O_WRONLY | O_BINARY);
+    const bool truncated = fd >= 0 && _chsize(fd, validLength) == 0;
+#else
+    const int fd = open(archiveFilePath, O_WRONLY);
+    const bool truncated = fd >= 0 && ftruncate(fd, validLength) == 0;
+#endif
+    if (fd >= 0) close(fd);
+    if (!truncated) return false;
+#ifdef _WIN32
+    archiver.fd = open(archiveFilePath, O_WRONLY | O_APPEND | O_BINARY);
+#else
+    archiver.fd = open(archiveFilePath, O_WRONLY | O_APPEND);
+#endif
+    archiver.opened = validLength;
+    return archiver.fd >= 0;
+}
+
+// openArchive starts an empty archive
+bool openArchive() {
+#ifdef _WIN32
+    archiver.fd = open(archiveFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_BINARY, 0644);
+#else
+    archiver.fd = open(archiveFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+#endif
+    if (archiver.fd < 0) return false;
+
+    const ArchiveFileHeader header = {
+        {'C', 'R', 'A', 'R'}, ARCHIVE_VERSION, sizeof(ArchiveRecord), sizeof(ArchiveItemRecord), sizeof(header)
+    };
+    if (!writeAll(archiver.fd, (const char *) &header, sizeof(header)) || !syncFile(archiver.fd)) {
+        close(archiver.fd);
+        archiver.fd = -1;
+        return false;
+    }
+    archiver.opened = sizeof(header);
+    return true;
+}
+
+// appendArchiveRecord encodes an order into the pending buffer, the archiver thread writes it out
+bool appendArchiveRecord(const Order *order) {
+    const size_t size = sizeof(ArchiveRecord) + order->itemCount * sizeof(ArchiveItemRecord);
+    pthread_mutex_lock(&archiver.lock);
+    if (archiver.pendingLength + size > archiver.pendingCapacity) {
+        size_t capacity = archiver.pendingCapacity == 0 ? 65536 : archiver.pendingCapacity;
+        while (archiver.pendingLength + size > capacity) capacity *= 2;
+        char *pending = realloc(archiver.pending, capacity);
+        if (pending == NULL) {
+            pthread_mutex_unlock(&archiver.lock);
+            return false;
+        }
+        archiver.pending = pending;
+        archiver.pendingCapacity = capacity;
+    }
+
+    char *data = archiver.pending + archiver.pendingLength;
+    ArchiveRecord record = {
+        size, 0, order->id, order->cashierId, order->paymentType, order->orderStatus, order->itemCount, 0
+    };
+    ArchiveItemRecord *items = (ArchiveItemRecord *) (data + sizeof(ArchiveRecord));
+    for (int i = 0; i < order->itemCount; i++) {
+        const Item *item = &order->items[i];
+        items[i] = (ArchiveItemRecord) {item->id, item->stockId, item->quantity, item->price};
+    }
+    memcpy(data, &record, sizeof(record));
+    record.checksum = checksumData(2166136261U, data + 2 * sizeof(uint32_t), size - 2 * sizeof(uint32_t));
+    memcpy(data, &record, sizeof(record));
+    archiver.pendingLength += size;
+    archiver.appended += size;
+    pthread_mutex_unlock(&archiver.lock);
+    return true;
+}
+
+// archiveOrders moves the orders that settled before settledBefore out of memory and returns how many it moved.
+// Each status list is in the order its orders settled, so the ones to archive are at its front and the pass
+// costs the orders archived. Without an open archive, e.g. in headless runs, the orders are only dropped.
+int archiveOrders(long long settledBefore) {
+    const OrderStatus settled[] = {COMPLETED, CANCELLED};
+    int count = 0;
+    for (int i = 0; i < 2; i++) {
+        while (1) {
+            pthread_mutex_lock(&salesLock);
+            Order *order = orders.statusHeads[settled[i]];
+            pthread_mutex_unlock(&salesLock);
+            if (order == NULL || order->settledAt > settledBefore) break;
+            if (archiver.fd >= 0 && !appendArchiveRecord(order)) break;
+
+            // its totals stay in sales, they only move to the part checkSales can't recount
+            pthread_mutex_lock(&salesLock);
+            recordOrder(&archivedSales, order, 1);
+            pthread_mutex_unlock(&salesLock);
+            unlinkOrder(order);
+            count++;
+        }
+    }
+
+    pthread_mutex_lock(&archiver.lock);
+    archiver.archived += count;
+    if (count > 0) pthread_cond_signal(&archiver.wake);
+    pthread_mutex_unlock(&archiver.lock);
+    return count;
+}
+
+// archiveWrite makes everything appended so far durable, with the lock held. The lock is dropped while
+// a buffer is written so orders keep being archived into the other one.
+bool archiveWrite() {
+    while (archiver.durable < archiver.appended && !archiver.failed) {
+        if (archiver.writing) {
+            pthread_cond_wait(&archiver.written, &archiver.lock);
+            continue;
+        }
+
+        char *data = archiver.pending;
+        const size_t capacity = archiver.pendingCapacity;
+        const size_t length = archiver.pendingLength;
+        const uint64_t target = archiver.appended;
+        archiver.pending = archiver.flushing;
+        archiver.pendingCapacity = archiver.flushingCapacity;
+        archiver.pendingLength = 0;
+        archiver.flushing = data;
+        archiver.flushingCapacity = capacity;
+        archiver.writing = true;
+
+        pthread_mutex_unlock(&archiver.lock);
+        const bool ok = archiver.fd >= 0 && writeAll(archiver.fd, data, length) && syncFile(archiver.fd);
+        pthread_mutex_lock(&archiver.lock);
+
+        if (ok) archiver.durable = target;
+        else archiver.failed = true;
+        archiver.writing = false;
+        pthread_cond_broadcast(&archiver.written);
+    }
+    return !archiver.failed;
+}
+
+// flushArchive waits until every archived order is durable, a checkpoint may only leave them out after that
+bool flushArchive() {
+    pthread_mutex_lock(&archiver.lock);
+    const bool ok = archiveWrite();
+    pthread_mutex_unlock(&archiver.lock);
+    return ok;
+}
+
+// archiveLength is how long the archive is once what was appended is durable, 0 without an open archive
+uint64_t archiveLength() {
+    pthread_mutex_lock(&archiver.lock);
+    const uint64_t length = archiver.fd >= 0 ? archiver.opened + archiver.appended : 0;
+    pthread_mutex_unlock(&archiver.lock);
+    return length;
+}
+
+// markArchiveCheckpoint records in the header how long the archive was when the orders file that was just
+// committed was written. The appending descriptor can't write anywhere but the end, so the header is written
+// through one of its own. A crash before it is durable only leaves the mark where it was.
+bool markArchiveCheckpoint(uint64_t length) {
+    if (length == 0) return true;
+#ifdef _WIN32
+    const int fd = open(archiveFilePath, O_WRONLY | O_BINARY);
+#else
+    const int fd = open(archiveFilePath, O_WRONLY);
+#endif
+    if (fd < 0) return false;
+    const bool ok = lseek(fd, offsetof(ArchiveFileHeader, checkpointed), SEEK_SET) >= 0 &&
+                    writeAll(fd, (const char *) &length, sizeof(length)) && syncFile(fd);
+    close(fd);
+    return ok;
+}
+
+void *archiverWorker(void *argument) {
+    (void) argument;
+    pthread_mutex_lock(&archiver.lock);
+    while (!archiver.stopping || archiver.durable < archiver.appended) {
+        if (archiver.durable == archiver.appended || archiver.failed) {
+            if (archiver.stopping) break;
+            pthread_cond_wait(&archiver.wake, &archiver.lock);
+            continue;
+        }
+        archiveWrite();
+    }
+    pthread_mutex_unlock(&archiver.lock);
+    return NULL;
+}
+
+// startArchiver starts the thread that writes the archive, minimumAge is how long an order stays
+// in memory after it settled
+bool startArchiver(long long minimumAge) {
+    archiver.minimumAge = minimumAge;
+    archiver.stopping = false;
+    archiver.running = pthread_create(&archiver.thread, NULL, archiverWorker, NULL) == 0;
+    return archiver.running;
+}
+
+// stopArchiver lets the thread write out what is pending, waits for it and closes the archive
+void stopArchiver() {
+    if (archiver.running) {
+        pthread_mutex_lock(&archiver.lock);
+        archiver.stopping = true;
+        pthread_cond_signal(&archiver.wake);
+        pthread_mutex_unlock(&archiver.lock);
+        pthread_join(archiver.thread, NULL);
+        archiver.running = false;
+    }
+    if (!flushArchive()) fprintf(stderr, "failed to write %s\n", archiveFilePath);
+    if (archiver.fd >= 0) close(archiver.fd);
+    archiver.fd = -1;
+}
+
+// archiveTick is the main loop timer that archives the orders old enough
+void archiveTick(void *context) {
+    (void) context;
+    archiveOrders(wallNanos() - archiver.minimumAge);
+}
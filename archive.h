@@ -0,0 +1,108 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "restaurant.h"
+#include "storage.h"
+
+#define ARCHIVE_VERSION 2
+
+// orders settled longer ago than this leave memory for the archive, the main loop looks for them this often
+#define ARCHIVE_MIN_AGE_SECONDS (60 * 60)
+#define ARCHIVE_INTERVAL_MILLIS 60000
+
+// ArchiveFileHeader starts the archive, records are only ever appended after it. checkpointed is how long the
+// archive was when the last checkpoint was written, the orders before it had left memory by then, so only the
+// ones after it can also be in the checkpoint.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t itemRecordSize;
+    uint64_t checkpointed;
+} ArchiveFileHeader;
+
+// ArchiveRecord is one archived order followed by its items, the checksum covers both
+typedef struct {
+    uint32_t size;
+    uint32_t checksum;
+    int32_t id;
+    int32_t cashierId;
+    int32_t paymentType;
+    int32_t orderStatus;
+    int32_t itemCount;
+    int32_t reserved;
+} ArchiveRecord;
+
+// ArchiveItemRecord keeps the price the item was sold at, an archived order is never revalued
+typedef struct {
+    int32_t id;
+    int32_t stockId;
+    int32_t quantity;
+    int32_t price;
+} ArchiveItemRecord;
+
+// Archiver moves settled orders out of memory. The thread that owns the order list encodes them into pending
+// and frees them, the archiver thread swaps the buffers and appends and syncs what was pending, like the journal.
+// Archived orders stay in the last checkpoint and the journal until the next checkpoint, which flushes the archive
+// first, so a crash before they are durable loses nothing. opened is how long the file was when it was opened,
+// appended and durable count from there.
+typedef struct {
+    int fd;
+    pthread_t thread;
+    bool running;
+    bool stopping;
+    bool writing;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t written;
+    char *pending;
+    size_t pendingLength;
+    size_t pendingCapacity;
+    char *flushing;
+    size_t flushingCapacity;
+    uint64_t opened;
+    uint64_t appended;
+    uint64_t durable;
+    long long minimumAge;
+    long long archived;
+} Archiver;
+
+extern const char *archiveFilePath;
+
+extern Archiver archiver;
+
+// functions for reading the archive back, it is streamed once at startup to restore the sales totals
+bool restoreArchivedOrder(const ArchiveRecord *record, const ArchiveItemRecord items[], bool checkpointed);
+
+bool validateArchive(const MappedFile *file);
+
+bool nextArchiveRecord(const MappedFile *file, size_t *offset, ArchiveRecord *record,
+                       const ArchiveItemRecord **items);
+
+bool readArchive();
+
+bool openArchive();
+
+// functions for archiving, archiveOrders runs on the thread that adds and removes orders
+bool appendArchiveRecord(const Order *order);
+
+int archiveOrders(long long settledBefore);
+
+bool archiveWrite();
+
+bool flushArchive();
+
+uint64_t archiveLength();
+
+bool markArchiveCheckpoint(uint64_t length);
+
+void *archiverWorker(void *argument);
+
+bool startArchiver(long long minimumAge);
+
+void stopArchiver();
+
+void archiveTick(void *context);
+
+#endif
@@ -0,0 +1,1925 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "catalog.h"
+#include "client.h"
+#include "events.h"
+#include "export.h"
+#include "kitchen.h"
+#include "metrics.h"
+#include "restaurant.h"
+#include "screen.h"
+#include "server.h"
+#include "shared.h"
+#include "snapshot.h"
+#include "storage.h"
+
+int benchRandom(unsigned int *seed, int bound);
+
+void benchCoreRow(const char *benchmark, int records, long long operations, long long elapsed);
+
+void benchCore();
+
+void benchLookups();
+
+void benchStartup();
+
+void benchJournal();
+
+void benchIds();
+
+void benchPipeline();
+
+void benchKitchen();
+
+void benchEvents();
+
+void drawBenchBoard(Screen *screen, int frame);
+
+void benchRender();
+
+void benchBoard();
+
+void benchSales();
+
+void benchNames();
+
+void benchReserve();
+
+void benchItems();
+
+void benchSnapshot();
+
+void benchServer();
+
+void benchShared();
+
+void benchMetrics();
+
+void benchExport();
+
+void benchStrings();
+
+void benchCatalog();
+
+// c_restaurant_bench runs one suite, "core" by default, which prints CSV so runs can be diffed for regressions
+int main(int argc, char *argv[]) {
+    const char *names[] = {
+        "core", "lookups", "startup", "journal", "ids", "pipeline", "kitchen", "events", "render", "board", "sales",
+        "names", "reserve", "items", "snapshot", "server", "shared", "metrics", "export",
+        "strings", "catalog"
+    };
+    void (*suites[])() = {
+        benchCore, benchLookups, benchStartup, benchJournal, benchIds, benchPipeline, benchKitchen, benchEvents,
+        benchRender, benchBoard, benchSales, benchNames, benchReserve, benchItems, benchSnapshot, benchServer,
+        benchShared, benchMetrics, benchExport, benchStrings, benchCatalog
+    };
+    const int suiteCount = sizeof(suites) / sizeof(suites[0]);
+
+    const char *name = argc > 1 ? argv[1] : "core";
+    for (int i = 0; i < suiteCount; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            suites[i]();
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "usage: %s [", argv[0]);
+    for (int i = 0; i < suiteCount; i++) fprintf(stderr, "%s%s", i == 0 ? "" : "|", names[i]);
+    fprintf(stderr, "]\n");
+    return 1;
+}
+
+int benchRandom(unsigned int *seed, int bound) {
+    // xorshift, rand() is too slow and too short on some platforms for a million records
+    unsigned int x = *seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *seed = x;
+    return (int) (x % (unsigned int) bound);
+}
+
+// benchLookups measures findOrder, findStock and findUser from 100 to 1M records,
+// the cost per lookup should stay flat as the lists grow.
+void benchLookups() {
+    const int lookups = 1000000;
+    unsigned int seed = 2463534242U;
+    idsFilePath = NULL;
+
+    printf("%-10s %-12s %-12s %-12s\n", "records", "findOrder", "findStock", "findUser");
+    for (int records = 100; records <= 1000000; records *= 10) {
+        for (int i = 1; i <= records; i++) {
+            Order *order = createOrder(i, CASH);
+            order->id = i;
+            addOrder(order);
+
+            Stock *stock = createStock("bench", 1, 1);
+            stock->id = i;
+            addStock(stock);
+
+            User *user = createUser("bench", "bench", CASHIER);
+            user->id = i;
+            addUser(user);
+        }
+
+        long long found = 0;
+        long long start = nowNanos();
+        for (int i = 0; i < lookups; i++) found += findOrder(benchRandom(&seed, records) + 1) != NULL;
+        const long long orderNanos = nowNanos() - start;
+
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) found += findStock(benchRandom(&seed, records) + 1) != NULL;
+        const long long stockNanos = nowNanos() - start;
+
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) found += findUser(benchRandom(&seed, records) + 1) != NULL;
+        const long long userNanos = nowNanos() - start;
+
+        if (found != 3LL * lookups) fprintf(stderr, "lookup missed %lld records\n", 3LL * lookups - found);
+        printf("%-10d %-12.1f %-12.1f %-12.1f\n", records, (double) orderNanos / lookups,
+                (double) stockNanos / lookups, (double) userNanos / lookups);
+
+        clearOrders();
+        while (stocks.head != NULL) removeStock(stocks.head);
+        while (users.head != NULL) removeUser(users.head);
+    }
+    printf("(ns per lookup)\n");
+}
+
+// benchStartup writes a million orders to a scratch file and times loading them back,
+// then checks that truncated and corrupted copies are rejected.
+void benchStartup() {
+    const int records = 1000000;
+    ordersFilePath = "bench_orders.dat";
+    idsFilePath = NULL;
+
+    for (int i = 1; i <= records; i++) {
+        Order *order = createOrder(i % 100, CASH);
+        order->id = i;
+        addOrder(order);
+        for (int j = 0; j < 3; j++) {
+            appendItem(order, j + 1, j + 1);
+        }
+    }
+
+    long long start = nowNanos();
+    const bool written = writeOrdersToFile() && commitDataFile(ordersFilePath);
+    const long long writeNanos = nowNanos() - start;
+    clearOrders();
+
+    start = nowNanos();
+    const bool read = written && readOrdersFromFile();
+    const long long readNanos = nowNanos() - start;
+
+    printf("orders: %d (%d loaded)\n", records, orders.length);
+    printf("write: %.1f ms\n", writeNanos / 1e6);
+    printf("load: %.1f ms (%.1f ns per order)\n", readNanos / 1e6, (double) readNanos / records);
+    clearOrders();
+
+    // a copy with the last record cut off must be rejected
+    MappedFile file;
+    if (read && mapFile(ordersFilePath, &file)) {
+        FILE *copy = fopen("bench_orders_bad.dat", "wb");
+        fwrite(file.data, 1, file.size - 1, copy);
+        fclose(copy);
+        ordersFilePath = "bench_orders_bad.dat";
+        printf("truncated file rejected: %s\n", readOrdersFromFile() ? "no" : "yes");
+
+        // and so must a copy with a single flipped byte in the middle
+        copy = fopen("bench_orders_bad.dat", "wb");
+        fwrite(file.data, 1, file.size, copy);
+        fseek(copy, file.size / 2, SEEK_SET);
+        fputc(file.data[file.size / 2] ^ 0xff, copy);
+        fclose(copy);
+        printf("corrupted file rejected: %s\n", readOrdersFromFile() ? "no" : "yes");
+
+        clearOrders();
+        unmapFile(&file);
+        remove("bench_orders_bad.dat");
+    }
+    remove("bench_orders.dat");
+}
+
+typedef struct {
+    int records;
+} BenchJournalWorker;
+
+void *benchJournalWorker(void *argument) {
+    const BenchJournalWorker *worker = argument;
+    for (int i = 0; i < worker->records; i++) {
+        journalWrite(JOURNAL_INCREMENT_QUANTITY, (int32_t[4]) {i % 100, 1}, NULL, 0);
+    }
+    return NULL;
+}
+
+// benchJournal compares a sync per record with group commit as the number of writing threads grows
+void benchJournal() {
+    const int recordsPerThread = 200;
+    journalFilePath = "bench_journal.dat";
+
+    printf("%-8s %-14s %-14s %-10s\n", "threads", "mode", "records/sec", "syncs");
+    for (int threads = 1; threads <= 16; threads *= 2) {
+        for (int groupCommit = 0; groupCommit <= 1; groupCommit++) {
+            openJournal(0);
+            journal.groupCommit = groupCommit;
+            journal.syncs = 0;
+
+            pthread_t workers[16];
+            BenchJournalWorker worker = {recordsPerThread};
+            const long long start = nowNanos();
+            for (int i = 0; i < threads; i++) pthread_create(&workers[i], NULL, benchJournalWorker, &worker);
+            for (int i = 0; i < threads; i++) pthread_join(workers[i], NULL);
+            const long long elapsed = nowNanos() - start;
+
+            printf("%-8d %-14s %-14.0f %-10llu\n", threads, groupCommit ? "group commit" : "sync per op",
+                    (double) threads * recordsPerThread * 1e9 / elapsed, (unsigned long long) journal.syncs);
+            closeJournal();
+        }
+    }
+    remove("bench_journal.dat");
+}
+
+typedef struct {
+    int count;
+    int *ids;
+} BenchIdsWorker;
+
+void *benchIdsWorker(void *argument) {
+    BenchIdsWorker *worker = argument;
+    for (int i = 0; i < worker->count; i++) worker->ids[i] = nextId(ORDER_ID);
+    return NULL;
+}
+
+// benchIds allocates ids from several threads at once and checks that none repeat
+void benchIds() {
+    const int idsPerThread = 1000000;
+    idsFilePath = "bench_ids.dat";
+
+    printf("%-8s %-14s %-10s\n", "threads", "ids/sec", "duplicates");
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        pthread_t threadIds[8];
+        BenchIdsWorker workers[8];
+        int *ids = malloc(sizeof(int) * idsPerThread * threads);
+
+        const long long start = nowNanos();
+        for (int i = 0; i < threads; i++) {
+            workers[i].count = idsPerThread;
+            workers[i].ids = ids + (size_t) i * idsPerThread;
+            pthread_create(&threadIds[i], NULL, benchIdsWorker, &workers[i]);
+        }
+        for (int i = 0; i < threads; i++) pthread_join(threadIds[i], NULL);
+        const long long elapsed = nowNanos() - start;
+
+        qsort(ids, (size_t) idsPerThread * threads, sizeof(int), compareInts);
+        int duplicates = 0;
+        for (int i = 1; i < idsPerThread * threads; i++) duplicates += ids[i] == ids[i - 1];
+        free(ids);
+
+        printf("%-8d %-14.0f %-10d\n", threads, (double) idsPerThread * threads * 1e9 / elapsed,
+                duplicates);
+    }
+    remove("bench_ids.dat");
+}
+
+typedef struct {
+    KitchenPipeline *pipeline;
+    Order **orders;
+    int count;
+} BenchCashier;
+
+void *benchCashier(void *argument) {
+    const BenchCashier *cashier = argument;
+    int misses = 0;
+    for (int i = 0; i < cashier->count; i++) {
+        while (!publishOrder(&cashier->pipeline->queue, cashier->orders[i])) backoff(&misses);
+        misses = 0;
+    }
+    return NULL;
+}
+
+// benchPipeline pushes orders from cashier threads through the kitchen queue to chef threads,
+// checks that every order is cooked exactly once and reports throughput and handoff latency
+void benchPipeline() {
+    const int total = 200000;
+    idsFilePath = NULL;
+
+    Order **all = malloc(sizeof(Order *) * total);
+    for (int i = 0; i < total; i++) {
+        all[i] = createOrder(1, CASH);
+        addOrder(all[i]);
+    }
+    long long *latencies = malloc(sizeof(long long) * total * 4);
+
+    printf("%-10s %-6s %-14s %-12s %-12s %-6s\n", "cashiers", "chefs", "orders/sec", "p50 ns", "p99 ns",
+            "ok");
+    for (int cashierCount = 1; cashierCount <= 4; cashierCount *= 2) {
+        for (int chefCount = 1; chefCount <= 4; chefCount *= 2) {
+            for (int i = 0; i < total; i++) all[i]->orderStatus = WAITING;
+
+            KitchenPipeline pipeline;
+            ChefWorker chefs[4];
+            for (int i = 0; i < chefCount; i++) {
+                chefs[i].latencies = latencies + (long long) i * total;
+                chefs[i].latencyCapacity = total;
+            }
+
+            const long long start = nowNanos();
+            if (!startKitchen(&pipeline, 1024, NULL, chefs, chefCount)) {
+                fprintf(stderr, "failed to start the kitchen\n");
+                break;
+            }
+            pthread_t threads[4];
+            BenchCashier cashiers[4];
+            for (int i = 0; i < cashierCount; i++) {
+                const int begin = (int) ((long long) total * i / cashierCount);
+                const int end = (int) ((long long) total * (i + 1) / cashierCount);
+                cashiers[i] = (BenchCashier) {&pipeline, all + begin, end - begin};
+                pthread_create(&threads[i], NULL, benchCashier, &cashiers[i]);
+            }
+            for (int i = 0; i < cashierCount; i++) pthread_join(threads[i], NULL);
+            stopKitchen(&pipeline, chefs, chefCount);
+            const long long elapsed = nowNanos() - start;
+
+            // gather the latencies each chef recorded into one sorted run
+            long long cooked = 0, recorded = 0;
+            for (int i = 0; i < chefCount; i++) {
+                memmove(latencies + recorded, chefs[i].latencies, sizeof(long long) * chefs[i].cooked);
+                recorded += chefs[i].cooked;
+                cooked += chefs[i].cooked;
+            }
+            qsort(latencies, recorded, sizeof(long long), compareLongLongs);
+
+            bool ok = cooked == total;
+            for (int i = 0; i < total && ok; i++) ok = all[i]->orderStatus == COMPLETED;
+
+            printf("%-10d %-6d %-14.0f %-12lld %-12lld %-6s\n", cashierCount, chefCount,
+                    total * 1e9 / elapsed, recorded > 0 ? latencies[recorded / 2] : 0,
+                    recorded > 0 ? latencies[recorded * 99 / 100] : 0, ok ? "yes" : "NO");
+        }
+    }
+
+    free(latencies);
+    free(all);
+    clearOrders();
+}
+
+// benchCook simulates cooking by sleeping 100us per portion, so stations overlap even on one core
+void benchCook(const KitchenTask *task) {
+#ifdef _WIN32
+    Sleep(task->item->quantity / 10 + 1);
+#else
+    const struct timespec duration = {0, 100000L * task->item->quantity};
+    nanosleep(&duration, NULL);
+#endif
+}
+
+// benchKitchen replays a rush where most items go to one station, with and without stealing,
+// and reports the makespan, ticket times and how long tasks waited for a station
+void benchKitchen() {
+    const int orderCount = 2000;
+    const int stationCount = 4;
+    idsFilePath = NULL;
+
+    // find a stock id for every station, the first one gets most of the items
+    KitchenScheduler probe = {.stationCount = stationCount};
+    int stockOfStation[4] = {-1, -1, -1, -1};
+    for (int stockId = 1, found = 0; found < stationCount; stockId++) {
+        const int station = stationForStock(&probe, stockId);
+        if (stockOfStation[station] == -1) {
+            stockOfStation[station] = stockId;
+            found++;
+        }
+    }
+
+    unsigned int seed = 88172645U;
+    Order **all = malloc(sizeof(Order *) * orderCount);
+    int taskCount = 0;
+    for (int i = 0; i < orderCount; i++) {
+        all[i] = createOrder(1, CASH);
+        const int items = benchRandom(&seed, 3) + 1;
+        for (int j = 0; j < items; j++) {
+            const int station = benchRandom(&seed, 10) < 7 ? 0 : benchRandom(&seed, stationCount);
+            appendItem(all[i], stockOfStation[station], benchRandom(&seed, 2) + 1);
+            taskCount++;
+        }
+        addOrder(all[i]);
+    }
+
+    KitchenTicket *tickets = malloc(sizeof(KitchenTicket) * orderCount);
+    long long *waits = malloc(sizeof(long long) * taskCount * stationCount);
+    long long *ticketTimes = malloc(sizeof(long long) * orderCount);
+
+    printf("%-10s %-14s %-14s %-14s %-14s %-8s\n", "stealing", "makespan ms", "p50 ticket ms",
+            "p99 ticket ms", "p99 wait ms", "stolen");
+    for (int stealing = 0; stealing <= 1; stealing++) {
+        Station stations[4];
+        for (int i = 0; i < stationCount; i++) {
+            stations[i].waits = waits + (long long) i * taskCount;
+            stations[i].waitCapacity = taskCount;
+        }
+        KitchenScheduler scheduler = {.stations = stations};
+        for (int i = 0; i < orderCount; i++) all[i]->orderStatus = WAITING;
+
+        const long long start = nowNanos();
+        if (!startScheduler(&scheduler, stationCount, stealing, benchCook)) {
+            fprintf(stderr, "failed to start the scheduler\n");
+            break;
+        }
+        // orders arrive every 150us, faster than the busy station alone can keep up with
+        for (int i = 0; i < orderCount; i++) {
+            tickets[i].order = all[i];
+            dispatchOrder(&scheduler, &tickets[i]);
+            const struct timespec arrival = {0, 150000};
+            nanosleep(&arrival, NULL);
+        }
+        stopScheduler(&scheduler);
+        const long long makespan = nowNanos() - start;
+
+        long long recorded = 0, stolen = 0;
+        for (int i = 0; i < stationCount; i++) {
+            memmove(waits + recorded, stations[i].waits, sizeof(long long) * stations[i].cooked);
+            recorded += stations[i].cooked;
+            stolen += stations[i].stolen;
+        }
+        qsort(waits, recorded, sizeof(long long), compareLongLongs);
+        for (int i = 0; i < orderCount; i++) ticketTimes[i] = tickets[i].completedAt - tickets[i].dispatchedAt;
+        qsort(ticketTimes, orderCount, sizeof(long long), compareLongLongs);
+
+        printf("%-10s %-14.1f %-14.2f %-14.2f %-14.2f %-8lld\n", stealing ? "on" : "off", makespan / 1e6,
+                ticketTimes[orderCount / 2] / 1e6, ticketTimes[orderCount * 99 / 100] / 1e6,
+                recorded > 0 ? waits[recorded * 99 / 100] / 1e6 : 0, stolen);
+    }
+
+    free(ticketTimes);
+    free(waits);
+    free(tickets);
+    free(all);
+    clearOrders();
+}
+
+// benchCoreRow prints one CSV row: benchmark,records,operations,ns_per_op
+void benchCoreRow(const char *benchmark, int records, long long operations, long long elapsed) {
+    printf("%s,%d,%lld,%.1f\n", benchmark, records, operations, (double) elapsed / operations);
+}
+
+// benchCore measures the core list operations from 10^2 to 10^6 records of each kind.
+// The linear scans run fewer operations on large lists so every row takes about the same time.
+void benchCore() {
+    unsigned int seed = 314159265U;
+    idsFilePath = NULL;
+
+    printf("benchmark,records,operations,ns_per_op\n");
+    for (int records = 100; records <= 1000000; records *= 10) {
+        char name[32];
+        for (int i = 1; i <= records; i++) {
+            snprintf(name, sizeof(name), "user%d", i);
+            User *user = createUser(name, "hashed", CASHIER);
+            user->id = i;
+            addUser(user);
+
+            snprintf(name, sizeof(name), "stock%d", i);
+            Stock *stock = createStock(name, 10, 1000);
+            stock->id = i;
+            addStock(stock);
+        }
+        for (int i = 1; i <= records; i++) {
+            Order *order = createOrder(benchRandom(&seed, records) + 1, CASH);
+            order->id = i;
+            addOrder(order);
+            for (int j = 0; j < 3; j++) addItemToOrder(order, benchRandom(&seed, records) + 1, 1);
+        }
+
+        const long long lookups = 1000000;
+        const long long scans = records >= 100000 ? 100 : 10000000 / records;
+        long long found = 0;
+
+        long long start = nowNanos();
+        for (long long i = 0; i < lookups; i++) found += findOrder(benchRandom(&seed, records) + 1) != NULL;
+        benchCoreRow("findOrder", records, lookups, nowNanos() - start);
+
+        start = nowNanos();
+        for (long long i = 0; i < lookups; i++) found += findStock(benchRandom(&seed, records) + 1) != NULL;
+        benchCoreRow("findStock", records, lookups, nowNanos() - start);
+
+        start = nowNanos();
+        for (long long i = 0; i < lookups; i++) found += findUser(benchRandom(&seed, records) + 1) != NULL;
+        benchCoreRow("findUser", records, lookups, nowNanos() - start);
+
+        start = nowNanos();
+        for (long long i = 0; i < scans; i++) {
+            snprintf(name, sizeof(name), "user%d", benchRandom(&seed, records) + 1);
+            found += findUserByName(name) != NULL;
+        }
+        benchCoreRow("findUserByName", records, scans, nowNanos() - start);
+
+        // about one more item per order, so the item lists stay the size real orders have
+        start = nowNanos();
+        for (long long i = 0; i < records; i++) {
+            addItemToOrder(findOrder(benchRandom(&seed, records) + 1), benchRandom(&seed, records) + 1, 1);
+        }
+        benchCoreRow("addItemToOrder", records, records, nowNanos() - start);
+
+        start = nowNanos();
+        Item item;
+        for (long long i = 0; i < scans; i++) found += findItemFromOrder(benchRandom(&seed, records) + 1, &item);
+        benchCoreRow("findItemFromOrder", records, scans, nowNanos() - start);
+
+        Order *using[16];
+        start = nowNanos();
+        for (long long i = 0; i < lookups; i++) {
+            found += findOrdersUsingStock(benchRandom(&seed, records) + 1, WAITING, using, 16);
+        }
+        benchCoreRow("findOrdersUsingStock", records, lookups, nowNanos() - start);
+
+        // printOrders renders every row, this is that rendering without the terminal
+        const long long renders = records >= 100000 ? 1 : 100000 / records;
+        char row[256];
+        start = nowNanos();
+        for (long long i = 0; i < renders; i++) {
+            for (Order *order = orders.head; order != NULL; order = order->next) {
+                found += formatOrderRow(order, row, sizeof(row))[0] == '|';
+            }
+        }
+        benchCoreRow("printOrders", records, renders, nowNanos() - start);
+
+        const long long removals = records / 2;
+        start = nowNanos();
+        for (long long i = 0; i < removals; i++) removeOrder(benchRandom(&seed, records) + 1);
+        benchCoreRow("removeOrder", records, removals, nowNanos() - start);
+
+        if (found == 0) fprintf(stderr, "nothing found\n");
+        clearOrders();
+        while (stocks.head != NULL) removeStock(stocks.head);
+        while (users.head != NULL) removeUser(users.head);
+    }
+}
+
+#ifndef _WIN32
+typedef struct {
+    int fd;
+    int keys;
+    _Atomic long long pressedAt;
+} BenchTypist;
+
+// benchTypist presses a key every millisecond by writing to the pipe the event loop waits on
+void *benchTypist(void *argument) {
+    BenchTypist *typist = argument;
+    const struct timespec pause = {0, 1000000};
+    for (int i = 0; i < typist->keys; i++) {
+        nanosleep(&pause, NULL);
+        atomic_store(&typist->pressedAt, nowNanos());
+        if (write(typist->fd, "k", 1) != 1) break;
+    }
+    return NULL;
+}
+
+void benchTick(void *context) {
+    (*(int *) context)++;
+}
+#endif
+
+// benchEvents measures how long a keystroke takes to wake the event loop,
+// and how much CPU the loop burns while it only runs a refresh timer
+void benchEvents() {
+#ifdef _WIN32
+    printf("the events suite needs pipes and is not available on Windows\n");
+#else
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) return;
+
+    EventLoop loop;
+    initEventLoop(&loop, pipeFds[0]);
+    BenchTypist typist = {pipeFds[1], 1000, 0};
+    long long *latencies = malloc(sizeof(long long) * typist.keys);
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, benchTypist, &typist);
+    int received = 0;
+    while (received < typist.keys && waitForInput(&loop, 1000)) {
+        char key;
+        if (read(pipeFds[0], &key, 1) != 1) break;
+        latencies[received++] = nowNanos() - atomic_load(&typist.pressedAt);
+    }
+    pthread_join(thread, NULL);
+
+    qsort(latencies, received, sizeof(long long), compareLongLongs);
+    printf("keystrokes: %d\n", received);
+    if (received > 0) {
+        printf("latency p50: %.1f us, p99: %.1f us, max: %.1f us\n", latencies[received / 2] / 1e3,
+               latencies[received * 99 / 100] / 1e3, latencies[received - 1] / 1e3);
+    }
+    free(latencies);
+
+    // idle with the order board refresh timer, nothing is typed
+    int ticks = 0;
+    addTimer(&loop, 100, benchTick, &ticks);
+    const clock_t cpuStart = clock();
+    const long long start = nowNanos();
+    waitForInput(&loop, 2000);
+    const double cpu = (double) (clock() - cpuStart) / CLOCKS_PER_SEC;
+    const double wall = (nowNanos() - start) / 1e9;
+    printf("idle: %.2f s, %d timer ticks, %.3f%% cpu\n", wall, ticks, cpu / wall * 100);
+
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+#endif
+}
+
+// drawBenchBoard draws the order board the way the ui does, one status changes every frame
+void drawBenchBoard(Screen *screen, int frame) {
+    screenClear(screen);
+    screenPrintf(screen, "Available Orders\n\n");
+    screenPrintf(screen, "| %-5s | %-10s | %-10s | %-10s | %-25s |\n", "ID", "Cashier", "Payment", "Status", "Items");
+    for (int i = 0; i < 18; i++) {
+        const int completed = (i + frame) % 18 == 0;
+        screenPrintf(screen, "| %-5d | %-10d | %-10s | \033[%dm%-10s\033[0m | %-25s |\n", 1000 + i, 7, "Cash",
+                     completed ? 32 : 0, completed ? "Completed" : "Waiting", "Burger, Fries");
+    }
+    screenPrintf(screen, "\nPress enter to continue...");
+}
+
+// benchRender compares redrawing the order board through the screen diff against repainting it in full,
+// and times the system("clear") the ui used to run before every redraw
+void benchRender() {
+    const int frames = 10000;
+    Screen screen = {0};
+    initScreen(&screen, 80, 24);
+    FILE *sink = fopen(
+#ifdef _WIN32
+        "NUL",
+#else
+        "/dev/null",
+#endif
+        "w");
+    if (sink == NULL) return;
+
+    for (int full = 1; full >= 0; full--) {
+        screenInvalidate(&screen);
+        screen.bytesWritten = 0;
+        const long long start = nowNanos();
+        for (int frame = 0; frame < frames; frame++) {
+            drawBenchBoard(&screen, frame);
+            if (full) screenInvalidate(&screen);
+            screenFlush(&screen, sink);
+        }
+        const long long elapsed = nowNanos() - start;
+        printf("%s: %.0f bytes/frame, %.2f us/frame\n", full ? "full repaint" : "incremental",
+               (double) screen.bytesWritten / frames, elapsed / 1e3 / frames);
+    }
+
+    const int clears = 50;
+    const long long start = nowNanos();
+    for (int i = 0; i < clears; i++) {
+#ifdef _WIN32
+        system("cls > NUL");
+#else
+        system("clear > /dev/null");
+#endif
+    }
+    printf("system(\"clear\"): %.2f us/frame\n", (nowNanos() - start) / 1e3 / clears);
+
+    fclose(sink);
+    freeScreen(&screen);
+}
+
+// benchBoard times a redraw of a 17 row order board window against printing every order, from 1k to 1M orders.
+// The window should cost the same at every size, with and without a status filter.
+void benchBoard() {
+    const int redraws = 1000;
+    idsFilePath = NULL;
+    char row[256];
+    Order *visible[17];
+    Screen screen = {0};
+    initScreen(&screen, 80, 24);
+
+    printf("%-10s %-14s %-14s %-14s\n", "orders", "window", "filtered", "full list");
+    for (int records = 1000; records <= 1000000; records *= 10) {
+        for (int i = 1; i <= records; i++) {
+            Order *order = createOrder(1, CASH);
+            order->id = i;
+            // one order in ten is still waiting, like a busy day's list
+            order->orderStatus = i % 10 == 0 ? WAITING : COMPLETED;
+            addOrder(order);
+        }
+
+        double nanos[2];
+        for (int filtered = 0; filtered < 2; filtered++) {
+            OrderBoard board;
+            initOrderBoard(&board, 17, filtered ? WAITING : BOARD_ALL_STATUSES);
+            boardJump(&board, records / 2);
+            const long long start = nowNanos();
+            for (int i = 0; i < redraws; i++) {
+                screenClear(&screen);
+                const int count = boardVisible(&board, visible);
+                for (int j = 0; j < count; j++) {
+                    screenPrintf(&screen, "%s\n", formatOrderRow(visible[j], row, sizeof(row)));
+                }
+                boardMove(&board, i % 2 == 0 ? 1 : -1);
+            }
+            nanos[filtered] = (double) (nowNanos() - start) / redraws;
+        }
+
+        // the old board printed every order, time a few passes of that
+        const int passes = records >= 100000 ? 3 : 30;
+        const long long start = nowNanos();
+        for (int i = 0; i < passes; i++) {
+            screenClear(&screen);
+            for (Order *order = orders.head; order != NULL; order = order->next) {
+                screenPrintf(&screen, "%s\n", formatOrderRow(order, row, sizeof(row)));
+            }
+        }
+        const double fullNanos = (double) (nowNanos() - start) / passes;
+
+        printf("%-10d %-14.1f %-14.1f %-14.1f\n", records, nanos[0] / 1e3, nanos[1] / 1e3, fullNanos / 1e3);
+        clearOrders();
+    }
+    printf("(us per redraw)\n");
+    freeScreen(&screen);
+}
+
+// benchSales times the order changes that keep the sales totals up to date, then compares reading the totals
+// with recounting them from every order, from 1k to 1M orders
+void benchSales() {
+    idsFilePath = NULL;
+    unsigned int seed = 1812433253U;
+    for (int i = 1; i <= 20; i++) {
+        Stock *stock = createStock("bench", 100 + i, 1000000);
+        stock->id = i;
+        addStock(stock);
+    }
+
+    printf("%-10s %-10s %-10s %-10s %-12s %-12s\n", "orders", "add ns", "modify ns", "status ns", "summary ns",
+           "recount ms");
+    for (int records = 1000; records <= 1000000; records *= 10) {
+        Order **all = malloc(sizeof(Order *) * records);
+        for (int i = 0; i < records; i++) {
+            all[i] = createOrder(benchRandom(&seed, 50) + 1, benchRandom(&seed, PAYMENT_TYPE_COUNT));
+            addOrder(all[i]);
+        }
+
+        long long start = nowNanos();
+        for (int i = 0; i < records * 3; i++) addItemToOrder(all[i % records], benchRandom(&seed, 20) + 1, 1);
+        const double addNanos = (double) (nowNanos() - start) / (records * 3);
+
+        start = nowNanos();
+        for (int i = 0; i < records; i++) modifyItemOnOrder(all[i], benchRandom(&seed, 20) + 1, 2);
+        const double modifyNanos = (double) (nowNanos() - start) / records;
+
+        start = nowNanos();
+        for (int i = 0; i < records; i++) setOrderStatus(all[i], i % 5 == 0 ? CANCELLED : COMPLETED);
+        const double statusNanos = (double) (nowNanos() - start) / records;
+
+        const int reads = 1000000;
+        long long revenue = 0;
+        SalesSummary summary;
+        start = nowNanos();
+        for (int i = 0; i < reads; i++) {
+            getSalesSummary(&summary);
+            revenue += summary.statusTotals[COMPLETED];
+        }
+        const double summaryNanos = (double) (nowNanos() - start) / reads;
+
+        char report[256];
+        start = nowNanos();
+        const int mismatches = checkSales(report, sizeof(report));
+        const double recountMillis = (nowNanos() - start) / 1e6;
+        if (mismatches != 0 || revenue <= 0) fprintf(stderr, "sales totals are off: %s\n", report);
+
+        printf("%-10d %-10.1f %-10.1f %-10.1f %-12.1f %-12.2f\n", records, addNanos, modifyNanos, statusNanos,
+               summaryNanos, recountMillis);
+        clearOrders();
+        free(all);
+    }
+}
+
+// benchNames times finding a stock by its full name and listing the first ten stocks under a three letter prefix,
+// against scanning the list, from 1k to 1M stocks
+void benchNames() {
+    const char *words[] = {"burger", "burrito", "bun", "fries", "falafel", "soda", "salad", "steak", "taco", "tea"};
+    const int lookups = 100000;
+    unsigned int seed = 3266489917U;
+    idsFilePath = NULL;
+    char name[64];
+
+    printf("%-10s %-10s %-10s %-10s %-10s\n", "stocks", "add ns", "exact ns", "prefix ns", "scan ns");
+    for (int records = 1000; records <= 1000000; records *= 10) {
+        long long start = nowNanos();
+        for (int i = 0; i < records; i++) {
+            snprintf(name, sizeof(name), "%s %d", words[benchRandom(&seed, 10)], i);
+            addStock(createStock(name, 1, 1));
+        }
+        // the first lookup merges the names added in bulk
+        findStockByName("");
+        const double addNanos = (double) (nowNanos() - start) / records;
+
+        int found = 0;
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) {
+            const int id = benchRandom(&seed, records);
+            snprintf(name, sizeof(name), "%s %d", words[id % 10], id);
+            found += findStockByName(name) != NULL;
+        }
+        const double exactNanos = (double) (nowNanos() - start) / lookups;
+
+        Stock *matches[10];
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) {
+            const char *word = words[benchRandom(&seed, 10)];
+            const char prefix[4] = {word[0], word[1], word[2], '\0'};
+            found += findStocksByPrefix(prefix, matches, 10) > 0;
+        }
+        const double prefixNanos = (double) (nowNanos() - start) / lookups;
+
+        // what finding a name cost before, a strcmp over the list
+        const int scans = records >= 100000 ? 10 : 1000;
+        start = nowNanos();
+        for (int i = 0; i < scans; i++) {
+            snprintf(name, sizeof(name), "%s %d", words[i % 10], benchRandom(&seed, records));
+            for (Stock *stock = stocks.head; stock != NULL; stock = stock->next) {
+                if (strcmp(stringAt(stock->name), name) == 0) break;
+            }
+        }
+        const double scanNanos = (double) (nowNanos() - start) / scans;
+
+        printf("%-10d %-10.1f %-10.1f %-10.1f %-10.0f\n", records, addNanos, exactNanos, prefixNanos, scanNanos);
+        if (found == 0) fprintf(stderr, "no names found\n");
+        while (stocks.head != NULL) removeStock(stocks.head);
+    }
+}
+
+typedef struct {
+    Stock **stocks;
+    int stockCount;
+    int operations;
+    bool hold;
+    bool locked;
+    long long committed;
+    long long refused;
+} BenchReserver;
+
+pthread_mutex_t benchStockLock = PTHREAD_MUTEX_INITIALIZER;
+atomic_bool benchReserving;
+atomic_int benchLowest;
+
+// benchReserver either sells like a cashier, reserving a portion and then cooking or cancelling it,
+// or when hold is off only reserves and releases so the stock never runs out
+void *benchReserver(void *argument) {
+    BenchReserver *reserver = argument;
+    unsigned int seed = (unsigned int) (uintptr_t) reserver | 1;
+    for (int i = 0; i < reserver->operations; i++) {
+        Stock *stock = reserver->stocks[benchRandom(&seed, reserver->stockCount)];
+        const int quantity = reserver->hold ? benchRandom(&seed, 3) + 1 : 1;
+        bool reserved;
+        if (reserver->locked) {
+            // the baseline, the same reservation behind one lock
+            pthread_mutex_lock(&benchStockLock);
+            reserved = stock->quantity >= quantity;
+            if (reserved) {
+                stock->quantity -= quantity;
+                stock->reserved += quantity;
+            }
+            pthread_mutex_unlock(&benchStockLock);
+        } else {
+            reserved = reserveStock(stock, quantity);
+        }
+        if (!reserved) {
+            reserver->refused++;
+            continue;
+        }
+        if (reserver->hold && benchRandom(&seed, 3) > 0) {
+            commitStock(stock, quantity);
+            reserver->committed += quantity;
+        } else {
+            releaseStock(stock, quantity);
+        }
+    }
+    return NULL;
+}
+
+// benchWatcher records the lowest quantity it sees while the cashiers sell
+void *benchWatcher(void *argument) {
+    Stock *stock = argument;
+    while (atomic_load(&benchReserving)) {
+        const int quantity = atomic_load(&stock->quantity);
+        if (quantity < atomic_load(&benchLowest)) atomic_store(&benchLowest, quantity);
+    }
+    return NULL;
+}
+
+// benchReserve first lets 8 threads sell the last 10000 portions of one stock and checks that none is oversold,
+// then measures reservations per second on one hot stock and on 64 stocks, against a mutex
+void benchReserve() {
+    idsFilePath = NULL;
+    pthread_t threadIds[8];
+    BenchReserver reservers[8];
+
+    const int portions = 10000;
+    Stock *hot = createStock("bench", 1, portions);
+    addStock(hot);
+    atomic_store(&benchReserving, true);
+    atomic_store(&benchLowest, portions);
+    pthread_t watcher;
+    pthread_create(&watcher, NULL, benchWatcher, hot);
+    for (int i = 0; i < 8; i++) {
+        reservers[i] = (BenchReserver) {&hot, 1, 100000, true, false, 0, 0};
+        pthread_create(&threadIds[i], NULL, benchReserver, &reservers[i]);
+    }
+    long long committed = 0, refused = 0;
+    for (int i = 0; i < 8; i++) {
+        pthread_join(threadIds[i], NULL);
+        committed += reservers[i].committed;
+        refused += reservers[i].refused;
+    }
+    atomic_store(&benchReserving, false);
+    pthread_join(watcher, NULL);
+
+    const bool conserved = committed + hot->quantity + hot->reserved == portions;
+    printf("stress: %d portions, %lld sold, %d left, %lld refused, lowest quantity seen %d\n", portions, committed,
+           hot->quantity, refused, atomic_load(&benchLowest));
+    printf("never below zero: %s, every portion accounted for: %s\n",
+           atomic_load(&benchLowest) >= 0 && hot->quantity >= 0 ? "yes" : "no", conserved ? "yes" : "no");
+
+    // a negative quantity would hand units back that were never taken, every path refuses it
+    atomic_store(&hot->quantity, 100);
+    Order *order = createOrder(1, CASH);
+    addOrder(order);
+    addItemToOrder(order, hot->id, 5);
+    const int left = hot->quantity, held = hot->reserved;
+    const bool negative = !reserveStock(hot, -3) && !decrementQuantity(hot->id, -50) &&
+                         !addItemToOrder(order, hot->id, -3) && !addItemToOrder(order, hot->id, 0) &&
+                         !modifyItemOnOrder(order, hot->id, -100);
+    printf("negative quantities refused: %s, stock unchanged: %s\n", negative ? "yes" : "no",
+           hot->quantity == left && hot->reserved == held && order->total == 5 ? "yes" : "no");
+    clearOrders();
+
+    Stock *spread[64];
+    for (int i = 0; i < 64; i++) {
+        spread[i] = createStock("bench", 1, 1000000);
+        addStock(spread[i]);
+    }
+    atomic_store(&hot->quantity, 1000000);
+
+    printf("%-8s %-16s %-16s %-16s %-16s\n", "threads", "cas 1 stock", "mutex 1 stock", "cas 64 stocks",
+           "mutex 64 stocks");
+    for (int threads = 1; threads <= 8; threads *= 2) {
+        double rates[4];
+        for (int run = 0; run < 4; run++) {
+            const int operations = 1000000;
+            const long long start = nowNanos();
+            for (int i = 0; i < threads; i++) {
+                reservers[i] = (BenchReserver) {run < 2 ? &hot : spread, run < 2 ? 1 : 64, operations, false,
+                                                run % 2 == 1, 0, 0};
+                pthread_create(&threadIds[i], NULL, benchReserver, &reservers[i]);
+            }
+            for (int i = 0; i < threads; i++) pthread_join(threadIds[i], NULL);
+            rates[run] = (double) threads * operations * 1e9 / (nowNanos() - start);
+        }
+        printf("%-8d %-16.0f %-16.0f %-16.0f %-16.0f\n", threads, rates[0], rates[1], rates[2], rates[3]);
+    }
+    printf("(reservations/sec, each released again)\n");
+    while (stocks.head != NULL) removeStock(stocks.head);
+}
+
+typedef struct BenchListItem BenchListItem;
+
+// BenchListItem and BenchListOrder are the layout orders had before their items moved inline,
+// a list of separately allocated item nodes
+struct BenchListItem {
+    int id;
+    int stockId;
+    int quantity;
+    int price;
+    BenchListItem *next;
+    BenchListItem *prev;
+};
+
+typedef struct BenchListOrder {
+    int id;
+    int cashierId;
+    PaymentType paymentType;
+    OrderStatus orderStatus;
+    BenchListItem *items;
+    long long total;
+    struct BenchListOrder *next;
+    struct BenchListOrder *prev;
+} BenchListOrder;
+
+// benchItems compares the memory of an order and the speed of walking and searching its items,
+// with the items inline against the old linked list. Orders get their lines one round at a time
+// the way busy counters add them, so the list nodes of one order end up spread over memory.
+void benchItems() {
+    const int orderCount = 1000000;
+    idsFilePath = NULL;
+    unsigned int seed = 362436069U;
+
+    printf("%-8s %-14s %-14s\n", "items", "list bytes", "inline bytes");
+    const int sizes[] = {1, 3, 8, 16};
+    for (int i = 0; i < 4; i++) {
+        const int items = sizes[i];
+        const size_t heap = items > ORDER_INLINE_ITEMS ? sizeof(Item) * ORDER_INLINE_ITEMS * 2 : 0;
+        printf("%-8d %-14zu %-14zu\n", items, sizeof(BenchListOrder) + sizeof(BenchListItem) * items,
+               sizeof(Order) + heap);
+    }
+
+    Slab listOrderSlab = {sizeof(BenchListOrder), 1024, NULL, NULL, NULL, NULL, 0};
+    Slab listItemSlab = {sizeof(BenchListItem), 4096, NULL, NULL, NULL, NULL, 0};
+    BenchListOrder **listOrders = malloc(sizeof(BenchListOrder *) * orderCount);
+    Order **inlineOrders = malloc(sizeof(Order *) * orderCount);
+    int *lines = malloc(sizeof(int) * orderCount);
+    long long totalLines = 0;
+    for (int i = 0; i < orderCount; i++) {
+        listOrders[i] = slabAlloc(&listOrderSlab);
+        memset(listOrders[i], 0, sizeof(BenchListOrder));
+        inlineOrders[i] = createOrder(1, CASH);
+        // mostly one to eight lines, now and then a large order that spills to the heap
+        lines[i] = benchRandom(&seed, 100) == 0 ? 12 : benchRandom(&seed, 8) + 1;
+        totalLines += lines[i];
+    }
+    // each round visits the orders in a new random order, as lines come in from many counters at once
+    int *visit = malloc(sizeof(int) * orderCount);
+    for (int i = 0; i < orderCount; i++) visit[i] = i;
+    for (int round = 0; round < 12; round++) {
+        for (int i = orderCount - 1; i > 0; i--) {
+            const int j = benchRandom(&seed, i + 1), swap = visit[i];
+            visit[i] = visit[j];
+            visit[j] = swap;
+        }
+        for (int k = 0; k < orderCount; k++) {
+            const int i = visit[k];
+            if (round >= lines[i]) continue;
+            BenchListItem *item = slabAlloc(&listItemSlab);
+            *item = (BenchListItem) {round, round + 1, 1, 10, listOrders[i]->items, NULL};
+            if (listOrders[i]->items != NULL) listOrders[i]->items->prev = item;
+            listOrders[i]->items = item;
+            appendItem(inlineOrders[i], round + 1, 1)->price = 10;
+        }
+    }
+
+    long long sums[2] = {0, 0};
+    long long start = nowNanos();
+    for (int i = 0; i < orderCount; i++) {
+        for (const BenchListItem *item = listOrders[i]->items; item != NULL; item = item->next) {
+            sums[0] += (long long) item->quantity * item->price;
+        }
+    }
+    const double listWalk = (double) (nowNanos() - start) / totalLines;
+    start = nowNanos();
+    for (int i = 0; i < orderCount; i++) {
+        const Order *order = inlineOrders[i];
+        for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+            sums[1] += (long long) item->quantity * item->price;
+        }
+    }
+    const double inlineWalk = (double) (nowNanos() - start) / totalLines;
+
+    // the lookup addItemToOrder does to merge a stock already on the order
+    long long found[2] = {0, 0};
+    const unsigned int findSeed = seed;
+    start = nowNanos();
+    for (int i = 0; i < orderCount; i++) {
+        const int stockId = benchRandom(&seed, 8) + 1;
+        for (const BenchListItem *item = listOrders[i]->items; item != NULL; item = item->next) {
+            if (item->stockId == stockId) {
+                found[0]++;
+                break;
+            }
+        }
+    }
+    const double listFind = (double) (nowNanos() - start) / orderCount;
+    seed = findSeed;
+    start = nowNanos();
+    for (int i = 0; i < orderCount; i++) found[1] += findOrderItem(inlineOrders[i], benchRandom(&seed, 8) + 1) != NULL;
+    const double inlineFind = (double) (nowNanos() - start) / orderCount;
+
+    if (sums[0] != sums[1] || found[0] != found[1]) fprintf(stderr, "the layouts disagree\n");
+    printf("%d orders, %.2f lines each\n", orderCount, (double) totalLines / orderCount);
+    printf("%-8s %-14s %-14s\n", "", "list", "inline");
+    printf("%-8s %-14.2f %-14.2f (ns per line)\n", "walk", listWalk, inlineWalk);
+    printf("%-8s %-14.2f %-14.2f (ns per order)\n", "find", listFind, inlineFind);
+
+    for (int i = 0; i < orderCount; i++) freeOrderItems(inlineOrders[i]);
+    slabReset(&orderSlab);
+    slabReset(&listOrderSlab);
+    slabReset(&listItemSlab);
+    free(listOrders);
+    free(inlineOrders);
+    free(lines);
+    free(visit);
+}
+
+// BenchReport is an end of day report, the count and value of the orders of each status
+typedef struct {
+    bool locked;
+    bool failed;
+    long long orders;
+    long long counts[ORDER_STATUS_COUNT];
+    long long totals[ORDER_STATUS_COUNT];
+    long long elapsed;
+} BenchReport;
+
+atomic_bool benchReporting;
+
+// benchReportPause stands in for the formatting and output a real report does between batches
+void benchReportPause() {
+#ifdef _WIN32
+    Sleep(1);
+#else
+    const struct timespec duration = {0, 200000L};
+    nanosleep(&duration, NULL);
+#endif
+}
+
+// benchReporter reads every order once, either through the open snapshot or, as the baseline,
+// holding salesLock over the whole list the way a report has to without snapshots
+void *benchReporter(void *argument) {
+    BenchReport *report = argument;
+    const long long start = nowNanos();
+    if (report->locked) {
+        pthread_mutex_lock(&salesLock);
+        for (const Order *order = orders.head; order != NULL; order = order->next) {
+            report->counts[order->orderStatus]++;
+            report->totals[order->orderStatus] += order->total;
+            if (++report->orders % SNAPSHOT_BATCH_SIZE == 0) benchReportPause();
+        }
+        pthread_mutex_unlock(&salesLock);
+    } else {
+        SnapshotBuffer batch = {0};
+        int count;
+        while ((count = readSnapshot(&batch)) > 0) {
+            for (const SnapshotOrder *order = batch.orders; order < batch.orders + count; order++) {
+                long long total = 0;
+                for (int i = 0; i < order->itemCount; i++) {
+                    const SnapshotItem *item = &batch.items[order->firstItem + i];
+                    total += (long long) item->quantity * item->price;
+                }
+                report->counts[order->orderStatus]++;
+                report->totals[order->orderStatus] += total;
+            }
+            report->orders += count;
+            benchReportPause();
+        }
+        report->failed = count < 0;
+        snapshotFreeBuffer(&batch);
+    }
+    report->elapsed = nowNanos() - start;
+    atomic_store(&benchReporting, false);
+    return NULL;
+}
+
+// benchSale is one cashier sale: an order with two lines and a takeaway drink off the shelf, cooked or cancelled,
+// and every fourth sale an old order is removed
+void benchSale(unsigned int *seed, int recent[], int sale) {
+    Order *order = createOrder(1, benchRandom(seed, PAYMENT_TYPE_COUNT));
+    addOrder(order);
+    addItemToOrder(order, benchRandom(seed, 20) + 1, 1);
+    addItemToOrder(order, benchRandom(seed, 20) + 1, 2);
+    decrementQuantity(benchRandom(seed, 20) + 1, 1);
+    setOrderStatus(order, sale % 5 == 0 ? CANCELLED : COMPLETED);
+    const int slot = sale % 4096;
+    if (sale % 4 == 0 && recent[slot] != 0) removeOrder(recent[slot]);
+    recent[slot] = order->id;
+}
+
+// benchSnapshot runs sales on the main thread while a long end of day report reads the orders on another,
+// through a snapshot and holding the lock, and compares the sales rate with no report at all.
+// The snapshot report has to add up to the totals at the moment it opened.
+void benchSnapshot() {
+    idsFilePath = NULL;
+    unsigned int seed = 2891336453U;
+    for (int i = 1; i <= 20; i++) {
+        Stock *stock = createStock("bench", 100 + i, 100000000);
+        stock->id = i;
+        addStock(stock);
+    }
+    int *recent = calloc(4096, sizeof(int));
+    const int preloaded = 200000;
+    for (int i = 0; i < preloaded; i++) benchSale(&seed, recent, i + 1);
+
+    printf("%d orders preloaded\n", orders.length);
+    printf("%-10s %-12s %-14s %-12s %-12s %-10s\n", "report", "sales/sec", "worst sale us", "report ms",
+           "orders read", "consistent");
+    // the snapshot report runs first, the sales without a report then run as long as it took
+    const char *modes[] = {"none", "snapshot", "locked"};
+    const int order[] = {1, 0, 2};
+    long long duration = 0;
+    double rates[3] = {0};
+    for (int run = 0; run < 3; run++) {
+        const int mode = order[run];
+        BenchReport report;
+        memset(&report, 0, sizeof(report));
+        report.locked = mode == 2;
+        SalesSummary summary = {{0}, {0}, {0}};
+        pthread_t reporter;
+        if (mode == 1 && !openSnapshot()) {
+            fprintf(stderr, "cannot open a snapshot\n");
+            break;
+        }
+        if (mode == 1) summary = snapshot.summary;
+        atomic_store(&benchReporting, mode != 0);
+        if (mode != 0) pthread_create(&reporter, NULL, benchReporter, &report);
+
+        long long sales = 0, worst = 0;
+        const long long start = nowNanos();
+        while (mode == 0 ? nowNanos() - start < duration : atomic_load(&benchReporting)) {
+            const long long saleStart = nowNanos();
+            benchSale(&seed, recent, preloaded + (int) sales + 1);
+            const long long elapsed = nowNanos() - saleStart;
+            if (elapsed > worst) worst = elapsed;
+            sales++;
+        }
+        const long long elapsed = nowNanos() - start;
+        if (mode != 0) pthread_join(reporter, NULL);
+        if (mode == 1) closeSnapshot();
+        if (mode == 1) duration = elapsed;
+
+        bool consistent = !report.failed;
+        for (int status = 0; mode == 1 && status < ORDER_STATUS_COUNT; status++) {
+            consistent = consistent && report.counts[status] == summary.orderCounts[status] &&
+                         report.totals[status] == summary.statusTotals[status];
+        }
+        rates[mode] = sales * 1e9 / elapsed;
+        printf("%-10s %-12.0f %-14.1f %-12.1f %-12lld %-10s\n", modes[mode], rates[mode], worst / 1e3,
+               report.elapsed / 1e6, report.orders, mode != 1 ? "-" : consistent ? "yes" : "no");
+    }
+    // with the reader copying outside the lock what is left is its share of the CPU, which shows on few cores
+    if (rates[0] > 0) printf("the snapshot report costs %.0f%% of the sales rate\n", 100 - rates[1] * 100 / rates[0]);
+    clearOrders();
+    free(recent);
+    while (stocks.head != NULL) removeStock(stocks.head);
+}
+
+// BenchTerminal is one cashier terminal of the load test, on a connection of its own
+typedef struct {
+    const char *path;
+    int sales;
+    long long *latencies;
+    long long requests;
+    long long failures;
+} BenchTerminal;
+
+// benchTerminalRequest sends one request and records how long its response took
+int benchTerminalRequest(BenchTerminal *terminal, ServerConnection *server, RequestType type, const int32_t args[4],
+                         const char *text, size_t textLength, ResponseHeader *response) {
+    const long long start = nowNanos();
+    const int status = sendRequest(server, type, args, text, textLength, response);
+    terminal->latencies[terminal->requests++] = nowNanos() - start;
+    if (status != RESPONSE_OK) terminal->failures++;
+    return status;
+}
+
+// benchTerminal logs in and rings up sales, each an order with two items that a chef on a connection of
+// its own then cooks
+void *benchTerminal(void *argument) {
+    BenchTerminal *terminal = argument;
+    ServerConnection server = {-1, 0, 0, NULL, 0, NULL, 0}, chef = {-1, 0, 0, NULL, 0, NULL, 0};
+    if (!connectServer(&server, terminal->path) || !connectServer(&chef, terminal->path)) {
+        disconnectServer(&server);
+        terminal->failures++;
+        return NULL;
+    }
+    unsigned int seed = (unsigned int) (uintptr_t) terminal | 1;
+    char text[64];
+    ResponseHeader response;
+    size_t length = credentials(text, "bench", "password");
+    benchTerminalRequest(terminal, &server, REQUEST_LOGIN, (int32_t[4]) {0}, text, length, &response);
+    length = credentials(text, "benchchef", "password");
+    benchTerminalRequest(terminal, &chef, REQUEST_LOGIN, (int32_t[4]) {0}, text, length, &response);
+    for (int i = 0; i < terminal->sales; i++) {
+        if (benchTerminalRequest(terminal, &server, REQUEST_CREATE_ORDER, (int32_t[4]) {CASH}, NULL, 0, &response) !=
+            RESPONSE_OK)
+            break;
+        const int orderId = response.args[0];
+        for (int j = 0; j < 2; j++) {
+            benchTerminalRequest(terminal, &server, REQUEST_ADD_ITEM,
+                                 (int32_t[4]) {orderId, benchRandom(&seed, 20) + 1, j + 1}, NULL, 0, &response);
+        }
+        benchTerminalRequest(terminal, &chef, REQUEST_COOK, (int32_t[4]) {orderId}, NULL, 0, &response);
+    }
+    disconnectServer(&server);
+    disconnectServer(&chef);
+    return NULL;
+}
+
+void *benchServerWorker(void *argument) {
+    serveRequests(argument);
+    return NULL;
+}
+
+// benchServer is the load test of server mode: a server thread owns the data and 1 to 256 terminals
+// on their own connections ring up sales, it reports requests per second, the request latency and how many
+// journal syncs the requests took
+void benchServer() {
+#ifdef __linux__
+    const char *path = "bench.sock";
+    idsFilePath = NULL;
+    journalFilePath = "bench_journal.dat";
+    openJournal(0);
+    for (int i = 1; i <= 20; i++) {
+        Stock *stock = createStock("bench", 100 + i, 100000000);
+        stock->id = i;
+        addStock(stock);
+    }
+    registerUser("bench", "password", CASHIER);
+    registerUser("benchchef", "password", CHEF);
+
+    Server server;
+    if (!startServer(&server, path)) {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        return;
+    }
+    pthread_t serverThread;
+    pthread_create(&serverThread, NULL, benchServerWorker, &server);
+
+    const int totalSales = 40000;
+    printf("%-10s %-12s %-10s %-10s %-10s %-10s %-10s\n", "terminals", "requests/s", "p50 us", "p99 us", "max us",
+           "failed", "syncs");
+    for (int terminals = 1; terminals <= 256; terminals *= 4) {
+        BenchTerminal *all = calloc(terminals, sizeof(BenchTerminal));
+        pthread_t *threads = malloc(sizeof(pthread_t) * terminals);
+        const int sales = totalSales / terminals;
+        const uint64_t syncs = journal.syncs;
+        const long long start = nowNanos();
+        for (int i = 0; i < terminals; i++) {
+            all[i] = (BenchTerminal) {path, sales, malloc(sizeof(long long) * (sales * 4 + 2)), 0, 0};
+            pthread_create(&threads[i], NULL, benchTerminal, &all[i]);
+        }
+        for (int i = 0; i < terminals; i++) pthread_join(threads[i], NULL);
+        const long long elapsed = nowNanos() - start;
+
+        long long requests = 0, failures = 0;
+        for (int i = 0; i < terminals; i++) {
+            requests += all[i].requests;
+            failures += all[i].failures;
+        }
+        long long *latencies = malloc(sizeof(long long) * (requests > 0 ? requests : 1));
+        long long merged = 0;
+        for (int i = 0; i < terminals; i++) {
+            memcpy(latencies + merged, all[i].latencies, sizeof(long long) * all[i].requests);
+            merged += all[i].requests;
+            free(all[i].latencies);
+        }
+        qsort(latencies, requests, sizeof(long long), compareLongLongs);
+        if (requests > 0) {
+            printf("%-10d %-12.0f %-10.1f %-10.1f %-10.1f %-10lld %-10llu\n", terminals, requests * 1e9 / elapsed,
+                   latencies[requests / 2] / 1e3, latencies[requests * 99 / 100] / 1e3, latencies[requests - 1] / 1e3,
+                   failures, (unsigned long long) (journal.syncs - syncs));
+        }
+        free(latencies);
+        free(threads);
+        free(all);
+    }
+
+    requestStop(&server);
+    pthread_join(serverThread, NULL);
+    stopServer(&server);
+    printf("%lld requests served, %d orders\n", server.requests, orders.length);
+    closeJournal();
+    remove("bench_journal.dat");
+    clearOrders();
+    while (users.head != NULL) removeUser(users.head);
+    while (stocks.head != NULL) removeStock(stocks.head);
+#else
+    printf("server mode needs epoll\n");
+#endif
+}
+
+#ifndef _WIN32
+
+// benchHammer is one process selling from the shared table until operations run out. With hold it reserves
+// 1 to 3 units and cooks two orders in three, counting what it cooked in committed, otherwise it reserves
+// one unit and releases it again. Only the ids are passed, the process looks the records up itself.
+void benchHammer(const int ids[], int idCount, int operations, bool hold, unsigned int seed, long long *committed) {
+    for (int i = 0; i < operations; i++) {
+        SharedStock *record = findSharedStock(&sharedStocks, ids[benchRandom(&seed, idCount)]);
+        const int quantity = hold ? benchRandom(&seed, 3) + 1 : 1;
+        if (record == NULL || !sharedReserve(record, quantity)) continue;
+        if (hold && benchRandom(&seed, 3) > 0) {
+            sharedCommit(record, quantity);
+            *committed += quantity;
+        } else {
+            sharedRelease(record, quantity);
+        }
+    }
+}
+
+// benchHammerProcesses forks processes that each run benchHammer, and returns when all of them exited.
+// killAfterMillis above 0 kills the first one with SIGKILL that long after the start, as a crash would.
+void benchHammerProcesses(int processes, const int ids[], int idCount, int operations, bool hold,
+                          long long committed[], int killAfterMillis) {
+    pid_t children[16];
+    for (int i = 0; i < processes; i++) {
+        children[i] = fork();
+        if (children[i] == 0) {
+            benchHammer(ids, idCount, operations, hold, (unsigned int) (i + 1) * 2654435761U | 1, &committed[i]);
+            _exit(0);
+        }
+    }
+    if (killAfterMillis > 0) {
+        const struct timespec pause = {0, killAfterMillis * 1000000L};
+        nanosleep(&pause, NULL);
+        kill(children[0], SIGKILL);
+    }
+    for (int i = 0; i < processes; i++) waitpid(children[i], NULL, 0);
+}
+
+#endif
+
+// benchShared checks the shared stock table with processes instead of threads: 8 processes sell the last
+// portions of one stock, then one of 4 processes is killed mid-sale and the others carry on. It then measures
+// a wait for units woken by another process's restock, and reservations per second from 1 to 8 processes.
+void benchShared() {
+#ifndef _WIN32
+    const char *path = "bench_stocks.shm";
+    idsFilePath = NULL;
+    remove(path);
+    if (!openSharedStocks(&sharedStocks, path, 65)) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return;
+    }
+    const int portions = 10000;
+    int ids[65];
+    for (int i = 0; i < 65; i++) {
+        Stock *stock = createStock("bench", 100 + i, i == 0 ? portions : 100000000);
+        stock->id = i + 1;
+        addStock(stock);
+        ids[i] = stock->id;
+    }
+    SharedStock *hot = findSharedStock(&sharedStocks, ids[0]);
+    long long *committed = mmap(NULL, sizeof(long long) * 16, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                                -1, 0);
+    if (hot == NULL || committed == MAP_FAILED) {
+        fprintf(stderr, "cannot share the bench stocks\n");
+        closeSharedStocks(&sharedStocks);
+        return;
+    }
+
+    memset(committed, 0, sizeof(long long) * 16);
+    benchHammerProcesses(8, ids, 1, 100000, true, committed, 0);
+    long long sold = 0;
+    for (int i = 0; i < 8; i++) sold += committed[i];
+    printf("stress: 8 processes, %d portions, %lld sold, %d left, %d reserved\n", portions, sold,
+           sharedQuantity(hot), sharedReserved(hot));
+    printf("never below zero: %s, every portion accounted for: %s\n", sharedQuantity(hot) >= 0 ? "yes" : "no",
+           sold + sharedQuantity(hot) + sharedReserved(hot) == portions ? "yes" : "no");
+
+    // a reservation is one atomic step, so the killed process leaves what it held reserved and nothing goes missing
+    sharedRestock(hot, portions);
+    const int before = sharedQuantity(hot) + sharedReserved(hot);
+    memset(committed, 0, sizeof(long long) * 16);
+    benchHammerProcesses(4, ids, 1, 2000000, false, committed, 20);
+    const int held = sharedReserved(hot);
+    printf("crash: 1 of 4 processes killed, %d units held by it, every unit accounted for: %s\n", held,
+           sharedQuantity(hot) + held == before ? "yes" : "no");
+    // what the dead process held is given back by whoever cleans up after it, here the bench
+    if (held > 0) sharedRelease(hot, held);
+    const bool usable = sharedReserve(hot, 1);
+    if (usable) sharedRelease(hot, 1);
+    printf("table usable after the crash: %s\n", usable ? "yes" : "no");
+
+    // a process waits for an empty stock, the bench restocks it and the waiter measures how long it took
+    const int available = sharedQuantity(hot);
+    sharedRestock(hot, -available);
+    const pid_t waiter = fork();
+    if (waiter == 0) {
+        const bool woken = waitSharedStock(hot, 1, 5000);
+        committed[0] = woken ? nowNanos() : 0;
+        _exit(0);
+    }
+    const struct timespec pause = {0, 20000000L};
+    nanosleep(&pause, NULL);
+    const long long restocked = nowNanos();
+    sharedRestock(hot, available);
+    waitpid(waiter, NULL, 0);
+    if (committed[0] > 0) printf("wait: woken %.1f us after the restock\n", (committed[0] - restocked) / 1000.0);
+    else printf("wait: not woken\n");
+
+    printf("%-10s %-18s %-18s\n", "processes", "shared 1 stock", "shared 64 stocks");
+    for (int processes = 1; processes <= 8; processes *= 2) {
+        double rates[2];
+        for (int run = 0; run < 2; run++) {
+            const int operations = 1000000;
+            const long long start = nowNanos();
+            benchHammerProcesses(processes, run == 0 ? ids : ids + 1, run == 0 ? 1 : 64, operations, false,
+                                 committed, 0);
+            rates[run] = (double) processes * operations * 1e9 / (nowNanos() - start);
+        }
+        printf("%-10d %-18.0f %-18.0f\n", processes, rates[0], rates[1]);
+    }
+    printf("(lookups and reservations/sec, each released again)\n");
+
+    munmap(committed, sizeof(long long) * 16);
+    while (stocks.head != NULL) removeStock(stocks.head);
+    closeSharedStocks(&sharedStocks);
+    remove(path);
+#else
+    printf("the shared stock table needs mmap\n");
+#endif
+}
+
+// benchMetrics measures what the instrumentation costs findStock and a sale with metrics off and on, against
+// the index lookup findStock wraps, then checks the percentiles of a known spread of latencies
+void benchMetrics() {
+    unsigned int seed = 271828183U;
+    idsFilePath = NULL;
+    const int records = 100000;
+    for (int i = 1; i <= records; i++) {
+        Stock *stock = createStock("bench", 10, 100000000);
+        stock->id = i;
+        addStock(stock);
+    }
+
+    const long long lookups = 10000000;
+    long long found = 0;
+    long long start = nowNanos();
+    for (long long i = 0; i < lookups; i++) found += indexGet(&stocks.index, benchRandom(&seed, records) + 1) != NULL;
+    const double bare = (double) (nowNanos() - start) / lookups;
+
+    printf("%-10s %-16s %-16s\n", "metrics", "findStock ns", "sale ns");
+    for (int enabled = 0; enabled <= 1; enabled++) {
+        atomic_store(&metricsEnabled, enabled);
+        start = nowNanos();
+        for (long long i = 0; i < lookups; i++) found += findStock(benchRandom(&seed, records) + 1) != NULL;
+        const double lookup = (double) (nowNanos() - start) / lookups;
+
+        const int sales = 200000;
+        start = nowNanos();
+        for (int i = 0; i < sales; i++) {
+            Order *order = createOrder(1, CASH);
+            addOrder(order);
+            for (int j = 0; j < 3; j++) addItemToOrder(order, benchRandom(&seed, records) + 1, 1);
+            setOrderStatus(order, COMPLETED);
+        }
+        const double sale = (double) (nowNanos() - start) / sales;
+        clearOrders();
+        printf("%-10s %-16.1f %-16.1f\n", enabled ? "on" : "off", lookup, sale);
+    }
+    printf("%-10s %-16.1f\n", "bare", bare);
+    printf("(%lld found)\n", found);
+
+    MetricReport *reports = malloc(sizeof(MetricReport) * METRIC_COUNT);
+    if (reports == NULL) return;
+    readMetrics(reports);
+    printf("%-15s %-10s %-8s %-8s %-8s %-8s\n", "operation", "count", "mean", "p50", "p99", "max");
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        const MetricReport *report = &reports[metric];
+        if (report->count == 0) continue;
+        printf("%-15s %-10lld %-8lld %-8lld %-8lld %-8lld\n", getMetricName(metric), report->count,
+               report->total / report->count, metricPercentile(report, 50), metricPercentile(report, 99),
+               metricPercentile(report, 100));
+    }
+    printf("(ns, each includes the clock reads around it)\n");
+
+    // 1 to 1000000ns spread evenly, so the true p50 is 500000 and the true p99 990000
+    MetricReport *spread = &reports[0];
+    memset(spread, 0, sizeof(MetricReport));
+    for (int i = 1; i <= 1000000; i++) {
+        spread->buckets[metricBucket(i)]++;
+        spread->count++;
+        spread->total += i;
+    }
+    const long long p50 = metricPercentile(spread, 50), p99 = metricPercentile(spread, 99);
+    printf("known spread: p50 %lld (500000), p99 %lld (990000), within 1/16: %s\n", p50, p99,
+           llabs(p50 - 500000) <= 500000 / 16 && llabs(p99 - 990000) <= 990000 / 16 ? "yes" : "no");
+    free(reports);
+    atomic_store(&metricsEnabled, false);
+    while (stocks.head != NULL) removeStock(stocks.head);
+}
+
+// benchExportRun times one export and prints its rows per second and file size
+void benchExportRun(const char *source, const char *path, ExportFormat format, long long expected) {
+    const long long start = nowNanos();
+    const long long rows = strcmp(source, "files") == 0 ? exportFiles(path, format) : exportSnapshot(path, format);
+    const long long elapsed = nowNanos() - start;
+    long size = 0;
+    FILE *file = fopen(path, "rb");
+    if (file != NULL) {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    printf("%-8s %-8s %-10lld %-12.0f %-10.1f %s\n", source, format == EXPORT_CSV ? "csv" : "columns", rows,
+           rows * 1e9 / elapsed, size / 1e6, rows == expected ? "yes" : "no");
+}
+
+// benchSameFile compares two files byte by byte
+bool benchSameFile(const char *path, const char *otherPath) {
+    FILE *file = fopen(path, "rb"), *other = fopen(otherPath, "rb");
+    bool same = file != NULL && other != NULL;
+    int c;
+    while (same && (c = fgetc(file)) != EOF) same = c == fgetc(other);
+    same = same && fgetc(other) == EOF;
+    if (file != NULL) fclose(file);
+    if (other != NULL) fclose(other);
+    return same;
+}
+
+// benchExport exports 1M orders of 3 items from memory and from the files they were saved to, in both formats.
+// The exporter's memory is one batch whatever the history's size.
+void benchExport() {
+    const int records = 1000000, stockCount = 1000;
+    unsigned int seed = 16180339U;
+    idsFilePath = NULL;
+    ordersFilePath = "bench_orders.dat";
+    stocksFilePath = "bench_stocks.dat";
+    archiveFilePath = "bench_archive.dat";
+    remove(archiveFilePath);
+
+    char name[32];
+    for (int i = 1; i <= stockCount; i++) {
+        snprintf(name, sizeof(name), "stock \"%d\"", i);
+        Stock *stock = createStock(name, 10 + i % 90, 100000000);
+        stock->id = i;
+        addStock(stock);
+    }
+    for (int i = 1; i <= records; i++) {
+        Order *order = createOrder(i % 100, i % PAYMENT_TYPE_COUNT);
+        order->id = i;
+        addOrder(order);
+        for (int j = 0; j < 3; j++) addItemToOrder(order, benchRandom(&seed, stockCount) + 1, j + 1);
+        if (i % 3 != 0) setOrderStatus(order, COMPLETED);
+    }
+    // an order only has one line per stock, so some got fewer than 3
+    long long expected = 0;
+    for (const Order *order = orders.head; order != NULL; order = order->next) expected += order->itemCount;
+    const bool written = writeStocksToFile() && commitDataFile(stocksFilePath) && writeOrdersToFile() &&
+                         commitDataFile(ordersFilePath);
+
+    printf("exporter memory: %.1f KB for batches of %d rows\n", sizeof(Exporter) / 1024.0, EXPORT_BATCH_ROWS);
+    printf("%-8s %-8s %-10s %-12s %-10s %s\n", "source", "format", "rows", "rows/sec", "MB", "all rows");
+    benchExportRun("memory", "bench_export.crex", EXPORT_COLUMNS, expected);
+    benchExportRun("memory", "bench_export.csv", EXPORT_CSV, expected);
+    if (written) {
+        benchExportRun("files", "bench_files.crex", EXPORT_COLUMNS, expected);
+        benchExportRun("files", "bench_files.csv", EXPORT_CSV, expected);
+        printf("files export the same as memory: %s\n",
+               benchSameFile("bench_export.crex", "bench_files.crex") &&
+               benchSameFile("bench_export.csv", "bench_files.csv") ? "yes" : "no");
+    }
+    remove("bench_export.crex");
+    remove("bench_export.csv");
+    remove("bench_files.crex");
+    remove("bench_files.csv");
+
+    clearOrders();
+    while (stocks.head != NULL) removeStock(stocks.head);
+    remove(ordersFilePath);
+    remove(stocksFilePath);
+}
+
+// the stock and user nodes as they were with their text inline, for benchStrings
+typedef struct BenchInlineStock {
+    int id;
+    char name[101];
+    int price;
+    _Atomic int quantity;
+    _Atomic int reserved;
+    SharedStock *shared;
+    struct BenchInlineStock *next;
+    struct BenchInlineStock *prev;
+} BenchInlineStock;
+
+typedef struct BenchInlineUser {
+    int id;
+    char name[101];
+    char hashedPassword[201];
+    UserType type;
+    struct BenchInlineUser *next;
+    struct BenchInlineUser *prev;
+} BenchInlineUser;
+
+// benchStrings compares the memory of a stock and a user and the speed of finding them, by walking the list
+// the way findStock and findUser used to and through the id index, with the text inline against the arena
+void benchStrings() {
+    idsFilePath = NULL;
+    unsigned int seed = 1013904223U;
+    const char *words[] = {"Burger", "Pizza", "Salad", "Soup", "Taco", "Wrap", "Curry", "Noodles", "Steak", "Pie"};
+
+    printf("%-10s %-8s %-14s %-14s %-14s %-14s\n", "records", "kind", "inline bytes", "arena bytes", "inline scan",
+           "arena scan");
+    printf("%-10s %-8s %-14s %-14s %-14s %-14s\n", "", "", "", "", "inline find", "arena find");
+    for (int records = 10000; records <= 1000000; records *= 100) {
+        Slab inlineStockSlab = {sizeof(BenchInlineStock), 256, NULL, NULL, NULL, NULL, 0};
+        Slab inlineUserSlab = {sizeof(BenchInlineUser), 64, NULL, NULL, NULL, NULL, 0};
+        IdIndex inlineStocks = {NULL, 0, 0}, inlineUsers = {NULL, 0, 0};
+        BenchInlineStock *stockHead = NULL, *stockTail = NULL;
+        BenchInlineUser *userHead = NULL, *userTail = NULL;
+
+        // names carry the round so earlier rounds don't share their strings
+        const size_t stockBytes = strings.bytes + sizeof(StringHandle) * strings.capacity;
+        char name[NAME_SIZE], password[HASHED_PASSWORD_SIZE], hashed[HASHED_PASSWORD_SIZE];
+        for (int i = 1; i <= records; i++) {
+            snprintf(name, sizeof(name), "%s %d-%d", words[i % 10], records, i);
+            Stock *stock = createStock(name, 10, 100);
+            stock->id = i;
+            addStock(stock);
+
+            BenchInlineStock *copy = slabAlloc(&inlineStockSlab);
+            memset(copy, 0, sizeof(*copy));
+            copy->id = i;
+            strcpy(copy->name, name);
+            copy->price = 10;
+            copy->quantity = 100;
+            copy->prev = stockTail;
+            if (stockTail != NULL) stockTail->next = copy;
+            else stockHead = copy;
+            stockTail = copy;
+            indexPut(&inlineStocks, i, copy);
+        }
+        const size_t userBytes = strings.bytes + sizeof(StringHandle) * strings.capacity;
+        for (int i = 1; i <= records; i++) {
+            snprintf(name, sizeof(name), "cashier%d-%d", records, i);
+            snprintf(password, sizeof(password), "secret%d", i);
+            hashPassword(password, hashed);
+            User *user = createUser(name, hashed, CASHIER);
+            user->id = i;
+            addUser(user);
+
+            BenchInlineUser *copy = slabAlloc(&inlineUserSlab);
+            memset(copy, 0, sizeof(*copy));
+            copy->id = i;
+            strcpy(copy->name, name);
+            strcpy(copy->hashedPassword, hashed);
+            copy->type = CASHIER;
+            copy->prev = userTail;
+            if (userTail != NULL) userTail->next = copy;
+            else userHead = copy;
+            userTail = copy;
+            indexPut(&inlineUsers, i, copy);
+        }
+        const size_t endBytes = strings.bytes + sizeof(StringHandle) * strings.capacity;
+
+        // a scan walks to a random id, a find looks it up and reads the node
+        const int scans = 20000000 / records;
+        const int lookups = 5000000;
+        const unsigned int scanSeed = seed;
+        long long visited = 0, found = 0;
+        long long start = nowNanos();
+        for (int i = 0; i < scans; i++) {
+            const int id = benchRandom(&seed, records) + 1;
+            for (const BenchInlineStock *stock = stockHead; stock != NULL; stock = stock->next, visited++) {
+                if (stock->id == id) break;
+            }
+        }
+        const double inlineStockScan = (double) (nowNanos() - start) / visited;
+        seed = scanSeed;
+        visited = 0;
+        start = nowNanos();
+        for (int i = 0; i < scans; i++) {
+            const int id = benchRandom(&seed, records) + 1;
+            for (const Stock *stock = stocks.head; stock != NULL; stock = stock->next, visited++) {
+                if (stock->id == id) break;
+            }
+        }
+        const double stockScan = (double) (nowNanos() - start) / visited;
+
+        seed = scanSeed;
+        visited = 0;
+        start = nowNanos();
+        for (int i = 0; i < scans; i++) {
+            const int id = benchRandom(&seed, records) + 1;
+            for (const BenchInlineUser *user = userHead; user != NULL; user = user->next, visited++) {
+                if (user->id == id) break;
+            }
+        }
+        const double inlineUserScan = (double) (nowNanos() - start) / visited;
+        seed = scanSeed;
+        visited = 0;
+        start = nowNanos();
+        for (int i = 0; i < scans; i++) {
+            const int id = benchRandom(&seed, records) + 1;
+            for (const User *user = users.head; user != NULL; user = user->next, visited++) {
+                if (user->id == id) break;
+            }
+        }
+        const double userScan = (double) (nowNanos() - start) / visited;
+
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) {
+            const BenchInlineStock *stock = indexGet(&inlineStocks, benchRandom(&seed, records) + 1);
+            found += stock->quantity > 0;
+        }
+        const double inlineStockFind = (double) (nowNanos() - start) / lookups;
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) found += findStock(benchRandom(&seed, records) + 1)->quantity > 0;
+        const double stockFind = (double) (nowNanos() - start) / lookups;
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) {
+            const BenchInlineUser *user = indexGet(&inlineUsers, benchRandom(&seed, records) + 1);
+            found += user->type == CASHIER;
+        }
+        const double inlineUserFind = (double) (nowNanos() - start) / lookups;
+        start = nowNanos();
+        for (int i = 0; i < lookups; i++) found += findUser(benchRandom(&seed, records) + 1)->type == CASHIER;
+        const double userFind = (double) (nowNanos() - start) / lookups;
+
+        if (found != 4LL * lookups) fprintf(stderr, "lookup missed %lld records\n", 4LL * lookups - found);
+        if (strcmp(stringAt(findStock(records)->name), stockTail->name) != 0 ||
+            !verifyPassword(findUser(records), password))
+            fprintf(stderr, "names or passwords don't match\n");
+
+        printf("%-10d %-8s %-14zu %-14.1f %-14.2f %-14.2f\n", records, "stock", sizeof(BenchInlineStock),
+               sizeof(Stock) + (double) (userBytes - stockBytes) / records, inlineStockScan, stockScan);
+        printf("%-10s %-8s %-14s %-14s %-14.1f %-14.1f\n", "", "", "", "", inlineStockFind, stockFind);
+        printf("%-10d %-8s %-14zu %-14.1f %-14.2f %-14.2f\n", records, "user", sizeof(BenchInlineUser),
+               sizeof(User) + (double) (endBytes - userBytes) / records, inlineUserScan, userScan);
+        printf("%-10s %-8s %-14s %-14s %-14.1f %-14.1f\n", "", "", "", "", inlineUserFind, userFind);
+
+        while (stocks.head != NULL) removeStock(stocks.head);
+        while (users.head != NULL) removeUser(users.head);
+        slabReset(&inlineStockSlab);
+        slabReset(&inlineUserSlab);
+        free(inlineStocks.entries);
+        free(inlineUsers.entries);
+    }
+    printf("(bytes per record with its text, ns per node walked and per lookup)\n");
+    printf("arena: %d strings in %d chunks, %zu bytes\n", strings.length, strings.chunkCount, strings.bytes);
+}
+
+// benchCatalogFile writes a catalog of lines lines into a buffer, with ids from firstId when it isn't 0
+char *benchCatalogFile(int lines, int firstId, int price, size_t *size) {
+    const char *words[] = {"Burger", "Pizza", "Salad", "Soup", "Taco", "Wrap", "Curry", "Noodles", "Steak", "Pie"};
+    char *data = malloc((size_t) lines * 64 + 64);
+    if (data == NULL) return NULL;
+    size_t length = sprintf(data, firstId != 0 ? "id,name,price,quantity\n" : "name,price,quantity\n");
+    for (int i = 0; i < lines; i++) {
+        if (firstId != 0) length += sprintf(data + length, "%d,", firstId + i);
+        if (i % 16 == 0) length += sprintf(data + length, "\"%s, large %d\",%d,%d\n", words[i % 10], i, price, i % 500);
+        else length += sprintf(data + length, "%s %d,%d,%d\n", words[i % 10], i, price + i % 7, i % 500);
+    }
+    *size = length;
+    return data;
+}
+
+// benchCatalog times importing a supplier catalog on more and more threads, then upserts it and checks
+// that a catalog with a bad line changes nothing
+void benchCatalog() {
+    idsFilePath = NULL;
+    const int lines = 500000;
+    size_t size;
+    char *data = benchCatalogFile(lines, 0, 250, &size);
+    if (data == NULL) return;
+
+    // a first import puts the names in the string arena, so every timed one finds them there
+    CatalogResult result;
+    importCatalogData(data, size, CATALOG_INSERT, 1, &result);
+    while (stocks.head != NULL) removeStock(stocks.head);
+
+    printf("%d lines, %.1f MB, %d processors\n", lines, size / 1e6, countProcessors());
+    printf("%-8s %-10s %-10s %-10s %-12s %-12s %-12s\n", "threads", "parse ms", "merge ms", "total ms", "parse gain",
+           "total gain", "lines/sec");
+    double parseBase = 0, totalBase = 0;
+    for (int threads = 1; threads <= 16; threads *= 2) {
+        if (!importCatalogData(data, size, CATALOG_INSERT, threads, &result) || result.added != lines ||
+            stocks.length != lines) {
+            reportCatalogErrors(stderr, "bench", &result);
+            fprintf(stderr, "import added %lld of %d lines\n", result.added, lines);
+        }
+        const double parse = result.parseNanos / 1e6, total = (result.parseNanos + result.mergeNanos) / 1e6;
+        if (threads == 1) {
+            parseBase = parse;
+            totalBase = total;
+        }
+        printf("%-8d %-10.1f %-10.1f %-10.1f %-12.2f %-12.2f %-12.0f\n", result.threads, parse,
+               result.mergeNanos / 1e6, total, parseBase / parse, totalBase / total, lines / (total / 1e3));
+        while (stocks.head != NULL) removeStock(stocks.head);
+    }
+    free(data);
+
+    // the same ids twice, the second time at a new price and with every fourth line a new stock
+    data = benchCatalogFile(lines, 1000000, 250, &size);
+    importCatalogData(data, size, CATALOG_INSERT, 0, &result);
+    free(data);
+    data = benchCatalogFile(lines + lines / 4, 1000000, 300, &size);
+    const bool refused = !importCatalogData(data, size, CATALOG_INSERT, 0, &result);
+    const bool upserted = importCatalogData(data, size, CATALOG_UPSERT, 0, &result);
+    const Stock *stock = findStock(1000000 + 7);
+    printf("upsert: %lld updated, %lld added in %.1f ms, insert of existing ids refused: %s, prices: %s\n",
+           result.updated, result.added, (result.parseNanos + result.mergeNanos) / 1e6, refused ? "yes" : "no",
+           upserted && stock != NULL && stock->price == 300 && stocks.length == lines + lines / 4 ? "new" : "WRONG");
+    free(data);
+
+    // one bad line near the end and nothing is imported
+    data = benchCatalogFile(lines, 0, 250, &size);
+    memcpy(data + size - 8, "x,y,z\n\n\n", 8);
+    const int before = stocks.length;
+    const bool imported = importCatalogData(data, size, CATALOG_INSERT, 0, &result);
+    printf("bad line: %s, %lld errors, stocks unchanged: %s\n", imported ? "imported" : "refused", result.errorTotal,
+           stocks.length == before ? "yes" : "no");
+    reportCatalogErrors(stdout, "bench", &result);
+    free(data);
+    while (stocks.head != NULL) removeStock(stocks.head);
+}
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "catalog.h"
+#include "storage.h"
+
+bool importCatalog(const char *path, CatalogMode mode, int threads, CatalogResult *result) {
+    MappedFile file;
+    if (!mapFile(path, &file)) {
+        memset(result, 0, sizeof(*result));
+        addCatalogError(result->errors, &result->errorCount, &result->errorTotal, 0, "cannot read the file");
+        return false;
+    }
+    const bool ok = importCatalogData(file.data, file.size, mode, threads, result);
+    unmapFile(&file);
+    return ok;
+}
+
+// importCatalogData splits the catalog into a chunk per thread at line breaks, parses and checks the chunks
+// in parallel and merges them into the stocks on this thread once every line is known to be valid
+bool importCatalogData(const char *data, size_t size, CatalogMode mode, int threads, CatalogResult *result) {
+    memset(result, 0, sizeof(*result));
+    if (threads <= 0) threads = countProcessors();
+    if (threads > CATALOG_MAX_THREADS) threads = CATALOG_MAX_THREADS;
+    if ((size_t) threads > size / CATALOG_MIN_CHUNK + 1) threads = (int) (size / CATALOG_MIN_CHUNK + 1);
+
+    CatalogChunk *chunks = calloc(threads, sizeof(CatalogChunk));
+    if (chunks == NULL) {
+        addCatalogError(result->errors, &result->errorCount, &result->errorTotal, 0, "out of memory");
+        return false;
+    }
+    // each chunk runs to the first line break past its even share of the file
+    const char *start = data, *end = data + size;
+    int chunkCount = 0;
+    for (int i = 0; i < threads && start < end; i++) {
+        const char *stop = i == threads - 1 ? end : data + size / threads * (i + 1);
+        if (stop < start) stop = start;
+        const char *newline = stop < end ? memchr(stop, '\n', end - stop) : NULL;
+        stop = newline != NULL ? newline + 1 : end;
+        chunks[chunkCount].start = start;
+        chunks[chunkCount].end = stop;
+        chunks[chunkCount].first = chunkCount == 0;
+        chunkCount++;
+        start = stop;
+    }
+    result->threads = chunkCount;
+
+    // the first chunk is parsed on this thread, and any chunk whose thread couldn't be started
+    const long long started = nowNanos();
+    bool threaded[CATALOG_MAX_THREADS] = {false};
+    for (int i = 1; i < chunkCount; i++) {
+        threaded[i] = pthread_create(&chunks[i].thread, NULL, parseCatalogChunk, &chunks[i]) == 0;
+    }
+    for (int i = 0; i < chunkCount; i++) {
+        if (!threaded[i]) parseCatalogChunk(&chunks[i]);
+    }
+    for (int i = 1; i < chunkCount; i++) {
+        if (threaded[i]) pthread_join(chunks[i].thread, NULL);
+    }
+    result->parseNanos = nowNanos() - started;
+
+    // number the lines in the file and report the errors in file order
+    long long firstLine = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        CatalogChunk *chunk = &chunks[i];
+        for (int j = 0; j < chunk->rowCount; j++) chunk->rows[j].line += firstLine;
+        for (int j = 0; j < chunk->errorCount; j++) {
+            addCatalogError(result->errors, &result->errorCount, &result->errorTotal,
+                            chunk->errors[j].line + firstLine, chunk->errors[j].message);
+        }
+        result->errorTotal += chunk->errorTotal - chunk->errorCount;
+        result->rows += chunk->rowCount;
+        firstLine += chunk->lines;
+    }
+
+    bool ok = result->errorTotal == 0;
+    if (ok) {
+        const long long mergeStarted = nowNanos();
+        ok = mergeCatalog(chunks, chunkCount, mode, result);
+        result->mergeNanos = nowNanos() - mergeStarted;
+    }
+    for (int i = 0; i < chunkCount; i++) {
+        free(chunks[i].rows);
+        free(chunks[i].names);
+    }
+    free(chunks);
+    return ok;
+}
+
+void *parseCatalogChunk(void *argument) {
+    CatalogChunk *chunk = argument;
+    const char *line = chunk->start;
+    while (line < chunk->end) {
+        const char *newline = memchr(line, '\n', chunk->end - line);
+        const char *end = newline != NULL ? newline : chunk->end;
+        chunk->lines++;
+        const char *error = parseCatalogLine(chunk, line, end, chunk->lines);
+        if (error != NULL) addCatalogError(chunk->errors, &chunk->errorCount, &chunk->errorTotal, chunk->lines, error);
+        line = newline != NULL ? newline + 1 : chunk->end;
+    }
+    return NULL;
+}
+
+// parseCatalogLine adds a line to the chunk's rows and returns NULL, or returns why the line isn't valid.
+// Blank lines are skipped, and the first line of the file if it is a header naming the columns.
+const char *parseCatalogLine(CatalogChunk *chunk, const char *line, const char *end, long long lineNumber) {
+    if (end > line && end[-1] == '\r') end--;
+    char fields[CATALOG_MAX_FIELDS][NAME_SIZE];
+    int count = 0;
+    const char *error = splitCatalogLine(line, end, fields, &count);
+    if (error != NULL) return error;
+    if (count == 1 && fields[0][0] == '\0') return NULL;
+    if (chunk->first && lineNumber == 1 && (compareNames(fields[0], "id") == 0 || compareNames(fields[0], "name") == 0))
+        return NULL;
+    if (count < 3) return "expected name,price,quantity or id,name,price,quantity";
+
+    CatalogRow row = {0, 0, 0, 0, lineNumber};
+    const int first = count - 3;
+    if (first == 1 && (!parseCatalogNumber(fields[0], &row.id) || row.id == 0)) return "the id isn't a positive number";
+    if (fields[first][0] == '\0') return "the name is empty";
+    if (!parseCatalogNumber(fields[first + 1], &row.price)) return "the price isn't a whole number";
+    if (!parseCatalogNumber(fields[first + 2], &row.quantity)) return "the quantity isn't a whole number";
+
+    const size_t nameSize = strlen(fields[first]) + 1;
+    if (chunk->rowCount == chunk->rowCapacity) {
+        const int capacity = chunk->rowCapacity == 0 ? 1024 : chunk->rowCapacity * 2;
+        CatalogRow *rows = realloc(chunk->rows, sizeof(CatalogRow) * capacity);
+        if (rows == NULL) return "out of memory";
+        chunk->rows = rows;
+        chunk->rowCapacity = capacity;
+    }
+    if (chunk->nameLength + nameSize > chunk->nameCapacity) {
+        size_t capacity = chunk->nameCapacity == 0 ? 16384 : chunk->nameCapacity;
+        while (chunk->nameLength + nameSize > capacity) capacity *= 2;
+        char *names = realloc(chunk->names, capacity);
+        if (names == NULL) return "out of memory";
+        chunk->names = names;
+        chunk->nameCapacity = capacity;
+    }
+    row.name = (uint32_t) chunk->nameLength;
+    memcpy(chunk->names + chunk->nameLength, fields[first], nameSize);
+    chunk->nameLength += nameSize;
+    chunk->rows[chunk->rowCount++] = row;
+    return NULL;
+}
+
+// splitCatalogLine cuts a line at its commas, trimming the blanks around each field. A quoted field may hold
+// commas and doubled quotes, but not a line break.
+const char *splitCatalogLine(const char *line, const char *end, char fields[CATALOG_MAX_FIELDS][NAME_SIZE],
+                             int *count) {
+    const char *p = line;
+    *count = 0;
+    while (1) {
+        if (*count == CATALOG_MAX_FIELDS) return "too many fields";
+        char *field = fields[(*count)++];
+        size_t length = 0;
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        if (p < end && *p == '"') {
+            p++;
+            while (1) {
+                if (p == end) return "a quote isn't closed";
+                if (*p == '"' && (p + 1 == end || p[1] != '"')) break;
+                if (length == NAME_SIZE - 1) return "a field is too long";
+                field[length++] = *p;
+                p += *p == '"' ? 2 : 1;
+            }
+            p++;
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            if (p < end && *p != ',') return "text after a quoted field";
+        } else {
+            const char *start = p;
+            while (p < end && *p != ',') p++;
+            const char *last = p;
+            while (last > start && (last[-1] == ' ' || last[-1] == '\t')) last--;
+            length = last - start;
+            if (length > NAME_SIZE - 1) return "a field is too long";
+            memcpy(field, start, length);
+        }
+        field[length] = '\0';
+        if (p == end) return NULL;
+        p++;
+    }
+}
+
+// parseCatalogNumber accepts only digits that fit an int32_t, no sign and nothing after them
+bool parseCatalogNumber(const char *text, int32_t *value) {
+    if (*text < '0' || *text > '9') return false;
+    long long number = 0;
+    for (; *text >= '0' && *text <= '9'; text++) {
+        number = number * 10 + (*text - '0');
+        if (number > INT32_MAX) return false;
+    }
+    if (*text != '\0') return false;
+    *value = (int32_t) number;
+    return true;
+}
+
+void addCatalogError(CatalogError errors[], int *errorCount, long long *errorTotal, long long line,
+                     const char *message) {
+    (*errorTotal)++;
+    if (*errorCount == CATALOG_MAX_ERRORS) return;
+    CatalogError *error = &errors[(*errorCount)++];
+    error->line = line;
+    snprintf(error->message, sizeof(error->message), "%s", message);
+}
+
+// mergeCatalog finds the stock of every row before anything changes, so a conflict leaves the stocks as they were.
+// The rows are then journaled and flushed once, and applied in one pass with the id index grown up front.
+// checkCatalogNames rejects the lines of an upsert that add a stock with a name another line adds too. A line
+// without an id finds its stock by name, so only the first of them could be updated by name afterwards. The
+// names of the new stocks are sorted, like fileIds keeps the ids, and a name next to itself is on several lines.
+// It returns false if there is no memory to sort them.
+bool checkCatalogNames(CatalogChunk chunks[], int chunkCount, Stock *targets[], long long total,
+                       CatalogResult *result) {
+    NameEntry *added = malloc(sizeof(NameEntry) * (total > 0 ? total : 1));
+    if (added == NULL) return false;
+    long long row = 0, count = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        for (CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount; line++, row++) {
+            if (targets[row] == NULL) added[count++] = (NameEntry) {chunks[i].names + line->name, line, false};
+        }
+    }
+    qsort(added, count, sizeof(NameEntry), compareNameEntries);
+
+    char message[80];
+    for (long long i = 1; i < count; i++) {
+        if (strcmp(added[i - 1].name, added[i].name) != 0) continue;
+        const CatalogRow *first = added[i - 1].value, *line = added[i].value;
+        if (first->line > line->line) {
+            const CatalogRow *swap = first;
+            first = line;
+            line = swap;
+        }
+        snprintf(message, sizeof(message), "%.40s is also added on line %lld", added[i].name, first->line);
+        addCatalogError(result->errors, &result->errorCount, &result->errorTotal, line->line, message);
+    }
+    free(added);
+    return true;
+}
+
+bool mergeCatalog(CatalogChunk chunks[], int chunkCount, CatalogMode mode, CatalogResult *result) {
+    long long total = 0;
+    for (int i = 0; i < chunkCount; i++) total += chunks[i].rowCount;
+    Stock **targets = malloc(sizeof(Stock *) * (total > 0 ? total : 1));
+    StringHandle *names = malloc(sizeof(StringHandle) * (total > 0 ? total : 1));
+    IdIndex fileIds = {NULL, 0, 0};
+    if (targets == NULL || names == NULL) {
+        free(targets);
+        free(names);
+        addCatalogError(result->errors, &result->errorCount, &result->errorTotal, 0, "out of memory");
+        return false;
+    }
+
+    char message[80];
+    long long row = 0, updates = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        for (CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount; line++, row++) {
+            Stock *stock = NULL;
+            if (line->id > 0) {
+                const CatalogRow *seen = indexGet(&fileIds, line->id);
+                stock = findStock(line->id);
+                if (seen != NULL) {
+                    snprintf(message, sizeof(message), "id %d is also on line %lld", line->id, seen->line);
+                    addCatalogError(result->errors, &result->errorCount, &result->errorTotal, line->line, message);
+                } else if (stock != NULL && mode == CATALOG_INSERT) {
+                    snprintf(message, sizeof(message), "stock %d already exists", line->id);
+                    addCatalogError(result->errors, &result->errorCount, &result->errorTotal, line->line, message);
+                }
+                indexPut(&fileIds, line->id, line);
+            } else if (mode == CATALOG_UPSERT) {
+                stock = findStockByName(chunks[i].names + line->name);
+            }
+            targets[row] = stock;
+            if (stock != NULL) updates++;
+        }
+    }
+    if (mode == CATALOG_UPSERT && !checkCatalogNames(chunks, chunkCount, targets, total, result)) {
+        addCatalogError(result->errors, &result->errorCount, &result->errorTotal, 0, "out of memory");
+    }
+
+    // new stocks without an id take the next free one, skipping the ids other lines ask for
+    bool ok = result->errorTotal == 0;
+    for (int i = 0; i < chunkCount && ok; i++) {
+        for (CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount; line++) {
+            if (line->id > 0) reserveIds(STOCK_ID, line->id);
+        }
+    }
+    row = 0;
+    for (int i = 0; i < chunkCount && ok; i++) {
+        for (CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount; line++, row++) {
+            if (targets[row] != NULL || line->id > 0 || !ok) continue;
+            do {
+                line->id = nextId(STOCK_ID);
+            } while (line->id != 0 && (findStock(line->id) != NULL || indexGet(&fileIds, line->id) != NULL));
+            if (line->id == 0) {
+                addCatalogError(result->errors, &result->errorCount, &result->errorTotal, 0, "no stock ids are left");
+                ok = false;
+            }
+        }
+    }
+    free(fileIds.entries);
+
+    // the whole batch goes to the journal before any of it is applied, a failed write takes all of it back
+    if (ok && journal.fd >= 0) {
+        pthread_mutex_lock(&journal.lock);
+        const size_t pendingLength = journal.pendingLength;
+        const uint64_t appended = journal.appended;
+        row = 0;
+        for (int i = 0; i < chunkCount && ok; i++) {
+            for (const CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount && ok;
+                 line++, row++) {
+                const char *name = chunks[i].names + line->name;
+                ok = journalAppend(targets[row] != NULL ? JOURNAL_UPDATE_STOCK : JOURNAL_ADD_STOCK,
+                                   (int32_t[4]) {targets[row] != NULL ? targets[row]->id : line->id, line->price,
+                                                 line->quantity}, name, strlen(name) + 1);
+            }
+        }
+        if (!ok) {
+            journal.pendingLength = pendingLength;
+            journal.appended = appended;
+        }
+        ok = ok && journalFlush(journal.appended);
+        pthread_mutex_unlock(&journal.lock);
+        if (!ok) addCatalogError(result->errors, &result->errorCount, &result->errorTotal, 0, "journal write failed");
+    }
+    if (!ok) {
+        free(targets);
+        free(names);
+        return false;
+    }
+
+    // renamed stocks leave the name index before any name is added, so it is merged once and not on every rename.
+    // Until they are given their new name they have the empty one, which isn't in the index.
+    row = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        for (const CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount; line++, row++) {
+            names[row] = internString(chunks[i].names + line->name, NAME_SIZE);
+            Stock *stock = targets[row];
+            if (stock == NULL || stock->name == names[row] || stock->name == 0) continue;
+            nameIndexRemove(&stocks.names, stringAt(stock->name), stock);
+            stock->name = 0;
+        }
+    }
+    pthread_rwlock_wrlock(&stocks.lock);
+    while ((stocks.index.length + total - updates + 1) * 4 > (long long) stocks.index.capacity * 3) {
+        indexGrow(&stocks.index);
+    }
+    pthread_rwlock_unlock(&stocks.lock);
+    row = 0;
+    for (int i = 0; i < chunkCount; i++) {
+        for (const CatalogRow *line = chunks[i].rows; line < chunks[i].rows + chunks[i].rowCount; line++, row++) {
+            Stock *stock = targets[row];
+            if (stock != NULL) {
+                if (stock->name != names[row]) {
+                    // a stock on several lines is renamed again by each of them
+                    if (stock->name != 0) nameIndexRemove(&stocks.names, stringAt(stock->name), stock);
+                    stock->name = names[row];
+                    nameIndexPut(&stocks.names, stringAt(stock->name), stock);
+                }
+                stock->price = line->price;
+                setStockQuantity(stock, line->quantity);
+                result->updated++;
+                continue;
+            }
+            stock = slabAlloc(&stockSlab);
+            stock->id = line->id;
+            stock->name = names[row];
+            stock->price = line->price;
+            stock->quantity = line->quantity;
+            stock->reserved = 0;
+            linkStock(stock);
+            result->added++;
+        }
+    }
+    free(targets);
+    free(names);
+    return true;
+}
+
+// reportCatalogErrors prints the kept errors the way a compiler does, and how many more there were
+void reportCatalogErrors(FILE *file, const char *path, const CatalogResult *result) {
+    for (int i = 0; i < result->errorCount; i++) {
+        const CatalogError *error = &result->errors[i];
+        if (error->line > 0) fprintf(file, "%s:%lld: %s\n", path, error->line, error->message);
+        else fprintf(file, "%s: %s\n", path, error->message);
+    }
+    if (result->errorTotal > result->errorCount) {
+        fprintf(file, "%s: %lld more errors\n", path, result->errorTotal - result->errorCount);
+    }
+}
+
+int countProcessors() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int) info.dwNumberOfProcessors : 1;
+#else
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int) count : 1;
+#endif
+}
+
+bool parseCatalogMode(const char *name, CatalogMode *mode) {
+    if (strcmp(name, "insert") == 0) *mode = CATALOG_INSERT;
+    else if (strcmp(name, "upsert") == 0) *mode = CATALOG_UPSERT;
+    else return false;
+    return true;
+}
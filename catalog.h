@@ -0,0 +1,99 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <stdio.h>
+
+#include "restaurant.h"
+
+// a line has at most an id, a name, a price and a quantity
+#define CATALOG_MAX_FIELDS 4
+// only the first errors are kept to be reported, the rest are counted
+#define CATALOG_MAX_ERRORS 8
+// files smaller than this many bytes per thread are parsed on fewer threads
+#define CATALOG_MIN_CHUNK 65536
+#define CATALOG_MAX_THREADS 64
+
+// an insert adds every line as a new stock and rejects ids that exist, an upsert updates the stock
+// with the line's id, or without an id the stock with its name, in place and adds the rest. An upsert
+// rejects a name that several lines add.
+typedef enum {
+    CATALOG_INSERT,
+    CATALOG_UPSERT
+} CatalogMode;
+
+// CatalogRow is a valid line, id is 0 when the line has none and name is an offset into its chunk's names
+typedef struct {
+    int32_t id;
+    int32_t price;
+    int32_t quantity;
+    uint32_t name;
+    long long line;
+} CatalogRow;
+
+typedef struct {
+    long long line;
+    char message[80];
+} CatalogError;
+
+// CatalogChunk is the part of the file one thread parses, from the start of a line to the start of another.
+// Lines are counted from the start of the chunk until every chunk is parsed and they can be numbered in the file.
+typedef struct {
+    const char *start;
+    const char *end;
+    bool first;
+    pthread_t thread;
+    CatalogRow *rows;
+    int rowCount;
+    int rowCapacity;
+    char *names;
+    size_t nameLength;
+    size_t nameCapacity;
+    long long lines;
+    CatalogError errors[CATALOG_MAX_ERRORS];
+    int errorCount;
+    long long errorTotal;
+} CatalogChunk;
+
+// CatalogResult is what an import did, nothing is changed unless every line is valid
+typedef struct {
+    int threads;
+    long long rows;
+    long long added;
+    long long updated;
+    long long errorTotal;
+    int errorCount;
+    CatalogError errors[CATALOG_MAX_ERRORS];
+    long long parseNanos;
+    long long mergeNanos;
+} CatalogResult;
+
+// functions for importing a supplier catalog, a CSV of name,price,quantity or id,name,price,quantity lines.
+// threads is how many threads parse it, 0 for one per processor.
+bool importCatalog(const char *path, CatalogMode mode, int threads, CatalogResult *result);
+
+bool importCatalogData(const char *data, size_t size, CatalogMode mode, int threads, CatalogResult *result);
+
+void *parseCatalogChunk(void *argument);
+
+const char *parseCatalogLine(CatalogChunk *chunk, const char *line, const char *end, long long lineNumber);
+
+const char *splitCatalogLine(const char *line, const char *end, char fields[CATALOG_MAX_FIELDS][NAME_SIZE],
+                             int *count);
+
+bool parseCatalogNumber(const char *text, int32_t *value);
+
+void addCatalogError(CatalogError errors[], int *errorCount, long long *errorTotal, long long line,
+                     const char *message);
+
+bool checkCatalogNames(CatalogChunk chunks[], int chunkCount, Stock *targets[], long long total,
+                       CatalogResult *result);
+
+bool mergeCatalog(CatalogChunk chunks[], int chunkCount, CatalogMode mode, CatalogResult *result);
+
+void reportCatalogErrors(FILE *file, const char *path, const CatalogResult *result);
+
+int countProcessors();
+
+bool parseCatalogMode(const char *name, CatalogMode *mode);
+
+#endif
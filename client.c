@@ -0,0 +1,426 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "client.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+ServerConnection connection = {-1, 0, 0, NULL, 0, NULL, 0};
+
+#ifndef _WIN32
+
+bool connectServer(ServerConnection *server, const char *path) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return false;
+    strcpy(address.sun_path, path);
+
+    server->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server->fd < 0) return false;
+    if (connect(server->fd, (struct sockaddr *) &address, sizeof(address)) != 0) {
+        close(server->fd);
+        server->fd = -1;
+        return false;
+    }
+    // a server that went away shows up as a failed request, not as a signal
+    signal(SIGPIPE, SIG_IGN);
+    server->version = 0;
+    server->epoch = 0;
+    return true;
+}
+
+void disconnectServer(ServerConnection *server) {
+    if (server->fd >= 0) close(server->fd);
+    server->fd = -1;
+    free(server->payload);
+    server->payload = NULL;
+    server->payloadCapacity = 0;
+    free(server->list);
+    server->list = NULL;
+    server->listCapacity = 0;
+}
+
+bool readAll(int fd, char *data, size_t size) {
+    while (size > 0) {
+        const ssize_t received = recv(fd, data, size, 0);
+        if (received < 0 && errno == EINTR) continue;
+        if (received <= 0) return false;
+        data += received;
+        size -= received;
+    }
+    return true;
+}
+
+// sendRequest sends one request and waits for its response. It returns the response status,
+// or -1 if the connection failed, after which the connection is closed.
+int sendRequest(ServerConnection *server, RequestType type, const int32_t args[4], const char *text,
+                size_t textLength, ResponseHeader *response) {
+    if (server->fd < 0 || sizeof(RequestHeader) + textLength > SERVER_MAX_REQUEST) return -1;
+    char request[SERVER_MAX_REQUEST];
+    const RequestHeader header = {sizeof(RequestHeader) + textLength, type, {args[0], args[1], args[2], args[3]}};
+    memcpy(request, &header, sizeof(header));
+    if (textLength > 0) memcpy(request + sizeof(header), text, textLength);
+
+    size_t sent = 0;
+    while (sent < header.size) {
+        const ssize_t written = send(server->fd, request + sent, header.size - sent, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) {
+            disconnectServer(server);
+            return -1;
+        }
+        sent += written;
+    }
+
+    if (!readAll(server->fd, (char *) response, sizeof(ResponseHeader)) || response->size < sizeof(ResponseHeader)) {
+        disconnectServer(server);
+        return -1;
+    }
+    const size_t length = response->size - sizeof(ResponseHeader);
+    if (length > server->payloadCapacity) {
+        char *payload = realloc(server->payload, length);
+        if (payload == NULL) {
+            disconnectServer(server);
+            return -1;
+        }
+        server->payload = payload;
+        server->payloadCapacity = length;
+    }
+    if (!readAll(server->fd, server->payload, length)) {
+        disconnectServer(server);
+        return -1;
+    }
+    return response->status;
+}
+
+#else
+
+bool connectServer(ServerConnection *server, const char *path) {
+    (void) path;
+    server->fd = -1;
+    return false;
+}
+
+void disconnectServer(ServerConnection *server) {
+    server->fd = -1;
+}
+
+bool readAll(int fd, char *data, size_t size) {
+    (void) fd;
+    (void) data;
+    return size == 0;
+}
+
+int sendRequest(ServerConnection *server, RequestType type, const int32_t args[4], const char *text,
+                size_t textLength, ResponseHeader *response) {
+    (void) server;
+    (void) type;
+    (void) args;
+    (void) text;
+    (void) textLength;
+    (void) response;
+    return -1;
+}
+
+#endif
+
+// listedLength returns how long the stock, user or order of the given kind at data is, 0 if it doesn't fit or
+// has a type or status the replica doesn't know
+size_t listedLength(int32_t kind, const char *data, size_t length) {
+    if (kind == CHANGE_STOCK) return length >= sizeof(StockRecord) ? sizeof(StockRecord) : 0;
+    if (kind == CHANGE_USER) {
+        if (length < sizeof(UserRecord)) return 0;
+        UserRecord record;
+        memcpy(&record, data, sizeof(record));
+        return record.type >= CHEF && record.type <= ADMIN ? sizeof(record) : 0;
+    }
+    if (kind != CHANGE_ORDER || length < sizeof(OrderRecord)) return 0;
+    OrderRecord record;
+    memcpy(&record, data, sizeof(record));
+    if (record.itemCount < 0 || (length - sizeof(record)) / sizeof(ListItem) < (size_t) record.itemCount) return 0;
+    if (record.paymentType < 0 || record.paymentType >= PAYMENT_TYPE_COUNT || record.orderStatus < 0 ||
+        record.orderStatus >= ORDER_STATUS_COUNT)
+        return 0;
+    return sizeof(record) + sizeof(ListItem) * record.itemCount;
+}
+
+// listedOrder adds an order from a list to the replica, or returns NULL if there's no memory for its items
+Order *listedOrder(const char *data) {
+    OrderRecord record;
+    memcpy(&record, data, sizeof(record));
+    data += sizeof(record);
+    Order *order = slabAlloc(&orderSlab);
+    order->id = record.id;
+    order->cashierId = record.cashierId;
+    order->paymentType = record.paymentType;
+    order->orderStatus = record.orderStatus;
+    order->settledAt = 0;
+    order->statusNext = NULL;
+    order->statusPrev = NULL;
+    order->inKitchen = false;
+    initOrderItems(order);
+    if (!growOrderItems(order, record.itemCount)) {
+        slabFree(&orderSlab, order);
+        return NULL;
+    }
+    for (int j = 0; j < record.itemCount; j++, data += sizeof(ListItem)) {
+        ListItem listed;
+        memcpy(&listed, data, sizeof(listed));
+        order->items[order->itemCount++] = (Item) {listed.id, listed.stockId, listed.quantity, listed.price, NULL};
+    }
+    addOrder(order);
+    return order;
+}
+
+// dropListedOrder takes an order out of the replica before what it is now is added. The server's stock
+// quantities already count its units, so only what the replica reserved for it is given back.
+void dropListedOrder(Order *order) {
+    for (const Item *item = order->items; order->orderStatus == WAITING && item < order->items + order->itemCount;
+         item++) {
+        Stock *stock = findStock(item->stockId);
+        if (stock != NULL) atomic_fetch_sub(&stock->reserved, item->quantity);
+    }
+    pthread_mutex_lock(&salesLock);
+    recordOrder(&sales, order, -1);
+    pthread_mutex_unlock(&salesLock);
+    unlinkOrder(order);
+}
+
+// applyList replaces the replica with the stocks, users and orders of a full list.
+// The logged in user is looked up again since the replica's nodes are all new.
+bool applyList(const char *list, size_t length) {
+    if (length < sizeof(ListCounts)) return false;
+    ListCounts counts;
+    memcpy(&counts, list, sizeof(counts));
+    if (counts.orders < 0 || counts.stocks < 0 || counts.users < 0) return false;
+    const char *payload = list + sizeof(counts);
+    length -= sizeof(counts);
+
+    // the whole list is checked before the replica is touched
+    size_t offset = sizeof(StockRecord) * counts.stocks;
+    for (int i = 0; i < counts.users && offset <= length; i++) {
+        if (listedLength(CHANGE_USER, payload + offset, length - offset) == 0) return false;
+        offset += sizeof(UserRecord);
+    }
+    for (int i = 0; i < counts.orders && offset <= length; i++) {
+        const size_t size = listedLength(CHANGE_ORDER, payload + offset, length - offset);
+        if (size == 0) return false;
+        offset += size;
+    }
+    if (offset != length) return false;
+
+    const int loggedUserId = loggedUser != NULL ? loggedUser->id : 0;
+    clearOrders();
+    while (stocks.head != NULL) removeStock(stocks.head);
+    while (users.head != NULL) removeUser(users.head);
+
+    offset = 0;
+    for (int i = 0; i < counts.stocks; i++, offset += sizeof(StockRecord)) {
+        StockRecord record;
+        memcpy(&record, payload + offset, sizeof(record));
+        Stock *stock = slabAlloc(&stockSlab);
+        stock->id = record.id;
+        stock->price = record.price;
+        stock->quantity = record.quantity;
+        stock->reserved = 0;
+        stock->name = internString(record.name, NAME_SIZE);
+        addStock(stock);
+    }
+    for (int i = 0; i < counts.users; i++, offset += sizeof(UserRecord)) {
+        UserRecord record;
+        memcpy(&record, payload + offset, sizeof(record));
+        User *user = slabAlloc(&userSlab);
+        user->id = record.id;
+        user->type = record.type;
+        user->name = internString(record.name, NAME_SIZE);
+        user->hashedPassword = 0;
+        addUser(user);
+    }
+    for (int i = 0; i < counts.orders; i++) {
+        if (listedOrder(payload + offset) == NULL) return false;
+        offset += listedLength(CHANGE_ORDER, payload + offset, length - offset);
+    }
+
+    loggedUser = findUser(loggedUserId);
+    return true;
+}
+
+// applyChanges brings the replica up to date with a page of changes. Stocks and users go first so that the
+// orders find the stocks they reserve, and are removed last, once no waiting order holds them.
+bool applyChanges(const char *payload, size_t length) {
+    // the whole page is checked before the replica is touched
+    size_t offset = 0;
+    while (offset < length) {
+        if (length - offset < sizeof(ListChange)) return false;
+        ListChange change;
+        memcpy(&change, payload + offset, sizeof(change));
+        offset += sizeof(change);
+        if (change.kind < CHANGE_ORDER || change.kind > CHANGE_USER) return false;
+        if (change.removed) continue;
+        const size_t size = listedLength(change.kind, payload + offset, length - offset);
+        if (size == 0) return false;
+        offset += size;
+    }
+
+    const int loggedUserId = loggedUser != NULL ? loggedUser->id : 0;
+    for (int pass = 0; pass < 3; pass++) {
+        for (offset = 0; offset < length;) {
+            ListChange change;
+            memcpy(&change, payload + offset, sizeof(change));
+            const char *data = payload + offset + sizeof(change);
+            offset += sizeof(change);
+            if (!change.removed) offset += listedLength(change.kind, data, length - offset);
+            if (pass != (change.kind == CHANGE_ORDER ? 1 : change.removed ? 2 : 0)) continue;
+
+            if (change.kind == CHANGE_STOCK) {
+                Stock *stock = findStock(change.id);
+                if (change.removed) {
+                    if (stock != NULL) removeStock(stock);
+                    continue;
+                }
+                StockRecord record;
+                memcpy(&record, data, sizeof(record));
+                record.name[sizeof(record.name) - 1] = '\0';
+                if (stock != NULL) {
+                    updateStock(stock, record.name, record.price, record.quantity);
+                    continue;
+                }
+                stock = slabAlloc(&stockSlab);
+                stock->id = record.id;
+                stock->price = record.price;
+                stock->quantity = record.quantity;
+                stock->reserved = 0;
+                stock->name = internString(record.name, NAME_SIZE);
+                addStock(stock);
+            } else if (change.kind == CHANGE_USER) {
+                // users only come and go, one that is listed again is added anew
+                User *user = findUser(change.id);
+                if (user != NULL) removeUser(user);
+                if (change.removed) continue;
+                UserRecord record;
+                memcpy(&record, data, sizeof(record));
+                user = slabAlloc(&userSlab);
+                user->id = record.id;
+                user->type = record.type;
+                user->name = internString(record.name, NAME_SIZE);
+                user->hashedPassword = 0;
+                addUser(user);
+            } else {
+                Order *order = findOrder(change.id);
+                if (order != NULL) dropListedOrder(order);
+                if (!change.removed && listedOrder(data) == NULL) return false;
+            }
+        }
+    }
+
+    loggedUser = findUser(loggedUserId);
+    return true;
+}
+
+// syncReplica brings the replica up to date, with the changes since its version a page at a time or with
+// the full list when the server doesn't have them anymore
+bool syncReplica(ServerConnection *server) {
+    size_t offset = 0;
+    for (;;) {
+        ResponseHeader response;
+        const int status = sendRequest(server, REQUEST_LIST, (int32_t[4]) {server->version, server->epoch, offset},
+                                       NULL, 0, &response);
+        if (status == RESPONSE_UNCHANGED) return true;
+        const size_t length = status >= 0 ? response.size - sizeof(ResponseHeader) : 0;
+        if (status == RESPONSE_CHANGES) {
+            if (!applyChanges(server->payload, length)) return false;
+            server->version = response.args[0];
+            if (!response.args[2]) return true;
+            continue;
+        }
+
+        // a page of the full list, which is applied once every page is in
+        const size_t size = response.args[3] > 0 ? (size_t) response.args[3] : 0;
+        if (status != RESPONSE_OK || length == 0 || (size_t) response.args[2] != offset || offset + length > size)
+            return false;
+        if (size > server->listCapacity) {
+            char *list = realloc(server->list, size);
+            if (list == NULL) return false;
+            server->list = list;
+            server->listCapacity = size;
+        }
+        memcpy(server->list + offset, server->payload, length);
+        offset += length;
+        if (offset < size) continue;
+        if (!applyList(server->list, size)) return false;
+        server->version = response.args[0];
+        server->epoch = response.args[1];
+        return true;
+    }
+}
+
+// credentials writes "name\0password\0" into text and returns its length
+size_t credentials(char text[], const char *name, const char *password) {
+    const size_t nameLength = strlen(name) + 1, passwordLength = strlen(password) + 1;
+    memcpy(text, name, nameLength);
+    memcpy(text + nameLength, password, passwordLength);
+    return nameLength + passwordLength;
+}
+
+bool remoteLogin(ServerConnection *server, const char *name, const char *password) {
+    char text[256];
+    if (strlen(name) > 100 || strlen(password) > 100) return false;
+    ResponseHeader response;
+    const size_t length = credentials(text, name, password);
+    if (sendRequest(server, REQUEST_LOGIN, (int32_t[4]) {0}, text, length, &response) != RESPONSE_OK) return false;
+    syncReplica(server);
+    loggedUser = findUser(response.args[0]);
+    return loggedUser != NULL;
+}
+
+bool remoteRegister(ServerConnection *server, const char *name, const char *password, UserType type) {
+    char text[256];
+    if (strlen(name) > 100 || strlen(password) > 100) return false;
+    ResponseHeader response;
+    const size_t length = credentials(text, name, password);
+    const bool ok = sendRequest(server, REQUEST_REGISTER, (int32_t[4]) {type}, text, length, &response) == RESPONSE_OK;
+    syncReplica(server);
+    return ok;
+}
+
+// remoteCreateOrder returns the id of the new order, or 0 if it wasn't created
+int remoteCreateOrder(ServerConnection *server, PaymentType paymentType) {
+    ResponseHeader response;
+    if (sendRequest(server, REQUEST_CREATE_ORDER, (int32_t[4]) {paymentType}, NULL, 0, &response) != RESPONSE_OK)
+        return 0;
+    syncReplica(server);
+    return response.args[0];
+}
+
+bool remoteAddItem(ServerConnection *server, int orderId, int stockId, int quantity) {
+    ResponseHeader response;
+    const bool ok = sendRequest(server, REQUEST_ADD_ITEM, (int32_t[4]) {orderId, stockId, quantity}, NULL, 0,
+                                &response) == RESPONSE_OK;
+    syncReplica(server);
+    return ok;
+}
+
+bool remoteCook(ServerConnection *server, int orderId) {
+    ResponseHeader response;
+    const bool ok = sendRequest(server, REQUEST_COOK, (int32_t[4]) {orderId}, NULL, 0, &response) == RESPONSE_OK;
+    syncReplica(server);
+    return ok;
+}
+
+bool remotePlaceOrder(ServerConnection *server, int orderId) {
+    ResponseHeader response;
+    const bool ok = sendRequest(server, REQUEST_PLACE, (int32_t[4]) {orderId}, NULL, 0, &response) == RESPONSE_OK;
+    syncReplica(server);
+    return ok;
+}
@@ -0,0 +1,60 @@
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include "server.h"
+
+// ServerConnection is a terminal's connection to the server. Requests are sent one at a time and wait for
+// their response, payload holds the payload of the last one. version and epoch are the data version the replica
+// has and the server it is from, list is where the pages of a full list are put together.
+typedef struct {
+    int fd;
+    int32_t version;
+    int32_t epoch;
+    char *payload;
+    size_t payloadCapacity;
+    char *list;
+    size_t listCapacity;
+} ServerConnection;
+
+// connection is the terminal's own connection, fd is -1 while the terminal keeps its own data
+extern ServerConnection connection;
+
+// functions for talking to the server
+bool connectServer(ServerConnection *server, const char *path);
+
+void disconnectServer(ServerConnection *server);
+
+bool readAll(int fd, char *data, size_t size);
+
+int sendRequest(ServerConnection *server, RequestType type, const int32_t args[4], const char *text,
+                size_t textLength, ResponseHeader *response);
+
+// functions for the replica, the copy of the server's data the terminal draws from
+size_t listedLength(int32_t kind, const char *data, size_t length);
+
+Order *listedOrder(const char *data);
+
+void dropListedOrder(Order *order);
+
+bool applyList(const char *list, size_t length);
+
+bool applyChanges(const char *payload, size_t length);
+
+bool syncReplica(ServerConnection *server);
+
+// functions the terminal calls instead of changing its replica, each refreshes the replica after the change
+size_t credentials(char text[], const char *name, const char *password);
+
+bool remoteLogin(ServerConnection *server, const char *name, const char *password);
+
+bool remoteRegister(ServerConnection *server, const char *name, const char *password, UserType type);
+
+int remoteCreateOrder(ServerConnection *server, PaymentType paymentType);
+
+bool remoteAddItem(ServerConnection *server, int orderId, int stockId, int quantity);
+
+bool remoteCook(ServerConnection *server, int orderId);
+
+bool remotePlaceOrder(ServerConnection *server, int orderId);
+
+#endif
@@ -0,0 +1,74 @@
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <poll.h>
+#endif
+
+#include "events.h"
+#include "restaurant.h"
+
+void initEventLoop(EventLoop *loop, int fd) {
+    memset(loop, 0, sizeof(EventLoop));
+    loop->fd = fd;
+}
+
+// addTimer returns the timer slot, or -1 when every slot is taken
+int addTimer(EventLoop *loop, int intervalMillis, void (*callback)(void *context), void *context) {
+    for (int i = 0; i < MAX_TIMERS; i++) {
+        Timer *timer = &loop->timers[i];
+        if (timer->active) continue;
+        timer->active = true;
+        timer->intervalNanos = intervalMillis * 1000000LL;
+        timer->deadline = nowNanos() + timer->intervalNanos;
+        timer->callback = callback;
+        timer->context = context;
+        return i;
+    }
+    return -1;
+}
+
+void removeTimer(EventLoop *loop, int timer) {
+    if (timer >= 0 && timer < MAX_TIMERS) loop->timers[timer].active = false;
+}
+
+// waitForInput sleeps until the descriptor is readable, running due timers on the way.
+// It returns true when there is input and false once timeoutMillis passed, a negative timeout waits forever.
+bool waitForInput(EventLoop *loop, int timeoutMillis) {
+    const long long giveUpAt = timeoutMillis < 0 ? -1 : nowNanos() + timeoutMillis * 1000000LL;
+    while (1) {
+        long long now = nowNanos();
+        for (int i = 0; i < MAX_TIMERS; i++) {
+            Timer *timer = &loop->timers[i];
+            if (!timer->active || timer->deadline > now) continue;
+            // skip the ticks missed while busy instead of firing them back to back
+            while (timer->deadline <= now) timer->deadline += timer->intervalNanos;
+            timer->callback(timer->context);
+            now = nowNanos();
+        }
+
+        long long wakeAt = giveUpAt;
+        for (int i = 0; i < MAX_TIMERS; i++) {
+            if (loop->timers[i].active && (wakeAt < 0 || loop->timers[i].deadline < wakeAt)) {
+                wakeAt = loop->timers[i].deadline;
+            }
+        }
+        if (giveUpAt >= 0 && now >= giveUpAt) return false;
+        // round up so a wait never ends just before the deadline and spins
+        const int waitMillis = wakeAt < 0 ? -1 : (int) ((wakeAt - now + 999999) / 1000000);
+
+#ifdef _WIN32
+        const DWORD result = WaitForSingleObject(GetStdHandle(STD_INPUT_HANDLE),
+                                                 waitMillis < 0 ? INFINITE : (DWORD) waitMillis);
+        if (result == WAIT_OBJECT_0) return true;
+        if (result != WAIT_TIMEOUT) return false;
+#else
+        struct pollfd input = {loop->fd, POLLIN, 0};
+        const int ready = poll(&input, 1, waitMillis);
+        if (ready > 0) return true;
+        if (ready < 0 && errno != EINTR) return false;
+#endif
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdbool.h>
+
+#define MAX_TIMERS 8
+
+// Timer calls its callback every interval while the event loop waits for input
+typedef struct {
+    bool active;
+    long long intervalNanos;
+    long long deadline;
+    void (*callback)(void *context);
+    void *context;
+} Timer;
+
+// EventLoop blocks on an input descriptor instead of polling it, and runs the timers that fall due meanwhile
+typedef struct {
+    int fd;
+    Timer timers[MAX_TIMERS];
+} EventLoop;
+
+void initEventLoop(EventLoop *loop, int fd);
+
+int addTimer(EventLoop *loop, int intervalMillis, void (*callback)(void *context), void *context);
+
+void removeTimer(EventLoop *loop, int timer);
+
+bool waitForInput(EventLoop *loop, int timeoutMillis);
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+#include "export.h"
+#include "snapshot.h"
+#include "storage.h"
+
+bool parseExportFormat(const char *name, ExportFormat *format) {
+    if (strcmp(name, "columns") == 0) *format = EXPORT_COLUMNS;
+    else if (strcmp(name, "csv") == 0) *format = EXPORT_CSV;
+    else return false;
+    return true;
+}
+
+// beginExport opens a temporary file next to path like the data files do, so a failed export leaves no half file
+bool beginExport(Exporter *exporter, const char *path, ExportFormat format) {
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+    exporter->file = fopen(temporaryPath, "wb");
+    if (exporter->file == NULL) return false;
+    setvbuf(exporter->file, NULL, _IOFBF, 1 << 20);
+
+    exporter->path = path;
+    exporter->format = format;
+    exporter->rows = 0;
+    exporter->nameOffsets[0] = 0;
+    memset(&exporter->header, 0, sizeof(ExportFileHeader));
+    memcpy(exporter->header.magic, "CREX", 4);
+    exporter->header.version = EXPORT_VERSION;
+    exporter->header.columnCount = EXPORT_INT_COLUMNS + 2;
+    exporter->header.batchRows = EXPORT_BATCH_ROWS;
+
+    const bool ok = format == EXPORT_CSV
+                        ? fputs("order_id,cashier_id,payment,status,item_id,stock_id,stock_name,quantity,price,"
+                                "stock_price,line_total\n", exporter->file) >= 0
+                        : fwrite(&exporter->header, sizeof(ExportFileHeader), 1, exporter->file) == 1;
+    if (!ok) {
+        fclose(exporter->file);
+        exporter->file = NULL;
+        remove(temporaryPath);
+    }
+    return ok;
+}
+
+// exportRow adds a row to the batch and writes the batch out once it is full
+bool exportRow(Exporter *exporter, const ExportRow *row) {
+    const int at = exporter->rows;
+    for (int column = 0; column < EXPORT_INT_COLUMNS; column++) exporter->columns[column][at] = row->values[column];
+    exporter->lineTotals[at] = (int64_t) row->values[EXPORT_QUANTITY] * row->values[EXPORT_PRICE];
+
+    size_t length = row->stockName != NULL ? strlen(row->stockName) : 0;
+    if (length > 103) length = 103;
+    if (length > 0) memcpy(exporter->names + exporter->nameOffsets[at], row->stockName, length);
+    exporter->nameOffsets[at + 1] = exporter->nameOffsets[at] + length;
+
+    exporter->rows++;
+    return exporter->rows < EXPORT_BATCH_ROWS || flushExport(exporter);
+}
+
+bool flushExport(Exporter *exporter) {
+    if (exporter->rows == 0) return true;
+    const bool ok = exporter->format == EXPORT_CSV ? writeCsvBatch(exporter) : writeColumnBatch(exporter);
+    exporter->header.rowCount += exporter->rows;
+    exporter->header.batchCount++;
+    exporter->rows = 0;
+    return ok;
+}
+
+// endExport writes what is left of the last batch and the final counts, and moves the file over path if ok
+bool endExport(Exporter *exporter, bool ok) {
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", exporter->path);
+
+    ok = ok && flushExport(exporter);
+    if (ok && exporter->format == EXPORT_COLUMNS) {
+        ok = fseek(exporter->file, 0, SEEK_SET) == 0 &&
+             fwrite(&exporter->header, sizeof(ExportFileHeader), 1, exporter->file) == 1;
+    }
+    ok = fclose(exporter->file) == 0 && ok;
+    if (ok) {
+#ifdef _WIN32
+        remove(exporter->path);
+#endif
+        ok = rename(temporaryPath, exporter->path) == 0;
+    }
+    if (!ok) remove(temporaryPath);
+    return ok;
+}
+
+// writeCsvBatch writes the batch a row per line, names are quoted with their quotes doubled
+bool writeCsvBatch(Exporter *exporter) {
+    FILE *file = exporter->file;
+    bool ok = true;
+    for (int row = 0; row < exporter->rows && ok; row++) {
+        ok = fprintf(file, "%d,%d,%s,%s,%d,%d,\"", exporter->columns[EXPORT_ORDER_ID][row],
+                     exporter->columns[EXPORT_CASHIER_ID][row],
+                     getPaymentName(exporter->columns[EXPORT_PAYMENT_TYPE][row]),
+                     getOrderStatusName(exporter->columns[EXPORT_ORDER_STATUS][row]),
+                     exporter->columns[EXPORT_ITEM_ID][row], exporter->columns[EXPORT_STOCK_ID][row]) > 0;
+        for (uint32_t i = exporter->nameOffsets[row]; i < exporter->nameOffsets[row + 1] && ok; i++) {
+            if (exporter->names[i] == '"') ok = fputc('"', file) != EOF;
+            ok = ok && fputc(exporter->names[i], file) != EOF;
+        }
+        ok = ok && fprintf(file, "\",%d,%d,%d,%lld\n", exporter->columns[EXPORT_QUANTITY][row],
+                           exporter->columns[EXPORT_PRICE][row], exporter->columns[EXPORT_STOCK_PRICE][row],
+                           (long long) exporter->lineTotals[row]) > 0;
+    }
+    return ok;
+}
+
+// writeColumnBatch writes the batch one column after the other, so a reader can take just the columns it needs
+bool writeColumnBatch(Exporter *exporter) {
+    const uint32_t rows = exporter->rows;
+    ExportBatchHeader header = {rows, exporter->nameOffsets[rows], 2166136261U, 0};
+    for (int column = 0; column < EXPORT_INT_COLUMNS; column++) {
+        header.checksum = checksumData(header.checksum, exporter->columns[column], sizeof(int32_t) * rows);
+    }
+    header.checksum = checksumData(header.checksum, exporter->lineTotals, sizeof(int64_t) * rows);
+    header.checksum = checksumData(header.checksum, exporter->nameOffsets, sizeof(uint32_t) * (rows + 1));
+    header.checksum = checksumData(header.checksum, exporter->names, header.nameBytes);
+
+    FILE *file = exporter->file;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int column = 0; column < EXPORT_INT_COLUMNS && ok; column++) {
+        ok = fwrite(exporter->columns[column], sizeof(int32_t), rows, file) == rows;
+    }
+    ok = ok && fwrite(exporter->lineTotals, sizeof(int64_t), rows, file) == rows;
+    ok = ok && fwrite(exporter->nameOffsets, sizeof(uint32_t), rows + 1, file) == rows + 1;
+    ok = ok && fwrite(exporter->names, 1, header.nameBytes, file) == header.nameBytes;
+    return ok;
+}
+
+// exportItem joins an item with its stock and adds it as a row of the order in row.
+bool exportItem(Exporter *exporter, ExportRow *row, const IdIndex *stockIndex, int itemId, int stockId,
+                int quantity, int price) {
+    const SnapshotStock *stock = indexGet(stockIndex, stockId);
+    row->values[EXPORT_ITEM_ID] = itemId;
+    row->values[EXPORT_STOCK_ID] = stockId;
+    row->values[EXPORT_QUANTITY] = quantity;
+    row->values[EXPORT_STOCK_PRICE] = stock != NULL ? stock->price : 0;
+    row->values[EXPORT_PRICE] = price;
+    row->stockName = stock != NULL ? stock->name : NULL;
+    return exportRow(exporter, row);
+}
+
+// exportSnapshot exports the orders in memory as they were when it started, reading them a snapshot batch
+// at a time so cashiers and cooks carry on meanwhile. Archived orders aren't in memory, exportFiles has them.
+long long exportSnapshot(const char *path, ExportFormat format) {
+    Exporter *exporter = malloc(sizeof(Exporter));
+    if (exporter == NULL) return -1;
+    if (!openSnapshot()) {
+        free(exporter);
+        return -1;
+    }
+    IdIndex stockIndex = {NULL, 0, 0};
+    for (int i = 0; i < snapshot.stockCount; i++) indexPut(&stockIndex, snapshot.stocks[i].id, &snapshot.stocks[i]);
+
+    const bool begun = beginExport(exporter, path, format);
+    bool ok = begun;
+    SnapshotBuffer batch = {0};
+    int count = 0;
+    while (ok && (count = readSnapshot(&batch)) > 0) {
+        for (int i = 0; i < count && ok; i++) {
+            const SnapshotOrder *order = &batch.orders[i];
+            ExportRow row = {{order->id, order->cashierId, order->paymentType, order->orderStatus}, NULL};
+            if (order->itemCount == 0) ok = exportRow(exporter, &row);
+            for (const SnapshotItem *item = batch.items + order->firstItem;
+                 item < batch.items + order->firstItem + order->itemCount && ok; item++) {
+                ok = exportItem(exporter, &row, &stockIndex, item->id, item->stockId, item->quantity, item->price);
+            }
+        }
+    }
+    ok = ok && count == 0;
+    if (begun) ok = endExport(exporter, ok) && ok;
+    const long long rows = ok ? (long long) exporter->header.rowCount : -1;
+
+    snapshotFreeBuffer(&batch);
+    free(stockIndex.entries);
+    closeSnapshot();
+    free(exporter);
+    return rows;
+}
+
+// exportFiles exports the whole history as of the last checkpoint, the archive first and then the orders file,
+// without loading either. Both are mapped and streamed, only the stocks and the ids of the orders file are kept.
+// An order archived after the checkpoint is in both files, its archived copy is the one exported.
+long long exportFiles(const char *path, ExportFormat format) {
+    MappedFile stocksFile = {NULL, 0}, ordersFile = {NULL, 0}, archiveFile = {NULL, 0};
+    const bool haveStocks = mapFile(stocksFilePath, &stocksFile);
+    const bool haveOrders = mapFile(ordersFilePath, &ordersFile);
+    const bool haveArchive = mapFile(archiveFilePath, &archiveFile);
+    const char *error = NULL;
+    if (haveStocks && (error = validateDataFile(&stocksFile, "CRST", sizeof(StockRecord), 0)) != NULL) {
+        fprintf(stderr, "%s: %s\n", stocksFilePath, error);
+    } else if (haveOrders &&
+               (error = validateDataFile(&ordersFile, "CROR", sizeof(OrderRecord), sizeof(ItemRecord))) != NULL) {
+        fprintf(stderr, "%s: %s\n", ordersFilePath, error);
+    } else if (haveArchive && !validateArchive(&archiveFile)) {
+        fprintf(stderr, "%s: bad archive header\n", archiveFilePath);
+        error = "bad archive header";
+    }
+
+    const DataFileHeader *stocksHeader = (const DataFileHeader *) stocksFile.data;
+    const uint64_t stockCount = haveStocks && error == NULL ? stocksHeader->count : 0;
+    SnapshotStock *stockCopies = malloc(sizeof(SnapshotStock) * (stockCount > 0 ? stockCount : 1));
+    Exporter *exporter = malloc(sizeof(Exporter));
+    const bool begun = error == NULL && stockCopies != NULL && exporter != NULL &&
+                       beginExport(exporter, path, format);
+    bool ok = begun;
+
+    IdIndex stockIndex = {NULL, 0, 0};
+    const StockRecord *stockRecords = (const StockRecord *) (stocksFile.data + sizeof(DataFileHeader));
+    for (uint64_t i = 0; i < stockCount && ok; i++) {
+        SnapshotStock *copy = &stockCopies[i];
+        copy->id = stockRecords[i].id;
+        copy->price = stockRecords[i].price;
+        memcpy(copy->name, stockRecords[i].name, sizeof(copy->name) - 1);
+        copy->name[sizeof(copy->name) - 1] = '\0';
+        indexPut(&stockIndex, copy->id, copy);
+    }
+
+    // the ids of the orders file, an order the archive also has gets marked so it is skipped below
+    int archivedMark = 0;
+    IdIndex orderIds = {NULL, 0, 0};
+    const DataFileHeader *ordersHeader = (const DataFileHeader *) ordersFile.data;
+    const uint64_t orderCount = haveOrders && ok ? ordersHeader->count : 0;
+    const OrderRecord *orderRecords = (const OrderRecord *) (ordersFile.data + sizeof(DataFileHeader));
+    for (uint64_t i = 0; i < orderCount; i++) indexPut(&orderIds, orderRecords[i].id, (void *) &orderRecords[i]);
+
+    size_t offset = sizeof(ArchiveFileHeader);
+    ArchiveRecord record;
+    const ArchiveItemRecord *archivedItems;
+    while (ok && haveArchive && nextArchiveRecord(&archiveFile, &offset, &record, &archivedItems)) {
+        if (indexGet(&orderIds, record.id) != NULL) indexPut(&orderIds, record.id, &archivedMark);
+        ExportRow row = {{record.id, record.cashierId, record.paymentType, record.orderStatus}, NULL};
+        if (record.itemCount == 0) ok = exportRow(exporter, &row);
+        for (int i = 0; i < record.itemCount && ok; i++) {
+            ok = exportItem(exporter, &row, &stockIndex, archivedItems[i].id, archivedItems[i].stockId,
+                            archivedItems[i].quantity, archivedItems[i].price);
+        }
+    }
+
+    const ItemRecord *itemRecords = (const ItemRecord *) (orderRecords + orderCount);
+    uint64_t nextItem = 0;
+    for (uint64_t i = 0; i < orderCount && ok; i++) {
+        const OrderRecord *order = &orderRecords[i];
+        if (order->itemCount < 0 || (uint64_t) order->itemCount > ordersHeader->itemCount - nextItem) {
+            fprintf(stderr, "%s: item count out of range\n", ordersFilePath);
+            ok = false;
+            break;
+        }
+        const ItemRecord *items = itemRecords + nextItem;
+        nextItem += order->itemCount;
+        if (indexGet(&orderIds, order->id) == &archivedMark) continue;
+        ExportRow row = {{order->id, order->cashierId, order->paymentType, order->orderStatus}, NULL};
+        if (order->itemCount == 0) ok = exportRow(exporter, &row);
+        for (int j = 0; j < order->itemCount && ok; j++) {
+            ok = exportItem(exporter, &row, &stockIndex, items[j].id, items[j].stockId, items[j].quantity,
+                             items[j].price);
+        }
+    }
+
+    long long rows = -1;
+    if (begun && endExport(exporter, ok) && ok) rows = (long long) exporter->header.rowCount;
+
+    free(orderIds.entries);
+    free(stockIndex.entries);
+    free(stockCopies);
+    free(exporter);
+    if (haveStocks) unmapFile(&stocksFile);
+    if (haveOrders) unmapFile(&ordersFile);
+    if (haveArchive) unmapFile(&archiveFile);
+    return rows;
+}
@@ -0,0 +1,93 @@
+#ifndef EXPORT_H
+#define EXPORT_H
+
+#include <stdio.h>
+
+#include "restaurant.h"
+
+#define EXPORT_VERSION 1
+
+// rows are written in batches of this many, the exporter never holds more than one batch
+#define EXPORT_BATCH_ROWS 4096
+
+typedef enum {
+    EXPORT_COLUMNS,
+    EXPORT_CSV
+} ExportFormat;
+
+// the int32 columns of a row, in the order a batch stores them
+typedef enum {
+    EXPORT_ORDER_ID,
+    EXPORT_CASHIER_ID,
+    EXPORT_PAYMENT_TYPE,
+    EXPORT_ORDER_STATUS,
+    EXPORT_ITEM_ID,
+    EXPORT_STOCK_ID,
+    EXPORT_QUANTITY,
+    EXPORT_PRICE,
+    EXPORT_STOCK_PRICE,
+    EXPORT_INT_COLUMNS
+} ExportColumn;
+
+// ExportFileHeader starts a columnar export, batches follow it until the end of the file. The counts are filled
+// in once the export is complete. Each batch is an ExportBatchHeader, then every int32 column for its rows,
+// then the int64 line totals, rows + 1 uint32 offsets into the names and the names themselves.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t columnCount;
+    uint32_t batchRows;
+    uint64_t rowCount;
+    uint32_t batchCount;
+    uint32_t reserved;
+} ExportFileHeader;
+
+// ExportBatchHeader gives the size of a batch, the checksum covers everything after it up to the next batch
+typedef struct {
+    uint32_t rows;
+    uint32_t nameBytes;
+    uint32_t checksum;
+    uint32_t reserved;
+} ExportBatchHeader;
+
+// ExportRow is one item of an order joined with its stock. price is what the item was sold at and stockPrice
+// what the stock costs now. An order without items is a row with item and stock 0 and no name.
+typedef struct {
+    int32_t values[EXPORT_INT_COLUMNS];
+    const char *stockName;
+} ExportRow;
+
+// Exporter is an export being written, the batch it is filling is kept column by column
+typedef struct {
+    FILE *file;
+    const char *path;
+    ExportFormat format;
+    ExportFileHeader header;
+    int rows;
+    int32_t columns[EXPORT_INT_COLUMNS][EXPORT_BATCH_ROWS];
+    int64_t lineTotals[EXPORT_BATCH_ROWS];
+    uint32_t nameOffsets[EXPORT_BATCH_ROWS + 1];
+    char names[EXPORT_BATCH_ROWS * 104];
+} Exporter;
+
+// functions for writing an export, the file only replaces path once endExport succeeds
+bool beginExport(Exporter *exporter, const char *path, ExportFormat format);
+
+bool exportRow(Exporter *exporter, const ExportRow *row);
+
+bool flushExport(Exporter *exporter);
+
+bool endExport(Exporter *exporter, bool ok);
+
+bool writeCsvBatch(Exporter *exporter);
+
+bool writeColumnBatch(Exporter *exporter);
+
+// functions for what is exported, each returns how many rows it wrote or -1 if it failed
+long long exportSnapshot(const char *path, ExportFormat format);
+
+long long exportFiles(const char *path, ExportFormat format);
+
+bool parseExportFormat(const char *name, ExportFormat *format);
+
+#endif
@@ -0,0 +1,437 @@
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "kitchen.h"
+
+KitchenPipeline kitchen = {
+    {NULL, 0, 0, 0, {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0}}, NULL, false, 0
+};
+ChefWorker kitchenChefs[KITCHEN_CHEFS];
+KitchenScheduler kitchenScheduler = {
+    NULL, NULL, 0, true, NULL, true, false, 0, 0, 0, {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0}
+};
+
+void initBell(KitchenBell *bell) {
+    pthread_mutex_init(&bell->lock, NULL);
+    pthread_cond_init(&bell->rung, NULL);
+    atomic_store(&bell->rings, 0);
+    atomic_store(&bell->sleepers, 0);
+}
+
+void freeBell(KitchenBell *bell) {
+    pthread_cond_destroy(&bell->rung);
+    pthread_mutex_destroy(&bell->lock);
+}
+
+// bellTicket is taken before the last look at an empty queue, waitBell returns at once if the bell rang since
+unsigned int bellTicket(KitchenBell *bell) {
+    return atomic_load(&bell->rings);
+}
+
+// ringBell wakes the parked workers after work was handed over or the kitchen closed. The lock is only taken
+// when someone sleeps: a worker counts itself before it checks the rings, so one of the two sees the other.
+void ringBell(KitchenBell *bell) {
+    atomic_fetch_add(&bell->rings, 1);
+    if (atomic_load(&bell->sleepers) == 0) return;
+    pthread_mutex_lock(&bell->lock);
+    pthread_cond_broadcast(&bell->rung);
+    pthread_mutex_unlock(&bell->lock);
+}
+
+void waitBell(KitchenBell *bell, unsigned int ticket) {
+    pthread_mutex_lock(&bell->lock);
+    atomic_fetch_add(&bell->sleepers, 1);
+    while (atomic_load(&bell->rings) == ticket) pthread_cond_wait(&bell->rung, &bell->lock);
+    atomic_fetch_sub(&bell->sleepers, 1);
+    pthread_mutex_unlock(&bell->lock);
+}
+
+bool initOrderQueue(OrderQueue *queue, size_t capacity) {
+    // the capacity is rounded up to a power of two so positions map to cells with a mask
+    size_t size = 2;
+    while (size < capacity) size *= 2;
+    queue->cells = malloc(sizeof(OrderQueueCell) * size);
+    if (queue->cells == NULL) return false;
+    for (size_t i = 0; i < size; i++) atomic_store_explicit(&queue->cells[i].sequence, i, memory_order_relaxed);
+    queue->mask = size - 1;
+    atomic_store(&queue->enqueuePosition, 0);
+    atomic_store(&queue->dequeuePosition, 0);
+    initBell(&queue->bell);
+    return true;
+}
+
+void freeOrderQueue(OrderQueue *queue) {
+    freeBell(&queue->bell);
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+// publishOrder hands an order over to the kitchen and wakes a parked chef, it returns false when the queue is full
+bool publishOrder(OrderQueue *queue, Order *order) {
+    size_t position = atomic_load_explicit(&queue->enqueuePosition, memory_order_relaxed);
+    while (1) {
+        OrderQueueCell *cell = &queue->cells[position & queue->mask];
+        const size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        const long difference = (long) sequence - (long) position;
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->enqueuePosition, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                cell->order = order;
+                cell->publishedAt = nowNanos();
+                atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+                ringBell(&queue->bell);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = atomic_load_explicit(&queue->enqueuePosition, memory_order_relaxed);
+        }
+    }
+}
+
+// takeOrder returns the oldest published order, or NULL when the queue is empty
+Order *takeOrder(OrderQueue *queue, long long *publishedAt) {
+    size_t position = atomic_load_explicit(&queue->dequeuePosition, memory_order_relaxed);
+    while (1) {
+        OrderQueueCell *cell = &queue->cells[position & queue->mask];
+        const size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+        const long difference = (long) sequence - (long) (position + 1);
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&queue->dequeuePosition, &position, position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                Order *order = cell->order;
+                if (publishedAt != NULL) *publishedAt = cell->publishedAt;
+                atomic_store_explicit(&cell->sequence, position + queue->mask + 1, memory_order_release);
+                return order;
+            }
+        } else if (difference < 0) {
+            return NULL;
+        } else {
+            position = atomic_load_explicit(&queue->dequeuePosition, memory_order_relaxed);
+        }
+    }
+}
+
+// backoff yields while the queue is briefly full and sleeps once it stays that way
+void backoff(int *misses) {
+    if (++*misses < KITCHEN_IDLE_SPINS) {
+        sched_yield();
+        return;
+    }
+#ifdef _WIN32
+    Sleep(1);
+#else
+    const struct timespec pause = {0, 50000};
+    nanosleep(&pause, NULL);
+#endif
+}
+
+void *chefWorker(void *argument) {
+    ChefWorker *chef = argument;
+    KitchenPipeline *pipeline = chef->pipeline;
+    int misses = 0;
+    while (1) {
+        long long publishedAt;
+        Order *order = takeOrder(&pipeline->queue, &publishedAt);
+        if (order == NULL) {
+            // publishers are done before the kitchen closes, so a last pass drains everything
+            if (!atomic_load(&pipeline->open) && (order = takeOrder(&pipeline->queue, &publishedAt)) == NULL) break;
+            if (order == NULL && ++misses < KITCHEN_IDLE_SPINS) {
+                sched_yield();
+                continue;
+            }
+            // an idle chef parks until an order is published or the kitchen closes
+            if (order == NULL) {
+                const unsigned int ticket = bellTicket(&pipeline->queue.bell);
+                if ((order = takeOrder(&pipeline->queue, &publishedAt)) == NULL) {
+                    if (atomic_load(&pipeline->open)) waitBell(&pipeline->queue.bell, ticket);
+                    continue;
+                }
+            }
+        }
+        misses = 0;
+
+        if (chef->latencies != NULL && chef->cooked < chef->latencyCapacity) {
+            chef->latencies[chef->cooked] = nowNanos() - publishedAt;
+        }
+        // no other chef takes the order, but the status still changes under salesLock and the journal lock
+        // since cashiers and snapshots on other threads read the same lists
+        if (pipeline->scheduler != NULL) {
+            cookClaimedOrder(order);
+        } else if (order->orderStatus == WAITING) {
+            setOrderStatus(order, COMPLETED);
+            atomic_fetch_add(&pipeline->cooked, 1);
+        }
+        chef->cooked++;
+    }
+    return NULL;
+}
+
+bool startKitchen(KitchenPipeline *pipeline, size_t capacity, KitchenScheduler *scheduler, ChefWorker chefs[],
+                  int chefCount) {
+    if (!initOrderQueue(&pipeline->queue, capacity)) return false;
+    pipeline->scheduler = scheduler;
+    atomic_store(&pipeline->open, true);
+    atomic_store(&pipeline->cooked, 0);
+    for (int i = 0; i < chefCount; i++) {
+        chefs[i].pipeline = pipeline;
+        chefs[i].cooked = 0;
+        if (pthread_create(&chefs[i].thread, NULL, chefWorker, &chefs[i]) != 0) {
+            stopKitchen(pipeline, chefs, i);
+            return false;
+        }
+    }
+    return true;
+}
+
+// stopKitchen lets the chefs finish every published order and waits for them
+void stopKitchen(KitchenPipeline *pipeline, ChefWorker chefs[], int chefCount) {
+    atomic_store(&pipeline->open, false);
+    ringBell(&pipeline->queue.bell);
+    for (int i = 0; i < chefCount; i++) pthread_join(chefs[i].thread, NULL);
+    freeOrderQueue(&pipeline->queue);
+}
+
+// openKitchen starts the stations and the chefs of the process that owns the data. Waiting orders that were
+// loaded were placed before, so they are queued again, and any the queue has no room for are left for a chef
+// to cook by hand.
+bool openKitchen() {
+    if (!startScheduler(&kitchenScheduler, KITCHEN_STATIONS, true, NULL)) return false;
+    if (!startKitchen(&kitchen, KITCHEN_QUEUE_CAPACITY, &kitchenScheduler, kitchenChefs, KITCHEN_CHEFS)) {
+        stopScheduler(&kitchenScheduler);
+        return false;
+    }
+    pthread_mutex_lock(&salesLock);
+    for (Order *order = orders.statusHeads[WAITING]; order != NULL; order = order->statusNext) {
+        order->inKitchen = true;
+        if (publishOrder(&kitchen.queue, order)) continue;
+        order->inKitchen = false;
+        break;
+    }
+    pthread_mutex_unlock(&salesLock);
+    return true;
+}
+
+// closeKitchen lets the chefs fire every placed order and the stations cook every fired one
+void closeKitchen() {
+    if (atomic_load(&kitchen.open)) stopKitchen(&kitchen, kitchenChefs, KITCHEN_CHEFS);
+    if (atomic_load(&kitchenScheduler.open)) stopScheduler(&kitchenScheduler);
+}
+
+// placeOrder hands an order the cashier is done with to the chefs. It returns false if the kitchen is closed
+// or full, or the order isn't waiting, it then stays on the board for a chef to cook by hand.
+bool placeOrder(Order *order) {
+    if (!atomic_load(&kitchen.open) || !claimOrder(order)) return false;
+    if (publishOrder(&kitchen.queue, order)) return true;
+    unclaimOrder(order);
+    return false;
+}
+
+// fireOrder sends a claimed order to the stations, the station that cooks its last item completes it.
+// It returns false if the stations are closed or there is no memory for the ticket.
+bool fireOrder(Order *order) {
+    if (!atomic_load(&kitchenScheduler.open)) return false;
+    KitchenTicket *ticket = malloc(sizeof(KitchenTicket));
+    if (ticket == NULL) return false;
+    ticket->order = order;
+    dispatchOrder(&kitchenScheduler, ticket);
+    return true;
+}
+
+// cookClaimedOrder fires a claimed order at the stations, or completes it right away if it can't be fired
+void cookClaimedOrder(Order *order) {
+    if (fireOrder(order)) return;
+    if (order->orderStatus == WAITING) setOrderStatus(order, COMPLETED);
+}
+
+bool pushTask(StationQueue *queue, KitchenTask task) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->length == queue->capacity) {
+        const int capacity = queue->capacity == 0 ? 64 : queue->capacity * 2;
+        KitchenTask *tasks = realloc(queue->tasks, sizeof(KitchenTask) * capacity);
+        if (tasks == NULL) {
+            pthread_mutex_unlock(&queue->lock);
+            return false;
+        }
+        queue->tasks = tasks;
+        queue->capacity = capacity;
+    }
+
+    int child = queue->length++;
+    while (child > 0) {
+        const int parent = (child - 1) / 2;
+        if (queue->tasks[parent].priority <= task.priority) break;
+        queue->tasks[child] = queue->tasks[parent];
+        child = parent;
+    }
+    queue->tasks[child] = task;
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+// popTask takes the most urgent task, both for the station itself and for a station stealing from it
+bool popTask(StationQueue *queue, KitchenTask *task) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->length == 0) {
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+
+    *task = queue->tasks[0];
+    const KitchenTask last = queue->tasks[--queue->length];
+    int parent = 0;
+    while (1) {
+        int child = parent * 2 + 1;
+        if (child >= queue->length) break;
+        if (child + 1 < queue->length && queue->tasks[child + 1].priority < queue->tasks[child].priority) child++;
+        if (last.priority <= queue->tasks[child].priority) break;
+        queue->tasks[parent] = queue->tasks[child];
+        parent = child;
+    }
+    queue->tasks[parent] = last;
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+// takeTask pops the most urgent task of the station's own queue, or steals one from the others
+bool takeTask(Station *station, KitchenTask *task) {
+    KitchenScheduler *scheduler = station->scheduler;
+    if (popTask(&scheduler->queues[station->index], task)) return true;
+    for (int i = 1; scheduler->stealing && i < scheduler->stationCount; i++) {
+        if (popTask(&scheduler->queues[(station->index + i) % scheduler->stationCount], task)) {
+            station->stolen++;
+            return true;
+        }
+    }
+    return false;
+}
+
+int stationForStock(const KitchenScheduler *scheduler, int stockId) {
+    return (int) (hashId(stockId) % (unsigned int) scheduler->stationCount);
+}
+
+// dispatchOrder queues one task per item at the station of its stock. Orders are prioritised
+// by dispatch order, so the oldest waiting order is cooked first everywhere.
+bool dispatchOrder(KitchenScheduler *scheduler, KitchenTicket *ticket) {
+    const long long priority = atomic_fetch_add(&scheduler->nextPriority, 1);
+    ticket->dispatchedAt = nowNanos();
+    ticket->completedAt = 0;
+
+    const int items = ticket->order->itemCount;
+    // one extra count keeps the ticket open until every task is queued
+    atomic_store(&ticket->remaining, items + 1);
+    atomic_fetch_add(&scheduler->pending, items + 1);
+
+    bool ok = true;
+    for (Item *item = ticket->order->items; item < ticket->order->items + items; item++) {
+        KitchenTask task = {ticket, item, priority, ticket->dispatchedAt};
+        if (!pushTask(&scheduler->queues[stationForStock(scheduler, item->stockId)], task)) {
+            finishTask(scheduler, &task);
+            ok = false;
+        }
+    }
+    ringBell(&scheduler->bell);
+    KitchenTask dispatched = {ticket, NULL, priority, ticket->dispatchedAt};
+    finishTask(scheduler, &dispatched);
+    return ok;
+}
+
+void finishTask(KitchenScheduler *scheduler, const KitchenTask *task) {
+    KitchenTicket *ticket = task->ticket;
+    if (atomic_fetch_sub(&ticket->remaining, 1) == 1) {
+        ticket->completedAt = nowNanos();
+        if (ticket->order->orderStatus == WAITING) setOrderStatus(ticket->order, COMPLETED);
+        if (scheduler->ownsTickets) {
+            atomic_fetch_add(&scheduler->completed, 1);
+            free(ticket);
+        }
+    }
+    atomic_fetch_sub(&scheduler->pending, 1);
+}
+
+void *stationWorker(void *argument) {
+    Station *station = argument;
+    KitchenScheduler *scheduler = station->scheduler;
+    int misses = 0;
+    while (1) {
+        KitchenTask task;
+        bool found = takeTask(station, &task);
+        if (!found) {
+            if (!atomic_load(&scheduler->open) && atomic_load(&scheduler->pending) == 0) break;
+            if (++misses < KITCHEN_IDLE_SPINS) {
+                sched_yield();
+                continue;
+            }
+            // an idle station parks until an order is dispatched. Once the stations close it only waits
+            // for the others to finish their last tasks, and nothing rings then.
+            const unsigned int ticket = bellTicket(&scheduler->bell);
+            found = takeTask(station, &task);
+            if (!found) {
+                if (atomic_load(&scheduler->open)) waitBell(&scheduler->bell, ticket);
+                else backoff(&misses);
+                continue;
+            }
+        }
+        misses = 0;
+
+        const long long startedAt = nowNanos();
+        if (station->waits != NULL && station->cooked < station->waitCapacity) {
+            station->waits[station->cooked] = startedAt - task.dispatchedAt;
+        }
+        if (scheduler->cook != NULL) scheduler->cook(&task);
+        station->cooked++;
+        finishTask(scheduler, &task);
+    }
+    return NULL;
+}
+
+bool startScheduler(KitchenScheduler *scheduler, int stationCount, bool stealing, void (*cook)(const KitchenTask *)) {
+    scheduler->stationCount = stationCount;
+    scheduler->stealing = stealing;
+    scheduler->cook = cook;
+    atomic_store(&scheduler->open, true);
+    atomic_store(&scheduler->pending, 0);
+    atomic_store(&scheduler->nextPriority, 0);
+    atomic_store(&scheduler->completed, 0);
+    scheduler->queues = calloc(stationCount, sizeof(StationQueue));
+    if (scheduler->queues == NULL) return false;
+    initBell(&scheduler->bell);
+    for (int i = 0; i < stationCount; i++) pthread_mutex_init(&scheduler->queues[i].lock, NULL);
+
+    // the caller may have set up the stations to record waits, otherwise they are created here
+    if (scheduler->stations == NULL) scheduler->stations = calloc(stationCount, sizeof(Station));
+    if (scheduler->stations == NULL) return false;
+    for (int i = 0; i < stationCount; i++) {
+        Station *station = &scheduler->stations[i];
+        station->scheduler = scheduler;
+        station->index = i;
+        station->cooked = 0;
+        station->stolen = 0;
+        if (pthread_create(&station->thread, NULL, stationWorker, station) != 0) {
+            scheduler->stationCount = i;
+            stopScheduler(scheduler);
+            return false;
+        }
+    }
+    return true;
+}
+
+// stopScheduler waits until every dispatched task is cooked and the stations have left
+void stopScheduler(KitchenScheduler *scheduler) {
+    atomic_store(&scheduler->open, false);
+    ringBell(&scheduler->bell);
+    for (int i = 0; i < scheduler->stationCount; i++) pthread_join(scheduler->stations[i].thread, NULL);
+    freeBell(&scheduler->bell);
+    for (int i = 0; i < scheduler->stationCount; i++) {
+        pthread_mutex_destroy(&scheduler->queues[i].lock);
+        free(scheduler->queues[i].tasks);
+    }
+    free(scheduler->queues);
+    scheduler->queues = NULL;
+}
@@ -0,0 +1,181 @@
+#ifndef KITCHEN_H
+#define KITCHEN_H
+
+#include "restaurant.h"
+
+// the terminal or server that owns the data runs this many chefs, firing the orders cashiers place
+// at this many stations
+#define KITCHEN_CHEFS 2
+#define KITCHEN_STATIONS 4
+// placed orders past this many wait on the board for a chef to cook them by hand
+#define KITCHEN_QUEUE_CAPACITY 1024
+// an idle chef or station yields this many times before it parks until work arrives
+#define KITCHEN_IDLE_SPINS 64
+
+// KitchenBell wakes the workers that parked on an empty queue. A worker takes a ticket before its last look
+// at the queue and sleeps only while nothing rang after it, so work handed over in between isn't missed.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t rung;
+    _Atomic unsigned int rings;
+    _Atomic int sleepers;
+} KitchenBell;
+
+// OrderQueueCell is a slot of the order queue, its sequence tells producers and consumers whose turn it is
+typedef struct {
+    _Atomic size_t sequence;
+    Order *order;
+    long long publishedAt;
+} OrderQueueCell;
+
+// OrderQueue is a bounded lock-free multi-producer multi-consumer ring buffer
+// that hands orders from cashiers to the kitchen
+typedef struct {
+    OrderQueueCell *cells;
+    size_t mask;
+    _Alignas(64) _Atomic size_t enqueuePosition;
+    _Alignas(64) _Atomic size_t dequeuePosition;
+    _Alignas(64) KitchenBell bell;
+} OrderQueue;
+
+typedef struct KitchenScheduler KitchenScheduler;
+
+// KitchenPipeline is the order queue with the chef workers cooking from it. With a scheduler the chefs
+// fire the orders they take at its stations, otherwise they complete them and count them in cooked.
+typedef struct {
+    OrderQueue queue;
+    KitchenScheduler *scheduler;
+    _Atomic bool open;
+    _Atomic long long cooked;
+} KitchenPipeline;
+
+// ChefWorker is one chef thread, it optionally records the handoff latency of every order it takes
+typedef struct {
+    KitchenPipeline *pipeline;
+    pthread_t thread;
+    long long cooked;
+    long long *latencies;
+    long long latencyCapacity;
+} ChefWorker;
+
+// KitchenTicket tracks an order while its items are cooked, the last station to finish completes it
+typedef struct {
+    Order *order;
+    _Atomic int remaining;
+    long long dispatchedAt;
+    long long completedAt;
+} KitchenTicket;
+
+// KitchenTask is one item of an order cooked at one station, a lower priority is cooked sooner.
+// item points into the order's item array, so no items are added to an order while it is in the kitchen.
+typedef struct {
+    KitchenTicket *ticket;
+    Item *item;
+    long long priority;
+    long long dispatchedAt;
+} KitchenTask;
+
+// StationQueue is the run queue of one station, a binary heap ordered by priority
+typedef struct {
+    pthread_mutex_t lock;
+    KitchenTask *tasks;
+    int length;
+    int capacity;
+} StationQueue;
+
+// Station is one chef working a station, it records how long each task it cooked waited
+typedef struct {
+    KitchenScheduler *scheduler;
+    int index;
+    pthread_t thread;
+    long long cooked;
+    long long stolen;
+    long long *waits;
+    long long waitCapacity;
+} Station;
+
+// KitchenScheduler splits orders into per-station tasks. Every station has its own queue,
+// an idle station steals the most urgent task of the others when stealing is on.
+// With ownsTickets the tickets were allocated by fireOrder and are freed once their order is complete,
+// completed counts those orders.
+struct KitchenScheduler {
+    Station *stations;
+    StationQueue *queues;
+    int stationCount;
+    bool stealing;
+    void (*cook)(const KitchenTask *task);
+    bool ownsTickets;
+    _Atomic bool open;
+    _Atomic long long pending;
+    _Atomic long long nextPriority;
+    _Atomic long long completed;
+    KitchenBell bell;
+};
+
+// kitchen is where placed orders go, it is open while this process owns the data.
+// Its chefs and the chefs cooking by hand fire orders at the stations of kitchenScheduler.
+extern KitchenPipeline kitchen;
+
+extern ChefWorker kitchenChefs[KITCHEN_CHEFS];
+
+extern KitchenScheduler kitchenScheduler;
+
+// functions for the bell idle workers park on
+void initBell(KitchenBell *bell);
+
+void freeBell(KitchenBell *bell);
+
+unsigned int bellTicket(KitchenBell *bell);
+
+void ringBell(KitchenBell *bell);
+
+void waitBell(KitchenBell *bell, unsigned int ticket);
+
+// functions for the kitchen pipeline, orders are published by cashiers and taken by chefs
+bool initOrderQueue(OrderQueue *queue, size_t capacity);
+
+void freeOrderQueue(OrderQueue *queue);
+
+bool publishOrder(OrderQueue *queue, Order *order);
+
+Order *takeOrder(OrderQueue *queue, long long *publishedAt);
+
+void backoff(int *misses);
+
+void *chefWorker(void *argument);
+
+bool startKitchen(KitchenPipeline *pipeline, size_t capacity, KitchenScheduler *scheduler, ChefWorker chefs[],
+                  int chefCount);
+
+void stopKitchen(KitchenPipeline *pipeline, ChefWorker chefs[], int chefCount);
+
+bool openKitchen();
+
+void closeKitchen();
+
+bool placeOrder(Order *order);
+
+bool fireOrder(Order *order);
+
+void cookClaimedOrder(Order *order);
+
+// functions for the kitchen scheduler
+bool pushTask(StationQueue *queue, KitchenTask task);
+
+bool popTask(StationQueue *queue, KitchenTask *task);
+
+bool takeTask(Station *station, KitchenTask *task);
+
+int stationForStock(const KitchenScheduler *scheduler, int stockId);
+
+bool dispatchOrder(KitchenScheduler *scheduler, KitchenTicket *ticket);
+
+void finishTask(KitchenScheduler *scheduler, const KitchenTask *task);
+
+void *stationWorker(void *argument);
+
+bool startScheduler(KitchenScheduler *scheduler, int stationCount, bool stealing, void (*cook)(const KitchenTask *));
+
+void stopScheduler(KitchenScheduler *scheduler);
+
+#endif
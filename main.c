@@ -1,26 +1,48 @@
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
-#include <math.h>
-#include <time.h>
 
 #ifdef _WIN32
 #include <windows.h>
 #include <conio.h>
 #else
+#include <unistd.h>
 #include <ncurses.h>
-#define printf printw
 #endif
 
+#include "archive.h"
+#include "catalog.h"
+#include "client.h"
+#include "events.h"
+#include "export.h"
+#include "kitchen.h"
+#include "metrics.h"
+#include "restaurant.h"
+#include "screen.h"
+#include "script.h"
+#include "server.h"
+#include "shared.h"
+#include "storage.h"
+
 #define KEY_ARROW_PREFIX 224
 #define KEY_ARROW_UP 72
 #define KEY_ARROW_DOWN 80
 #define KEY_ARROW_LEFT 75
 #define KEY_ARROW_RIGHT 77
+#define KEY_ARROW_HOME 71
+#define KEY_ARROW_END 79
+#define KEY_ARROW_PAGE_UP 73
+#define KEY_ARROW_PAGE_DOWN 81
 #define KEY_ESC 27
 #define KEY_W 119
 #define KEY_S 115
+#define KEY_FILTER 102
+#define KEY_GOTO 103
+#define KEY_DUMP 100
+#define KEY_TOGGLE 101
+#define KEY_ZERO 122
 
 #ifndef KEY_ENTER
 #define KEY_ENTER 13
@@ -35,157 +57,48 @@
 #define ANSI_RED "\033[31m"
 #define ANSI_RESET "\033[0m"
 
-typedef enum { PAYPAL, CREDIT_CARD, DEBIT_CARD, CASH } PaymentType;
-
-typedef enum { WAITING, CANCELLED, COMPLETED } OrderStatus;
-
-typedef enum { CHEF, CASHIER, ADMIN } UserType;
-
-typedef struct Order Order;
-typedef struct Item Item;
-typedef struct Stock Stock;
-typedef struct User User;
-
-// Order is a struct that contains the information of an order
-struct Order {
-    int id;
-    int cashierId;
-    PaymentType paymentType;
-    OrderStatus orderStatus;
-    Item *items;
-
-    Order *next;
-    Order *prev;
-};
-
-struct Item {
-    int id;
-    int stockId;
-    int quantity;
-
-    Item *next;
-    Item *prev;
-};
+// lines the order board needs around its rows for the title, the column headers and the key help
+#define BOARD_CHROME_LINES 7
 
-struct Stock {
-    int id;
-    char name[101];
-    int price;
-    int quantity;
-
-    Stock *next;
-    Stock *prev;
-};
-
-struct User {
-    int id;
-    char name[101];
-    char hashedPassword[201];
-    UserType type;
-
-    User *next;
-    User *prev;
-};
-
-struct Buyer {
-    int id;
-
-};
+// the order entry screen lists at most this many stocks matching the search
+#define ENTRY_MAX_MATCHES 64
 
+// OrderEntry is the state of the order entry screen, the order is only created once its first item is added.
+// It keeps the order id since a refreshed replica has new order nodes.
 typedef struct {
-    Order *head;
-    Order *tail;
-    int length;
-} OrderList;
-
-typedef struct {
-    Stock *head;
-    Stock *tail;
-    int length;
-} StockList;
+    PaymentType paymentType;
+    int orderId;
+    char search[101];
+    int searchLength;
+    int selected;
+    char *message;
+} OrderEntry;
 
+// BoardView is an order board on screen, with the title above it and what enter does below it
 typedef struct {
-    User *head;
-    User *tail;
-    int length;
-} UserList;
-
-OrderList orders = {NULL, NULL, 0};
-StockList stocks = {NULL, NULL, 0};
-UserList users = {NULL, NULL, 0};
-
-User *loggedUser = NULL;
-
-Item *createItem(int stockId, int quantity);
-
-// linked list functions for orders
-Order *createOrder(int cashierId, PaymentType paymentType);
-
-Order *findOrder(int id);
-
-void addOrder(Order *order);
-
-void removeOrder(int id);
-
-Item *findItemFromOrder(int stockId);
-
-void addItemToOrder(Order *order, int stockId, int quantity);
-
-void modifyItemOnOrder(Order *order, int stockId, int quantity);
-
-char *getItemNames(Item *head);
-
-char *getPaymentName(PaymentType paymentType);
-
-char *getOrderStatusName(OrderStatus orderStatus);
-
-// linked list functions for stocks
-Stock *createStock(char name[], int price, int quantity);
-
-Stock *findStock(int id);
-
-void addStock(Stock *stock);
-
-void removeStock(Stock *stock);
+    OrderBoard board;
+    const char *title;
+    const char *enterAction;
+} BoardView;
 
-void incrementQuantity(int id, int amount);
+// everything the ui prints is drawn into the screen buffer, and only the changed cells reach the terminal
+#define printf uiPrintf
 
-void decrementQuantity(int id, int amount);
+// uiLoop waits for keystrokes and runs the screen refresh timers
+EventLoop uiLoop;
 
-// linked list functions for users
-User *createUser(char name[], char hashedPassword[], UserType type);
+Screen screen;
 
-User *findUser(int id);
+// remote is set when the terminal is a client of a server, its lists are then a replica that only the server changes
+bool remote = false;
 
-User *findUserByName(const char *name);
-
-void addUser(User *user);
-
-void removeUser(User *user);
-
-void changePassword(User *user, char hashedPassword[]);
-
-// functions for user management
-void registerUser(char name[], char password[], UserType type);
-
-void hashPassword(char password[], char hashedPassword[]);
-
-bool verifyPassword(User *user, char password[]);
-
-// functions for file management
-void readOrdersFromFile();
-
-void readStocksFromFile();
-
-void readUsersFromFile();
-
-void writeOrdersToFile();
+void clearTerminal();
 
-void writeStocksToFile();
+int uiPrintf(const char *format, ...);
 
-void writeUsersToFile();
+void resizeScreen();
 
-void clearTerminal();
+void presentScreen();
 
 int mainMenu();
 
@@ -197,6 +110,8 @@ int adminMainMenu();
 
 void setCursor(int x, int y);
 
+int readKey();
+
 int menuArrowSelector(int total_option, int *selected);
 
 void printOption(const char *option);
@@ -215,15 +130,113 @@ int creditsView();
 
 int viewOrders();
 
-void printOrders();
+void drawBoard(void *context);
+
+Order *runBoard(BoardView *view);
+
+bool readNumber(int *value);
 
 int cookOrder();
 
-bool isLogged();
+int newOrderView();
+
+void drawOrderEntry(const OrderEntry *entry, Stock *matches[], int count, int rows);
+
+int salesView();
+
+void drawSales(void *context);
+
+int checkSalesView();
+
+int metricsView();
+
+void drawMetrics(void *context);
 
 void printc(char *text, char *color);
 
-int main() {
+void syncTick(void *context);
+
+void shareTick(void *context);
+
+int main(int argc, char *argv[]) {
+    if (argc > 2 && strcmp(argv[1], "--script") == 0) {
+        return runScript(argv[2]);
+    }
+    if (argc > 1 && strcmp(argv[1], "--server") == 0) {
+        return runServer(argc > 2 ? argv[2] : SERVER_SOCKET_PATH);
+    }
+    // --export streams the checkpoint and the archive out for analysis without loading them
+    if (argc > 2 && strcmp(argv[1], "--export") == 0) {
+        ExportFormat format = EXPORT_COLUMNS;
+        if (argc > 3 && !parseExportFormat(argv[3], &format)) {
+            fprintf(stderr, "unknown export format %s, expected columns or csv\n", argv[3]);
+            return 1;
+        }
+        const long long rows = exportFiles(argv[2], format);
+        if (rows < 0) {
+            fprintf(stderr, "failed to export to %s\n", argv[2]);
+            return 1;
+        }
+        fprintf(stdout, "%lld rows exported to %s\n", rows, argv[2]);
+        return 0;
+    }
+
+    // --import merges a supplier catalog into the stocks and writes a checkpoint, parsing on threads threads
+    if (argc > 2 && strcmp(argv[1], "--import") == 0) {
+        CatalogMode mode = CATALOG_INSERT;
+        if (argc > 3 && !parseCatalogMode(argv[3], &mode)) {
+            fprintf(stderr, "unknown import mode %s, expected insert or upsert\n", argv[3]);
+            return 1;
+        }
+        if (!loadData()) return 1;
+        CatalogResult result;
+        const bool ok = importCatalog(argv[2], mode, argc > 4 ? atoi(argv[4]) : 0, &result);
+        reportCatalogErrors(stderr, argv[2], &result);
+        if (ok) {
+            saveData();
+            fprintf(stdout, "%lld lines from %s, %lld stocks added and %lld updated in %.1f ms on %d threads\n",
+                    result.rows, argv[2], result.added, result.updated, (result.parseNanos + result.mergeNanos) / 1e6,
+                    result.threads);
+        }
+        closeJournal();
+        return ok ? 0 : 1;
+    }
+
+    // with a server running the terminal is its client, otherwise it keeps the data itself
+    const char *socketPath = argc > 2 && strcmp(argv[1], "--connect") == 0 ? argv[2] : SERVER_SOCKET_PATH;
+    const bool sharing = argc > 1 && strcmp(argv[1], "--shared") == 0;
+    remote = !sharing && connectServer(&connection, socketPath);
+    if (remote) {
+        idsFilePath = NULL;
+        if (!syncReplica(&connection)) {
+            fprintf(stderr, "cannot read the data from %s\n", socketPath);
+            return 1;
+        }
+    } else {
+        if (!loadData()) return 1;
+        atexit(saveData);
+    }
+    // with --shared the terminal keeps its own orders but takes the stock units from a table other terminals share.
+    // The table is closed after the chefs stop and before the checkpoint, which then has the units left in it.
+    if (sharing) {
+        if (argc > 2) sharedStocksPath = argv[2];
+        if (!openSharedStocks(&sharedStocks, sharedStocksPath, stocks.length)) {
+            fprintf(stderr, "cannot open the shared stock table %s\n", sharedStocksPath);
+            return 1;
+        }
+        atexit(stopSharingStocks);
+        attachSharedStocks(&sharedStocks);
+        if (sharedStocks.overflows > 0) {
+            fprintf(stderr, "the shared stock table %s is full, %d stocks stay with this terminal\n", sharedStocksPath,
+                    sharedStocks.overflows);
+        }
+    }
+    if (!remote) {
+        // exit handlers run last first, so the archive is written out before the checkpoint
+        if (startArchiver(ARCHIVE_MIN_AGE_SECONDS * 1000000000LL)) atexit(stopArchiver);
+        if (openKitchen()) atexit(closeKitchen);
+    }
+
 #ifndef _WIN32
     initscr();
     cbreak();
@@ -234,41 +247,121 @@ int main() {
         start_color();
         use_default_colors();
     }
+    // ncurses only reads the keyboard, this lets it do its initial clear before the first frame is drawn
+    refresh();
 #else
     SetConsoleOutputCP(CP_UTF8);
+    const HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    if (GetConsoleMode(hOut, &mode)) SetConsoleMode(hOut, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
 #endif
+    resizeScreen();
 
-    srand(time(NULL));
-    int state = 0;
-    while (1) {
-        while (mainMenu());
-    }
+#ifdef _WIN32
+    initEventLoop(&uiLoop, 0);
+#else
+    initEventLoop(&uiLoop, STDIN_FILENO);
+#endif
+    if (remote) addTimer(&uiLoop, 1000, syncTick, NULL);
+    else addTimer(&uiLoop, ARCHIVE_INTERVAL_MILLIS, archiveTick, NULL);
+    if (sharedStocks.header != NULL) addTimer(&uiLoop, 1000, shareTick, NULL);
+    while (mainMenu());
+#ifndef _WIN32
+    endwin();
+#endif
+    freeScreen(&screen);
     return 0;
 }
 
+// clearTerminal only blanks the screen buffer, the terminal is updated when the next frame is presented
 void clearTerminal() {
-#ifdef _WIN32
-    system("cls");
-    setCursor(0, 0);
-#else
-        system("clear");
-#endif
+    screenClear(&screen);
 }
 
 void setCursor(int x, int y) {
+    screenMove(&screen, x, y);
+}
+
+int uiPrintf(const char *format, ...) {
+    char text[1024];
+    va_list arguments;
+    va_start(arguments, format);
+    const int length = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    screenWrite(&screen, text);
+    return length;
+}
+
+// resizeScreen sizes the screen buffer to the terminal, the next frame is repainted in full
+void resizeScreen() {
 #ifdef _WIN32
-    const HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    const COORD coord = {x, y};
-    SetConsoleCursorPosition(hOut, coord);
+    CONSOLE_SCREEN_BUFFER_INFO info;
+    int width = 80, height = 24;
+    if (GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info)) {
+        width = info.srWindow.Right - info.srWindow.Left + 1;
+        height = info.srWindow.Bottom - info.srWindow.Top + 1;
+    }
 #else
-        move(y, x);
+    const int width = getmaxx(stdscr), height = getmaxy(stdscr);
 #endif
+    Screen resized = {0};
+    if (!initScreen(&resized, width, height)) return;
+    if (screen.back != NULL) {
+        // keep what was drawn so far, the menus don't redraw everything on every key
+        for (int y = 0; y < resized.height && y < screen.height; y++) {
+            for (int x = 0; x < resized.width && x < screen.width; x++) {
+                resized.back[y * resized.width + x] = screen.back[y * screen.width + x];
+            }
+        }
+        resized.cursorX = screen.cursorX;
+        resized.cursorY = screen.cursorY;
+    }
+    freeScreen(&screen);
+    screen = resized;
+}
+
+// presentScreen sends the cells that changed since the last frame to the terminal
+void presentScreen() {
+    const long long started = metricStart();
+    screenFlush(&screen, stdout);
+    metricEnd(METRIC_PRESENT, started);
 }
 
 void printc(char *text, char *color) {
     printf("%s%s%s", color, text, ANSI_RESET);
 }
 
+// syncTick refreshes the replica from the server, the screens redrawn by their own timers then show the changes
+void syncTick(void *context) {
+    (void) context;
+    syncReplica(&connection);
+}
+
+// shareTick adds the stocks other terminals put on the shared table since the last tick
+void shareTick(void *context) {
+    (void) context;
+    adoptSharedStocks(&sharedStocks);
+}
+
+// readKey blocks until a key is pressed instead of spinning on getch, running the screen timers meanwhile
+int readKey() {
+    while (1) {
+        presentScreen();
+#ifdef _WIN32
+        if (_kbhit()) return getch();
+#else
+        // getch doesn't wait since the screen is in nodelay mode, and may hand out keys it already buffered
+        const int key = getch();
+        if (key == KEY_RESIZE) {
+            resizeScreen();
+            continue;
+        }
+        if (key != ERR) return key == '\n' || key == '\r' ? KEY_ENTER : key;
+#endif
+        waitForInput(&uiLoop, -1);
+    }
+}
+
 int menuArrowSelector(int total_option, int *selected) {
     for (int i = 0; i < total_option; i++) {
         setCursor(1, i + 2);
@@ -284,9 +377,17 @@ int menuArrowSelector(int total_option, int *selected) {
 
     setCursor(0, 0);
 
-    const int key = getch();
+    const int key = readKey();
+#ifndef _WIN32
+    if (key == KEY_UP) {
+        *selected = (*selected - 1 + total_option) % total_option;
+    }
+    if (key == KEY_DOWN) {
+        *selected = (*selected + 1) % total_option;
+    }
+#endif
     if (key == KEY_ARROW_PREFIX) {
-        const int key2 = getch();
+        const int key2 = readKey();
         switch (key2) {
             case KEY_ARROW_UP:
                 *selected = (*selected - 1 + total_option) % total_option;
@@ -316,6 +417,7 @@ void beginPrintOption() {
 
 void pressEnterToContinue() {
     printf("\nPress enter to continue...");
+    presentScreen();
     while (getchar() != '\n');
 }
 
@@ -347,9 +449,6 @@ int mainMenu() {
     int selected = 0;
     while (1) {
         const int key = menuArrowSelector(totalOption, &selected);
-#ifndef _WIN32
-        refresh();
-#endif
 
         if (key == KEY_ESC) {
             exit(0);
@@ -390,25 +489,38 @@ int loginView() {
 
     setCursor(10, 2);
     char username[105];
+    presentScreen();
     scanf("%100s", username);
     getchar();
 
     setCursor(10, 3);
     char password[105];
+    presentScreen();
     scanf("%100s", password);
     getchar();
 
-    for (User *user = users.head; user != NULL; user = user->next) {
-        if (strcmp(user->name, username) == 0) {
-            if (verifyPassword(user, password)) {
-                clearTerminal();
-                printc("Login successful!\n", ANSI_GREEN);
-                loggedUser = user;
-                pressEnterToContinue();
-                return 0;
-            } else {
-                printc("INVALID PWD\n", ANSI_RED);
-            }
+    if (remote) {
+        clearTerminal();
+        if (remoteLogin(&connection, username, password)) {
+            printc("Login successful!\n", ANSI_GREEN);
+            pressEnterToContinue();
+            return 0;
+        }
+        printc("Invalid username or password!\n", ANSI_RED);
+        pressEnterToContinue();
+        return 1;
+    }
+
+    User *user = findUserByName(username);
+    if (user != NULL) {
+        if (verifyPassword(user, password)) {
+            clearTerminal();
+            printc("Login successful!\n", ANSI_GREEN);
+            loggedUser = user;
+            pressEnterToContinue();
+            return 0;
+        } else {
+            printc("INVALID PWD\n", ANSI_RED);
         }
     }
 
@@ -428,17 +540,18 @@ int registerView() {
 
     while (1) {
         printc("Enter a username: ", ANSI_BLUE);
+        presentScreen();
         scanf("%100s", temp);
         getchar();
         if (findUserByName(temp) != NULL) {
             printc("Username already exists!\n", ANSI_RED);
             continue;
         }
-        if (strlen(temp) <= 3) {
+        if (strlen(temp) < USER_NAME_MIN) {
             printc("Username must be at least 4 characters long!\n", ANSI_RED);
             continue;
         }
-        if (strlen(temp) > 20) {
+        if (strlen(temp) > USER_NAME_MAX) {
             printc("Username must be at most 20 characters long!\n", ANSI_RED);
             continue;
         }
@@ -449,13 +562,14 @@ int registerView() {
 
     printc("Enter a password: ", ANSI_BLUE);
     while (1) {
+        presentScreen();
         scanf("%100s", temp);
         getchar();
-        if (strlen(temp) <= 5) {
+        if (strlen(temp) < USER_PASSWORD_MIN) {
             printc("Password must be at least 6 characters long!\n", ANSI_RED);
             continue;
         }
-        if (strlen(temp) > 50) {
+        if (strlen(temp) > USER_PASSWORD_MAX) {
             printc("Password must be at most 50 characters long!\n", ANSI_RED);
             continue;
         }
@@ -477,16 +591,19 @@ int registerView() {
 
     while (1) {
         const int key = menuArrowSelector(totalOption, &selected);
-#ifndef _WIN32
-        refresh();
-#endif
 
         if (key == KEY_ESC) {
             return 1;
         }
 
         if (key == KEY_ENTER) {
-            registerUser(username, password, selected);
+            if (remote && !remoteRegister(&connection, username, password, selected)) {
+                clearTerminal();
+                printc("The server did not register the user!\n", ANSI_RED);
+                pressEnterToContinue();
+                return 0;
+            }
+            if (!remote) registerUser(username, password, selected);
             clearTerminal();
             printc("User registered successfully, you can now login!\n", ANSI_GREEN);
             pressEnterToContinue();
@@ -508,9 +625,6 @@ int chefMainMenu() {
 
     while (1) {
         const int key = menuArrowSelector(totalOption, &selected);
-#ifndef _WIN32
-        refresh();
-#endif
 
         if (key == KEY_ESC) {
             exit(0);
@@ -531,43 +645,151 @@ int chefMainMenu() {
     return 1;
 }
 
+// cookOrder lets the chef pick a waiting order off the board and fires it at the kitchen's stations
 int cookOrder() {
-    printf("Cook Order\n");
-    printOrders();
-    printc("Enter order ID to cook: ", ANSI_BLUE);
-    int orderId;
-    scanf("%d", &orderId);
-    getchar();
+    BoardView view = {.title = "Cook Order", .enterAction = "cook"};
+    initOrderBoard(&view.board, screen.height - BOARD_CHROME_LINES, WAITING);
+    Order *order = runBoard(&view);
+    if (order == NULL) return 0;
 
-    Order *order = findOrder(orderId);
-    if (order == NULL) {
-        printc("Order not found!\n", ANSI_RED);
+    clearTerminal();
+    // the replica may be behind, the server checks again. An order the kitchen's chefs have can't be cooked by hand.
+    if (remote ? order->orderStatus != WAITING || !remoteCook(&connection, order->id) : !claimOrder(order)) {
+        printc("Order is not waiting!\n", ANSI_RED);
         pressEnterToContinue();
         return 1;
     }
 
-    clearTerminal();
-    return 1;
+    // the stations cook its items, the last one to finish completes it
+    if (!remote) cookClaimedOrder(order);
+    printc("Order sent to the kitchen!\n", ANSI_GREEN);
+    pressEnterToContinue();
+    return 0;
 }
 
-void printOrders() {
+// drawBoard draws the visible window of the order board, so a redraw costs the screen height and not the order count
+void drawBoard(void *context) {
+    const long long started = metricStart();
+    BoardView *view = context;
+    OrderBoard *board = &view->board;
+    board->rows = screen.height > BOARD_CHROME_LINES ? screen.height - BOARD_CHROME_LINES : 1;
+    Order **visible = malloc(sizeof(Order *) * board->rows);
+    if (visible == NULL) {
+        metricEnd(METRIC_DRAW_BOARD, started);
+        return;
+    }
+    // the kitchen's chefs move orders between the status lists the board walks
+    pthread_mutex_lock(&salesLock);
+    const int count = boardVisible(board, visible);
+    const Order *selected = boardSelected(board);
+
+    clearTerminal();
+    printf("%s\n\n", view->title);
     printf("| %-5s | %-10s | %-10s | %-10s | %-25s |\n", "ID", "Cashier", "Payment", "Status", "Items");
     printf("| %-5s | %-10s | %-10s | %-10s | %-25s |\n", "-----", "----------", "----------", "----------",
            "----------");
-    for (Order *order = orders.head; order != NULL; order = order->next) {
-        printf("| %-5d | %-10s | %-10s | %-10d | %-25s |\n", order->id, findUser(order->cashierId)->name,
-               getPaymentName(order->paymentType), order->orderStatus, getItemNames(order->items));
+    char row[256];
+    for (int i = 0; i < count; i++) {
+        formatOrderRow(visible[i], row, sizeof(row));
+        if (visible[i] == selected) {
+            printc(row, ANSI_GREEN);
+            printf("\n");
+        } else {
+            printf("%s\n", row);
+        }
     }
+    pthread_mutex_unlock(&salesLock);
+    if (count == 0) printf("| %-73s |\n", "No orders");
+
+    setCursor(0, screen.height - 3);
     printf("| %-5s | %-10s | %-10s | %-10s | %-25s |\n", "-----", "----------", "----------", "----------",
            "----------");
+    printf("%d orders, showing: %s\n", orders.length,
+           board->statusFilter == BOARD_ALL_STATUSES ? "All" : getOrderStatusName(board->statusFilter));
+    printf("Up/Down PgUp/PgDn Home/End: move, F: filter, G: go to id, Enter: %s, Esc: back",
+           view->enterAction != NULL ? view->enterAction : "back");
+    free(visible);
+    metricEnd(METRIC_DRAW_BOARD, started);
 }
 
-int viewOrders() {
-    clearTerminal();
+// runBoard shows the order board, redrawn every second, until an order is picked with enter or the board is left.
+// It returns the picked order, or NULL when the board has no enter action or was left with escape.
+Order *runBoard(BoardView *view) {
+    OrderBoard *board = &view->board;
+    drawBoard(view);
+    const int timer = addTimer(&uiLoop, 1000, drawBoard, view);
+    Order *picked = NULL;
+    while (1) {
+        int key = readKey();
+#ifdef _WIN32
+        if (key == KEY_ARROW_PREFIX) key = readKey() + KEY_ARROW_PREFIX;
+        const int up = KEY_ARROW_PREFIX + KEY_ARROW_UP, down = KEY_ARROW_PREFIX + KEY_ARROW_DOWN;
+        const int pageUp = KEY_ARROW_PREFIX + KEY_ARROW_PAGE_UP, pageDown = KEY_ARROW_PREFIX + KEY_ARROW_PAGE_DOWN;
+        const int home = KEY_ARROW_PREFIX + KEY_ARROW_HOME, end = KEY_ARROW_PREFIX + KEY_ARROW_END;
+#else
+        const int up = KEY_UP, down = KEY_DOWN, pageUp = KEY_PPAGE, pageDown = KEY_NPAGE;
+        const int home = KEY_HOME, end = KEY_END;
+#endif
+        if (key == KEY_ESC) break;
+        pthread_mutex_lock(&salesLock);
+        if (key == KEY_ENTER && view->enterAction != NULL) picked = boardSelected(board);
+        if (key == up || key == KEY_W) boardMove(board, -1);
+        if (key == down || key == KEY_S) boardMove(board, 1);
+        if (key == pageUp) boardMove(board, -board->rows);
+        if (key == pageDown) boardMove(board, board->rows);
+        if (key == home) boardHome(board);
+        if (key == end) boardEnd(board);
+        if (key == KEY_FILTER) {
+            boardSetFilter(board, board->statusFilter == COMPLETED ? BOARD_ALL_STATUSES : board->statusFilter + 1);
+        }
+        pthread_mutex_unlock(&salesLock);
+        if (key == KEY_ENTER && (picked != NULL || view->enterAction == NULL)) break;
+        if (key == KEY_GOTO) {
+            setCursor(0, screen.height - 1);
+            printf("%-*s", screen.width - 1, "Go to order ID: ");
+            setCursor(16, screen.height - 1);
+            int id;
+            if (readNumber(&id)) {
+                pthread_mutex_lock(&salesLock);
+                boardJump(board, id);
+                pthread_mutex_unlock(&salesLock);
+            }
+        }
+        drawBoard(view);
+    }
+    removeTimer(&uiLoop, timer);
 
-    printf("Available Orders\n\n");
-    printOrders();
-    pressEnterToContinue();
+    return picked;
+}
+
+// readNumber reads digits typed at the cursor until enter, it returns false if escape is pressed or nothing was typed
+bool readNumber(int *value) {
+    int digits = 0;
+    *value = 0;
+    while (1) {
+        const int key = readKey();
+        if (key == KEY_ESC) return false;
+        if (key == KEY_ENTER) return digits > 0;
+        if ((key == KEY_BACKSPACE || key == 127 || key == 8) && digits > 0) {
+            digits--;
+            *value /= 10;
+            setCursor(screen.cursorX - 1, screen.cursorY);
+            printf(" ");
+            setCursor(screen.cursorX - 1, screen.cursorY);
+        }
+        if (key >= '0' && key <= '9' && digits < 9) {
+            digits++;
+            *value = *value * 10 + key - '0';
+            printf("%c", key);
+        }
+    }
+}
+
+// viewOrders shows the order board until enter or escape is pressed
+int viewOrders() {
+    BoardView view = {.title = "Available Orders"};
+    initOrderBoard(&view.board, screen.height - BOARD_CHROME_LINES, BOARD_ALL_STATUSES);
+    runBoard(&view);
 
     return 0;
 }
@@ -575,7 +797,7 @@ int viewOrders() {
 int cashierMainMenu() {
     beginPrintOption();
 
-    printOption("Select Order");
+    printOption("New Order");
     printOption("View Orders");
 
     int totalOption = 2;
@@ -583,9 +805,6 @@ int cashierMainMenu() {
 
     while (1) {
         const int key = menuArrowSelector(totalOption, &selected);
-#ifndef _WIN32
-        refresh();
-#endif
 
         if (key == KEY_ESC) {
             exit(0);
@@ -595,6 +814,7 @@ int cashierMainMenu() {
             clearTerminal();
             switch (selected) {
                 case 0:
+                    while (newOrderView());
                     return 1;
                 case 1:
                     while (viewOrders());
@@ -605,293 +825,289 @@ int cashierMainMenu() {
     return 1;
 }
 
+// newOrderView takes an order: the cashier picks the payment type, then types part of a stock name
+// and adds the highlighted match with enter until escape closes the order
+int newOrderView() {
+    printc("Select a payment type:", ANSI_BLUE);
+    beginPrintOption();
+    printOption("PayPal");
+    printOption("Credit Card");
+    printOption("Debit Card");
+    printOption("Cash");
 
+    OrderEntry entry = {0};
+    int selectedPayment = 0;
+    while (1) {
+        const int key = menuArrowSelector(PAYMENT_TYPE_COUNT, &selectedPayment);
+        if (key == KEY_ESC) return 0;
+        if (key == KEY_ENTER) break;
+    }
+    entry.paymentType = selectedPayment;
 
-int adminMainMenu() {
-    printf("ADMIN\n");
-    pressEnterToContinue();
-    return 1;
-}
-
-int idGenerator(int length) {
-    srand(time(NULL));
-    int id = rand();
-    id = id % (int) pow(10, length);
-    return id;
-}
-
-Order *createOrder(int cashierId, PaymentType paymentType) {
-    Order *order = malloc(sizeof(Order));
-    order->id = idGenerator(5);
-    order->cashierId = cashierId;
-    order->paymentType = paymentType;
-    return order;
-}
-
-Item *createItem(int stockId, int quantity) {
-    Item *item = malloc(sizeof(Item));
-    item->id = idGenerator(6);
-    item->quantity = quantity;
-    item->stockId = stockId;
-    item->prev = NULL;
-    item->next = NULL;
-    return item;
-}
-
-Order *findOrder(int id) {
-    int currentIteration = 0;
-    for (Order *firstOrder = orders.head, *lastOrder = orders.tail;
-         firstOrder != NULL && lastOrder != NULL && currentIteration < (orders.length / 2 + 1);
-         firstOrder = firstOrder->next, lastOrder = lastOrder->prev) {
-        if (firstOrder->id == id) return firstOrder;
-        if (lastOrder->id == id) return lastOrder;
-        currentIteration++;
+    Stock *matches[ENTRY_MAX_MATCHES];
+    while (1) {
+        int rows = (screen.height - 10) / 2;
+        if (rows < 1) rows = 1;
+        if (rows > ENTRY_MAX_MATCHES) rows = ENTRY_MAX_MATCHES;
+        // the catalog is searched through the name index, so each keystroke costs the matches shown
+        const int count = findStocksByPrefix(entry.search, matches, rows);
+        if (entry.selected >= count) entry.selected = count > 0 ? count - 1 : 0;
+        drawOrderEntry(&entry, matches, count, rows);
+
+        int key = readKey();
+#ifdef _WIN32
+        if (key == KEY_ARROW_PREFIX) key = readKey() + KEY_ARROW_PREFIX;
+        const int up = KEY_ARROW_PREFIX + KEY_ARROW_UP, down = KEY_ARROW_PREFIX + KEY_ARROW_DOWN;
+#else
+        const int up = KEY_UP, down = KEY_DOWN;
+#endif
+        entry.message = NULL;
+        if (key == KEY_ESC) break;
+        if (key == up && entry.selected > 0) entry.selected--;
+        if (key == down && entry.selected < count - 1) entry.selected++;
+        if ((key == KEY_BACKSPACE || key == 127 || key == 8) && entry.searchLength > 0) {
+            entry.search[--entry.searchLength] = '\0';
+            entry.selected = 0;
+        }
+        if (key >= ' ' && key < 127 && entry.searchLength < (int) sizeof(entry.search) - 1) {
+            entry.search[entry.searchLength++] = (char) key;
+            entry.search[entry.searchLength] = '\0';
+            entry.selected = 0;
+        }
+        if (key == KEY_ENTER && count > 0) {
+            const int stockId = matches[entry.selected]->id;
+            if (entry.orderId == 0 && remote) {
+                entry.orderId = remoteCreateOrder(&connection, entry.paymentType);
+            } else if (entry.orderId == 0) {
+                // without an id the order isn't added and nothing is added to it
+                Order *order = createOrder(loggedUser->id, entry.paymentType);
+                entry.orderId = order->id;
+                if (order->id != 0) addOrder(order);
+                else freeOrder(order);
+            }
+            Order *order = findOrder(entry.orderId);
+            bool added;
+            if (remote) added = entry.orderId != 0 && remoteAddItem(&connection, entry.orderId, stockId, 1);
+            else added = order != NULL && addItemToOrder(order, stockId, 1);
+            entry.message = added ? NULL : "Not enough left in stock!";
+        }
     }
-    return NULL;
-}
 
-void addOrder(Order *order) {
-    if (orders.head == NULL) {
-        orders.head = order;
-        orders.tail = order;
-        orders.length = 1;
-    } else {
-        orders.tail->next = order;
-        order->prev = orders.tail;
-        orders.tail = order;
-        orders.length++;
-    }
-}
-
-void removeOrder(int id) {
-    Order *order = findOrder(id);
-    if (order == NULL) return;
-    if (order == orders.head) {
-        orders.head = order->next;
-        orders.head->prev = NULL;
-    } else if (order == orders.tail) {
-        orders.tail = order->prev;
-        orders.tail->next = NULL;
+    clearTerminal();
+    Order *order = entry.orderId != 0 ? findOrder(entry.orderId) : NULL;
+    if (order == NULL) {
+        printf("No items were added, the order was not placed.\n");
     } else {
-        order->prev->next = order->next;
-        order->next->prev = order->prev;
+        printc("Order placed!\n", ANSI_GREEN);
+        printf("Order %d, total %lld\n", order->id, order->total);
+        // the kitchen's chefs cook it, unless they have too many orders and a chef has to cook it by hand
+        const bool placed = remote ? remotePlaceOrder(&connection, order->id) : placeOrder(order);
+        if (!placed) printf("The kitchen is busy, the order waits for a chef.\n");
     }
-    free(order);
-    orders.length--;
+    pressEnterToContinue();
+    return 0;
 }
 
-Item *findItemFromOrder(int stockId) {
-    for (Order *order = orders.head; order != NULL; order = order->next) {
-        for (Item *item = order->items; item != NULL; item = item->next) {
-            if (item->stockId == stockId) return item;
-        }
+// drawOrderEntry draws the search with its matches on top and the items of the order below
+void drawOrderEntry(const OrderEntry *entry, Stock *matches[], int count, int rows) {
+    clearTerminal();
+    printf("New Order (%s)\n\n\n", getPaymentName(entry->paymentType));
+    printf("| %-5s | %-30s | %-8s | %-8s |\n", "ID", "Stock", "Price", "Quantity");
+    for (int i = 0; i < count; i++) {
+        char row[128];
+        snprintf(row, sizeof(row), "| %-5d | %-30.30s | %-8d | %-8d |", matches[i]->id, stringAt(matches[i]->name),
+                 matches[i]->price, getStockQuantity(matches[i]));
+        if (i == entry->selected) printc(row, ANSI_GREEN);
+        else printf("%s", row);
+        printf("\n");
     }
-    return NULL;
-}
-
-void addItemToOrder(Order *order, int stockId, int quantity) {
-    Stock *stock = findStock(stockId);
-    if (stock == NULL) return;
-
-    int found = 0;
-    for (Item *item = order->items; item != NULL; item = item->next) {
-        if (item->stockId == stockId) {
-            item->quantity += quantity;
-            found = 1;
+    if (count == 0) printf("| %-62s |\n", "No stock matches");
+
+    setCursor(0, rows + 5);
+    printf("Items\n");
+    const Order *order = entry->orderId != 0 ? findOrder(entry->orderId) : NULL;
+    const int itemRows = screen.height - rows - 10;
+    int shown = 0;
+    for (int i = 0; order != NULL && i < order->itemCount; i++) {
+        const Item *item = &order->items[i];
+        if (shown++ == itemRows) {
+            printf("  ...\n");
             break;
         }
+        const Stock *stock = findStock(item->stockId);
+        printf("  %3d x %-30.30s %lld\n", item->quantity, stock != NULL ? stringAt(stock->name) : "-",
+               (long long) item->quantity * item->price);
     }
-
-    if (!found) {
-        Item *item = createItem(stockId, quantity);
-        item->next = order->items;
-        if (order->items != NULL) {
-            order->items->prev = item;
-        }
-        order->items = item;
-    }
+    printf("Total: %lld\n", order != NULL ? order->total : 0);
+
+    setCursor(0, screen.height - 3);
+    if (entry->message != NULL) printc(entry->message, ANSI_RED);
+    setCursor(0, screen.height - 2);
+    printf("Type to search, Up/Down: pick, Enter: add one, Esc: finish the order");
+    setCursor(0, 2);
+    printc("Search: ", ANSI_BLUE);
+    printf("%s", entry->search);
 }
 
-void modifyItemOnOrder(Order *order, int stockId, int quantity) {
-    for (Item *item = order->items; item != NULL; item = item->next)
-        if (item->stockId == stockId)
-            item->quantity = quantity;
-}
+int adminMainMenu() {
+    beginPrintOption();
 
-Stock *findStock(int id) {
-    int currentIteration = 0;
-    for (Stock *firstStock = stocks.head, *lastStock = stocks.tail;
-         firstStock != NULL && lastStock != NULL && currentIteration < (stocks.length / 2 + 1);
-         firstStock = firstStock->next, lastStock = lastStock->prev) {
-        if (firstStock->id == id) return firstStock;
-        if (lastStock->id == id) return lastStock;
-        currentIteration++;
-    }
-    return NULL;
-}
+    printOption("Sales");
+    printOption("Check sales totals");
+    printOption("Metrics");
 
-void addStock(Stock *stock) {
-    if (stocks.head == NULL) {
-        stocks.head = stock;
-        stocks.tail = stock;
-        stocks.length = 1;
-    } else {
-        stocks.tail->next = stock;
-        stock->prev = stocks.tail;
-        stocks.tail = stock;
-        stocks.length++;
-    }
-}
+    int totalOption = 3;
+    int selected = 0;
 
-void removeStock(Stock *stock) {
-    if (stocks.head != NULL && stock->id == stocks.head->id) {
-        stocks.head = stock->next;
-        stocks.head->prev = NULL;
-    } else if (stocks.tail != NULL && stock->id == stocks.tail->id) {
-        stocks.tail = stock->prev;
-        stocks.tail->next = NULL;
-    } else {
-        stock->prev->next = stock->next;
-        stock->next->prev = stock->prev;
-    }
-    free(stock);
-    stocks.length--;
-}
+    while (1) {
+        const int key = menuArrowSelector(totalOption, &selected);
 
-void incrementQuantity(int stockId, int quantity) {
-    Stock *stock = findStock(stockId);
-    if (stock == NULL) return;
-    stock->quantity += quantity;
-}
+        if (key == KEY_ESC) {
+            exit(0);
+        }
 
-void decrementQuantity(int stockId, int quantity) {
-    Stock *stock = findStock(stockId);
-    if (stock == NULL) return;
-    stock->quantity -= quantity;
+        if (key == KEY_ENTER) {
+            clearTerminal();
+            switch (selected) {
+                case 0:
+                    while (salesView());
+                    return 1;
+                case 1:
+                    while (checkSalesView());
+                    return 1;
+                case 2:
+                    while (metricsView());
+                    return 1;
+            }
+        }
+    }
+    return 1;
 }
 
-User *createUser(char name[], char hashedPassword[], UserType type) {
-    User *user = malloc(sizeof(User));
-    user->id = idGenerator(7);
-    strcpy(user->name, name);
-    strcpy(user->hashedPassword, hashedPassword);
-    user->type = type;
-    return user;
-}
+// drawSales draws the running sales totals, the summary is read in O(1) and the tables stop at the screen edge
+void drawSales(void *context) {
+    (void) context;
+    SalesSummary summary;
+    getSalesSummary(&summary);
 
-User *findUser(int id) {
-    int currentIteration = 0;
-    for (User *firstUser = users.head, *lastUser = users.tail;
-         firstUser != NULL && lastUser != NULL && currentIteration < (users.length / 2 + 1);
-         firstUser = firstUser->next, lastUser = lastUser->prev) {
-        if (firstUser->id == id) return firstUser;
-        if (lastUser->id == id) return lastUser;
-        currentIteration++;
+    clearTerminal();
+    printf("Sales\n\n");
+    printc("Revenue: ", ANSI_BLUE);
+    printf("%lld from %d completed orders\n", summary.statusTotals[COMPLETED], summary.orderCounts[COMPLETED]);
+    printf("Waiting: %d orders worth %lld, cancelled: %d orders worth %lld\n\n", summary.orderCounts[WAITING],
+           summary.statusTotals[WAITING], summary.orderCounts[CANCELLED], summary.statusTotals[CANCELLED]);
+    for (int i = 0; i < PAYMENT_TYPE_COUNT; i++) {
+        printf("%-12s %lld\n", getPaymentName(i), summary.paymentRevenue[i]);
     }
-    return NULL;
-}
 
-void addUser(User *user) {
-    if (users.head == NULL) {
-        users.head = user;
-        users.tail = user;
-        users.length = 1;
-    } else {
-        users.tail->next = user;
-        user->prev = users.tail;
-        users.tail = user;
-        users.length++;
+    // the two tables share what is left of the screen, cashiers on the left and stocks on the right
+    const int top = screen.cursorY + 1, rows = screen.height - top - 3;
+    setCursor(0, top);
+    printf("| %-10s | %-6s | %-8s |", "Cashier", "Orders", "Revenue");
+    int row = 0;
+    for (const User *user = users.head; user != NULL && row < rows; user = user->next) {
+        if (user->type != CASHIER) continue;
+        const SalesTotal total = getCashierSales(user->id);
+        setCursor(0, top + 1 + row++);
+        printf("| %-10.10s | %-6d | %-8lld |", stringAt(user->name), total.orders, total.revenue);
     }
-}
 
-void removeUser(User *user) {
-    if (users.head != NULL && user->id == users.head->id) {
-        users.head = user->next;
-        users.head->prev = NULL;
-    } else if (users.tail != NULL && user->id == users.tail->id) {
-        users.tail = user->prev;
-        users.tail->next = NULL;
-    } else {
-        user->prev->next = user->next;
-        user->next->prev = user->prev;
+    setCursor(35, top);
+    printf("| %-10s | %-6s | %-7s | %-8s |", "Stock", "Sold", "Waiting", "Revenue");
+    row = 0;
+    for (const Stock *stock = stocks.head; stock != NULL && row < rows; stock = stock->next) {
+        const SalesTotal total = getStockSales(stock->id);
+        setCursor(35, top + 1 + row++);
+        printf("| %-10.10s | %-6lld | %-7lld | %-8lld |", stringAt(stock->name), total.quantity, total.waiting,
+               total.revenue);
     }
-    free(user);
-    users.length--;
-}
-
-void changePassword(User *user, char hashedPassword[]) {
-    strcpy(user->hashedPassword, hashedPassword);
-}
 
-void registerUser(char name[], char password[], UserType type) {
-    char hashed[201];
-    hashPassword(password, hashed);
-    User *user = createUser(name, hashed, type);
-    addUser(user);
+    setCursor(0, screen.height - 1);
+    printf("Press enter to continue...");
 }
 
-void hashPassword(char password[], char hashedPassword[]) {
-    // let's say abc, where a = 97, b = 98, c = 99
-    int passwordLength = strlen(password);
-    for (int i = 0; i < passwordLength; i++) {
-        hashedPassword[i] = password[i] + (i * 7) % 26;
-        // a = 97 + (0 * 7) % 26 = 97 + (0 * 7) = 97
-        // b = 98 + (1 * 7) % 26 = 98 + (1 * 7) = 105
-        // c = 99 + (2 * 7) % 26 = 99 + (2 * 7) = 106
+// salesView shows the sales totals, redrawn every second, until enter or escape is pressed
+int salesView() {
+    drawSales(NULL);
+    const int timer = addTimer(&uiLoop, 1000, drawSales, NULL);
+    while (1) {
+        const int key = readKey();
+        if (key == KEY_ENTER || key == KEY_ESC) break;
     }
-    hashedPassword[passwordLength] = '\0';
-}
+    removeTimer(&uiLoop, timer);
 
-bool verifyPassword(User *user, char password[]) {
-    char hashedPassword[201];
-    hashPassword(password, hashedPassword);
-    if (strcmp(user->hashedPassword, hashedPassword) == 0) return true;
-    else return false;
+    return 0;
 }
 
-User *findUserByName(const char *name) {
-    for (User *user = users.head; user != NULL; user = user->next) {
-        if (strcmp(user->name, name) == 0) return user;
-    }
-    return NULL;
-}
+// checkSalesView recomputes the sales totals from every order and reports whether the running totals agree
+int checkSalesView() {
+    char report[256];
+    const long long start = nowNanos();
+    const int mismatches = checkSales(report, sizeof(report));
+    const long long elapsed = nowNanos() - start;
 
-bool isLogged() {
-    return loggedUser != NULL;
+    printf("Checked %d orders in %.1f ms\n\n", orders.length, elapsed / 1e6);
+    if (mismatches == 0) {
+        printc("Sales totals are consistent\n", ANSI_GREEN);
+    } else {
+        printf("%d totals differ, first: ", mismatches);
+        printc(report, ANSI_RED);
+        printf("\n");
+    }
+    pressEnterToContinue();
+    return 0;
 }
 
-char *getItemNames(Item *head) {
-    for (Item *item = head; item != NULL; item = item->next) {
-        Stock *stock = findStock(item->stockId);
-        printf("%s x%d", stock->name, item->quantity);
+// drawMetrics draws a line per instrumented operation with its latency percentiles since the last reset.
+// context points to the message of the last key pressed, if any.
+void drawMetrics(void *context) {
+    const char *const *message = context;
+    MetricReport *reports = malloc(sizeof(MetricReport) * METRIC_COUNT);
+    if (reports == NULL) return;
+    readMetrics(reports);
 
-        if (item->next != NULL) printf(", ");
+    clearTerminal();
+    printf("Metrics (%s)\n\n", atomic_load(&metricsEnabled) ? "recording" : "off");
+    printf("| %-15s | %-9s | %-9s | %-9s | %-9s | %-9s | %-9s |\n", "Operation", "Count", "Mean us", "p50 us",
+           "p90 us", "p99 us", "Max us");
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        const MetricReport *report = &reports[metric];
+        printf("| %-15s | %-9lld | %-9.1f | %-9.1f | %-9.1f | %-9.1f | %-9.1f |\n", getMetricName(metric),
+               report->count, report->count > 0 ? report->total / 1000.0 / report->count : 0.0,
+               metricPercentile(report, 50) / 1000.0, metricPercentile(report, 90) / 1000.0,
+               metricPercentile(report, 99) / 1000.0, metricPercentile(report, 100) / 1000.0);
     }
-}
+    free(reports);
 
-char *getPaymentName(PaymentType paymentType) {
-    switch (paymentType) {
-        case PAYPAL: return "PayPal";
-        case CREDIT_CARD: return "Credit Card";
-        case DEBIT_CARD: return "Debit Card";
-        case CASH: return "Cash";
-        default: return "Unknown";
+    if (*message != NULL) {
+        printf("\n");
+        printc((char *) *message, ANSI_BLUE);
     }
+    setCursor(0, screen.height - 1);
+    printf("E: turn recording %s, Z: zero, D: write to %s, Esc: back",
+           atomic_load(&metricsEnabled) ? "off" : "on", metricsFilePath);
 }
 
-char *getOrderStatusName(OrderStatus orderStatus) {
-    switch (orderStatus) {
-        case WAITING: return "Waiting";
-        case CANCELLED: return "Cancelled";
-        case COMPLETED: return "Completed";
-        default: return "Unknown";
+// metricsView shows the metrics, redrawn every second, until enter or escape is pressed
+int metricsView() {
+    const char *message = NULL;
+    drawMetrics(&message);
+    const int timer = addTimer(&uiLoop, 1000, drawMetrics, &message);
+    while (1) {
+        const int key = readKey();
+        if (key == KEY_ENTER || key == KEY_ESC) break;
+        if (key == KEY_TOGGLE) {
+            atomic_store(&metricsEnabled, !atomic_load(&metricsEnabled));
+            message = NULL;
+        }
+        if (key == KEY_ZERO) {
+            resetMetrics();
+            message = "Metrics zeroed";
+        }
+        if (key == KEY_DUMP) message = writeMetricsToFile(metricsFilePath) ? "Metrics written" : "Failed to write";
+        drawMetrics(&message);
     }
-}
+    removeTimer(&uiLoop, timer);
 
-Stock *createStock(char *name, int price, int quantity) {
-    Stock *stock = malloc(sizeof(Stock));
-    strcpy(stock->name, name);
-    stock->price = price;
-    stock->quantity = quantity;
-    return stock;
+    return 0;
 }
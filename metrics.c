@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "metrics.h"
+
+const char *metricsFilePath = "metrics.csv";
+_Atomic bool metricsEnabled = false;
+
+// the shards of every thread that recorded something, and what they held at the last reset
+MetricsShard *metricsShards = NULL;
+pthread_mutex_t metricsLock = PTHREAD_MUTEX_INITIALIZER;
+MetricReport metricsBaseline[METRIC_COUNT];
+
+_Thread_local MetricsShard *metricsShard = NULL;
+
+// metricAdd adds to a counter only its own thread writes, which needs no locked instruction
+void metricAdd(_Atomic long long *counter, long long amount) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + amount,
+                          memory_order_relaxed);
+}
+
+void recordMetric(Metric metric, long long started) {
+    const long long elapsed = nowNanos() - started;
+    MetricsShard *shard = metricsShard;
+    if (shard == NULL) {
+        shard = calloc(1, sizeof(MetricsShard));
+        if (shard == NULL) return;
+        pthread_mutex_lock(&metricsLock);
+        shard->next = metricsShards;
+        metricsShards = shard;
+        pthread_mutex_unlock(&metricsLock);
+        metricsShard = shard;
+    }
+    MetricHistogram *histogram = &shard->histograms[metric];
+    metricAdd(&histogram->count, 1);
+    metricAdd(&histogram->total, elapsed);
+    metricAdd(&histogram->buckets[metricBucket(elapsed)], 1);
+}
+
+// metricBucket keeps the top 5 bits of nanos, the power of two picks the group of buckets and the next 4 bits
+// the bucket in it. Below 16ns every nanosecond has its own bucket.
+int metricBucket(long long nanos) {
+    if (nanos < METRIC_SUB_BUCKETS) return nanos < 0 ? 0 : (int) nanos;
+#if defined(__GNUC__)
+    const int highest = 63 - __builtin_clzll((unsigned long long) nanos);
+#else
+    int highest = 0;
+    while ((nanos >> highest) > 1) highest++;
+#endif
+    const int shift = highest - 4;
+    const int bucket = METRIC_SUB_BUCKETS * (shift + 1) + (int) (nanos >> shift) - METRIC_SUB_BUCKETS;
+    return bucket < METRIC_BUCKETS ? bucket : METRIC_BUCKETS - 1;
+}
+
+// metricBucketValue is the middle of a bucket, the value a percentile that falls in it reports
+long long metricBucketValue(int bucket) {
+    if (bucket < METRIC_SUB_BUCKETS) return bucket;
+    const int shift = bucket / METRIC_SUB_BUCKETS - 1;
+    return ((long long) (METRIC_SUB_BUCKETS + bucket % METRIC_SUB_BUCKETS) << shift) + ((1LL << shift) >> 1);
+}
+
+// sumMetrics adds up every shard, as recorded since the program started
+void sumMetrics(MetricReport reports[METRIC_COUNT]) {
+    memset(reports, 0, sizeof(MetricReport) * METRIC_COUNT);
+    pthread_mutex_lock(&metricsLock);
+    for (const MetricsShard *shard = metricsShards; shard != NULL; shard = shard->next) {
+        for (int metric = 0; metric < METRIC_COUNT; metric++) {
+            const MetricHistogram *histogram = &shard->histograms[metric];
+            MetricReport *report = &reports[metric];
+            if (atomic_load_explicit(&histogram->count, memory_order_relaxed) == 0) continue;
+            report->count += atomic_load_explicit(&histogram->count, memory_order_relaxed);
+            report->total += atomic_load_explicit(&histogram->total, memory_order_relaxed);
+            for (int i = 0; i < METRIC_BUCKETS; i++) {
+                report->buckets[i] += atomic_load_explicit(&histogram->buckets[i], memory_order_relaxed);
+            }
+        }
+    }
+    pthread_mutex_unlock(&metricsLock);
+}
+
+// readMetrics reports every operation since the last reset. The shards are read while threads keep recording,
+// so a call in flight may be in the count and not yet in its bucket.
+void readMetrics(MetricReport reports[METRIC_COUNT]) {
+    sumMetrics(reports);
+    pthread_mutex_lock(&metricsLock);
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        reports[metric].count -= metricsBaseline[metric].count;
+        reports[metric].total -= metricsBaseline[metric].total;
+        for (int i = 0; i < METRIC_BUCKETS; i++) reports[metric].buckets[i] -= metricsBaseline[metric].buckets[i];
+    }
+    pthread_mutex_unlock(&metricsLock);
+}
+
+// resetMetrics starts the reports over. The shards aren't cleared since only their threads write them,
+// what they hold now becomes the baseline the reports are taken from.
+void resetMetrics() {
+    MetricReport *current = malloc(sizeof(MetricReport) * METRIC_COUNT);
+    if (current == NULL) return;
+    sumMetrics(current);
+    pthread_mutex_lock(&metricsLock);
+    memcpy(metricsBaseline, current, sizeof(MetricReport) * METRIC_COUNT);
+    pthread_mutex_unlock(&metricsLock);
+    free(current);
+}
+
+// metricPercentile returns the value below which percentile percent of the calls fall, 0 if there were none
+long long metricPercentile(const MetricReport *report, double percentile) {
+    if (report->count <= 0) return 0;
+    long long wanted = (long long) (report->count * percentile / 100.0);
+    if (wanted >= report->count) wanted = report->count - 1;
+    long long seen = 0;
+    for (int i = 0; i < METRIC_BUCKETS; i++) {
+        seen += report->buckets[i];
+        if (seen > wanted) return metricBucketValue(i);
+    }
+    return metricBucketValue(METRIC_BUCKETS - 1);
+}
+
+char *getMetricName(Metric metric) {
+    switch (metric) {
+        case METRIC_LOGIN: return "Login";
+        case METRIC_ADD_ORDER: return "Add order";
+        case METRIC_ADD_ITEM: return "Add item";
+        case METRIC_SET_STATUS: return "Set status";
+        case METRIC_FIND_STOCK: return "Find stock";
+        case METRIC_SEARCH_STOCKS: return "Search stocks";
+        case METRIC_JOURNAL_WRITE: return "Journal write";
+        case METRIC_SAVE: return "Checkpoint";
+        case METRIC_DRAW_BOARD: return "Draw board";
+        case METRIC_PRESENT: return "Present screen";
+        case METRIC_REQUEST: return "Server request";
+        default: return "Unknown";
+    }
+}
+
+// writeMetricsToFile writes a summary line per operation, then the buckets that have calls, both as CSV
+bool writeMetricsToFile(const char *path) {
+    MetricReport *reports = malloc(sizeof(MetricReport) * METRIC_COUNT);
+    if (reports == NULL) return false;
+    readMetrics(reports);
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        free(reports);
+        return false;
+    }
+
+    fprintf(file, "operation,count,mean_ns,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        const MetricReport *report = &reports[metric];
+        fprintf(file, "%s,%lld,%lld,%lld,%lld,%lld,%lld,%lld\n", getMetricName(metric), report->count,
+                report->count > 0 ? report->total / report->count : 0, metricPercentile(report, 50),
+                metricPercentile(report, 90), metricPercentile(report, 99), metricPercentile(report, 99.9),
+                metricPercentile(report, 100));
+    }
+    fprintf(file, "\noperation,bucket_ns,count\n");
+    for (int metric = 0; metric < METRIC_COUNT; metric++) {
+        for (int i = 0; i < METRIC_BUCKETS; i++) {
+            if (reports[metric].buckets[i] == 0) continue;
+            fprintf(file, "%s,%lld,%lld\n", getMetricName(metric), metricBucketValue(i), reports[metric].buckets[i]);
+        }
+    }
+
+    free(reports);
+    return fclose(file) == 0;
+}
@@ -0,0 +1,85 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "restaurant.h"
+
+// histograms keep 16 buckets per power of two, so a percentile is within 1/16 of the true value.
+// The last bucket takes everything from about 18 minutes up.
+#define METRIC_SUB_BUCKETS 16
+#define METRIC_BUCKETS (METRIC_SUB_BUCKETS * 38)
+
+typedef enum {
+    METRIC_LOGIN,
+    METRIC_ADD_ORDER,
+    METRIC_ADD_ITEM,
+    METRIC_SET_STATUS,
+    METRIC_FIND_STOCK,
+    METRIC_SEARCH_STOCKS,
+    METRIC_JOURNAL_WRITE,
+    METRIC_SAVE,
+    METRIC_DRAW_BOARD,
+    METRIC_PRESENT,
+    METRIC_REQUEST,
+    METRIC_COUNT
+} Metric;
+
+// MetricHistogram counts one operation's calls by how long they took, in nanoseconds.
+// Only the thread that owns it writes it, the atomics are so another thread can read it at any time.
+typedef struct {
+    _Atomic long long count;
+    _Atomic long long total;
+    _Atomic long long buckets[METRIC_BUCKETS];
+} MetricHistogram;
+
+typedef struct MetricsShard MetricsShard;
+
+// MetricsShard is one thread's histograms, so recording never shares a cache line with another thread.
+// Shards are kept when their thread ends so what it recorded still counts.
+struct MetricsShard {
+    MetricHistogram histograms[METRIC_COUNT];
+    MetricsShard *next;
+};
+
+// MetricReport is one operation summed over every thread, since the last reset
+typedef struct {
+    long long count;
+    long long total;
+    long long buckets[METRIC_BUCKETS];
+} MetricReport;
+
+extern const char *metricsFilePath;
+extern _Atomic bool metricsEnabled;
+
+// metricStart and metricEnd time an operation. They are macros so that with metrics turned off an operation costs
+// one load and one branch, and built with RESTAURANT_NO_METRICS nothing at all. metricResult ends the timing
+// and passes result on, for functions that return from several places.
+#ifdef RESTAURANT_NO_METRICS
+#define metricStart() 0LL
+#else
+#define metricStart() (atomic_load_explicit(&metricsEnabled, memory_order_relaxed) ? nowNanos() : 0LL)
+#endif
+#define metricEnd(metric, started) ((started) != 0 ? recordMetric(metric, started) : (void) 0)
+#define metricResult(metric, started, result) (metricEnd(metric, started), (result))
+
+// functions for recording and reading the metrics
+void metricAdd(_Atomic long long *counter, long long amount);
+
+void recordMetric(Metric metric, long long started);
+
+int metricBucket(long long nanos);
+
+long long metricBucketValue(int bucket);
+
+void sumMetrics(MetricReport reports[METRIC_COUNT]);
+
+void readMetrics(MetricReport reports[METRIC_COUNT]);
+
+void resetMetrics();
+
+long long metricPercentile(const MetricReport *report, double percentile);
+
+char *getMetricName(Metric metric);
+
+bool writeMetricsToFile(const char *path);
+
+#endif
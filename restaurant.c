@@ -0,0 +1,1582 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "metrics.h"
+#include "restaurant.h"
+#include "shared.h"
+#include "snapshot.h"
+#include "storage.h"
+
+Slab orderSlab = {sizeof(Order), 1024, NULL, NULL, NULL, NULL, 0};
+Slab stockSlab = {sizeof(Stock), 256, NULL, NULL, NULL, NULL, 0};
+Slab userSlab = {sizeof(User), 64, NULL, NULL, NULL, NULL, 0};
+
+IdSequence idSequences[ID_KIND_COUNT] = {{1, 1}, {1, 1}, {1, 1}, {1, 1}};
+pthread_mutex_t idLeaseLock = PTHREAD_MUTEX_INITIALIZER;
+
+// the block of ids the current thread is handing out, per kind
+_Thread_local int64_t idBlockNext[ID_KIND_COUNT];
+_Thread_local int64_t idBlockEnd[ID_KIND_COUNT];
+
+OrderList orders = {NULL, NULL, 0, {NULL, 0, 0}, {NULL}, {NULL}, {0}};
+StockList stocks = {NULL, NULL, 0, {NULL, 0, 0}, {NULL, 0, 0, 0, 0}, PTHREAD_RWLOCK_INITIALIZER};
+UserList users = {NULL, NULL, 0, {NULL, 0, 0}, {NULL, 0, 0, 0, 0}};
+
+StringArena strings = {{NULL}, 0, 0, NULL, 0, 0, 0, PTHREAD_MUTEX_INITIALIZER};
+
+User *loggedUser = NULL;
+
+Sales sales = {{{0}, {0}, {0}}, {NULL, 0, 0}, {NULL, 0, 0}, {sizeof(SalesTotal), 256, NULL, NULL, NULL, NULL, 0}};
+// archivedSales is the part of sales that comes from archived orders, checkSales can't recount it from memory
+Sales archivedSales = {
+    {{0}, {0}, {0}}, {NULL, 0, 0}, {NULL, 0, 0}, {sizeof(SalesTotal), 256, NULL, NULL, NULL, NULL, 0}
+};
+pthread_mutex_t salesLock = PTHREAD_MUTEX_INITIALIZER;
+
+StockUseIndex stockUses = {
+    {NULL, 0, 0},
+    {sizeof(StockUses), 256, NULL, NULL, NULL, NULL, 0},
+    {sizeof(StockUse), 4096, NULL, NULL, NULL, NULL, 0}
+};
+
+ChangeLog changes = {NULL, 0, 1, PTHREAD_MUTEX_INITIALIZER};
+
+// nextId returns a unique id of the given kind. Each thread hands out ids from its own block,
+// so ids only touch the shared counter once per block and increase monotonically per thread.
+// It returns 0 when the block is past the lease and ids.dat can't record a new one, since those ids could come
+// back after a crash. The block is dropped and the next call tries the lease again.
+int nextId(IdKind kind) {
+    if (idBlockNext[kind] == idBlockEnd[kind]) {
+        IdSequence *sequence = &idSequences[kind];
+        const int64_t start = atomic_fetch_add(&sequence->next, ID_BLOCK_SIZE);
+        const int64_t end = start + ID_BLOCK_SIZE;
+        if (end > atomic_load(&sequence->leased) && !leaseIds(kind, end)) {
+            fprintf(stderr, "failed to write %s\n", idsFilePath);
+            return 0;
+        }
+        idBlockNext[kind] = start;
+        idBlockEnd[kind] = end;
+    }
+    return (int) idBlockNext[kind]++;
+}
+
+// leaseIds records in ids.dat that ids up to end (and a lease beyond it) may be in use
+bool leaseIds(IdKind kind, int64_t end) {
+    pthread_mutex_lock(&idLeaseLock);
+    bool ok = true;
+    if (atomic_load(&idSequences[kind].leased) < end) {
+        int64_t leased[ID_KIND_COUNT];
+        for (int i = 0; i < ID_KIND_COUNT; i++) leased[i] = atomic_load(&idSequences[i].leased);
+        leased[kind] = end + ID_LEASE_SIZE;
+        ok = writeIdsToFile(leased);
+        if (ok) atomic_store(&idSequences[kind].leased, leased[kind]);
+    }
+    pthread_mutex_unlock(&idLeaseLock);
+    return ok;
+}
+
+// reserveIds moves the sequence past an id that is already in use, e.g. one loaded from disk
+void reserveIds(IdKind kind, int64_t id) {
+    int64_t next = atomic_load(&idSequences[kind].next);
+    while (next <= id && !atomic_compare_exchange_weak(&idSequences[kind].next, &next, id + 1));
+}
+
+unsigned int hashId(int id) {
+    unsigned int hash = (unsigned int) id;
+    hash ^= hash >> 16;
+    hash *= 0x7feb352dU;
+    hash ^= hash >> 15;
+    hash *= 0x846ca68bU;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+void *indexGet(const IdIndex *index, int id) {
+    if (index->entries == NULL) return NULL;
+    const unsigned int mask = index->capacity - 1;
+    for (unsigned int slot = hashId(id) & mask; index->entries[slot].value != NULL; slot = (slot + 1) & mask) {
+        if (index->entries[slot].id == id) return index->entries[slot].value;
+    }
+    return NULL;
+}
+
+void indexGrow(IdIndex *index) {
+    IndexEntry *oldEntries = index->entries;
+    const int oldCapacity = index->capacity;
+
+    index->capacity = oldCapacity == 0 ? 16 : oldCapacity * 2;
+    index->entries = calloc(index->capacity, sizeof(IndexEntry));
+    index->length = 0;
+    for (int i = 0; i < oldCapacity; i++) {
+        if (oldEntries[i].value != NULL) indexPut(index, oldEntries[i].id, oldEntries[i].value);
+    }
+    free(oldEntries);
+}
+
+void indexPut(IdIndex *index, int id, void *value) {
+    // keep the load factor under 0.75 so probe sequences stay short
+    if ((index->length + 1) * 4 > index->capacity * 3) indexGrow(index);
+
+    const unsigned int mask = index->capacity - 1;
+    unsigned int slot = hashId(id) & mask;
+    while (index->entries[slot].value != NULL) {
+        if (index->entries[slot].id == id) {
+            index->entries[slot].value = value;
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    index->entries[slot].id = id;
+    index->entries[slot].value = value;
+    index->length++;
+}
+
+void indexRemove(IdIndex *index, int id, const void *value) {
+    if (index->entries == NULL) return;
+    const unsigned int mask = index->capacity - 1;
+    unsigned int slot = hashId(id) & mask;
+    while (index->entries[slot].id != id || index->entries[slot].value != value) {
+        if (index->entries[slot].value == NULL) return;
+        slot = (slot + 1) & mask;
+    }
+
+    // shift the following entries of the probe sequence back instead of leaving a tombstone
+    unsigned int next = slot;
+    while (1) {
+        next = (next + 1) & mask;
+        if (index->entries[next].value == NULL) break;
+        const unsigned int home = hashId(index->entries[next].id) & mask;
+        const bool stays = slot <= next ? (slot < home && home <= next) : (slot < home || home <= next);
+        if (stays) continue;
+        index->entries[slot] = index->entries[next];
+        slot = next;
+    }
+    index->entries[slot].value = NULL;
+    index->length--;
+}
+
+// hashString is FNV-1a over the first length bytes of text
+uint32_t hashString(const char *text, size_t length) {
+    uint32_t hash = 2166136261U;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) text[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+// growStrings doubles the hash of the arena's strings, the strings themselves don't move
+bool growStrings() {
+    const int capacity = strings.capacity == 0 ? 256 : strings.capacity * 2;
+    StringHandle *slots = calloc(capacity, sizeof(StringHandle));
+    if (slots == NULL) return false;
+    const unsigned int mask = capacity - 1;
+    for (int i = 0; i < strings.capacity; i++) {
+        if (strings.slots[i] == 0) continue;
+        const char *stored = stringAt(strings.slots[i]);
+        unsigned int slot = hashString(stored, strlen(stored)) & mask;
+        while (slots[slot] != 0) slot = (slot + 1) & mask;
+        slots[slot] = strings.slots[i];
+    }
+    free(strings.slots);
+    strings.slots = slots;
+    strings.capacity = capacity;
+    return true;
+}
+
+// internString returns the handle of text cut to size - 1 characters, as if it were copied into a char[size],
+// adding it to the arena the first time it is seen. It returns 0, the empty string, if the arena is out of memory.
+StringHandle internString(const char *text, size_t size) {
+    if (size > STRING_CHUNK_SIZE / 2) size = STRING_CHUNK_SIZE / 2;
+    const size_t length = strnlen(text, size - 1);
+    if (length == 0) return 0;
+    const uint32_t hash = hashString(text, length);
+
+    pthread_mutex_lock(&strings.lock);
+    // keep the load factor under 0.5 so a miss finds an empty slot quickly
+    if ((strings.length + 1) * 2 > strings.capacity && !growStrings()) {
+        pthread_mutex_unlock(&strings.lock);
+        return 0;
+    }
+    const unsigned int mask = strings.capacity - 1;
+    unsigned int slot = hash & mask;
+    for (; strings.slots[slot] != 0; slot = (slot + 1) & mask) {
+        const char *stored = stringAt(strings.slots[slot]);
+        if (strncmp(stored, text, length) == 0 && stored[length] == '\0') {
+            const StringHandle handle = strings.slots[slot];
+            pthread_mutex_unlock(&strings.lock);
+            return handle;
+        }
+    }
+
+    // a string that doesn't fit in the last chunk starts a new one, the first byte of the arena is the empty string
+    if (strings.chunkCount == 0 || strings.used + length + 1 > STRING_CHUNK_SIZE) {
+        char *chunk = strings.chunkCount < STRING_MAX_CHUNKS ? malloc(STRING_CHUNK_SIZE) : NULL;
+        if (chunk == NULL) {
+            pthread_mutex_unlock(&strings.lock);
+            return 0;
+        }
+        chunk[0] = '\0';
+        strings.used = strings.chunkCount == 0 ? 1 : 0;
+        strings.chunks[strings.chunkCount++] = chunk;
+    }
+    const StringHandle handle = (StringHandle) (strings.chunkCount - 1) << STRING_CHUNK_BITS | strings.used;
+    char *copy = strings.chunks[strings.chunkCount - 1] + strings.used;
+    memcpy(copy, text, length);
+    copy[length] = '\0';
+    strings.used += length + 1;
+    strings.bytes += length + 1;
+    strings.slots[slot] = handle;
+    strings.length++;
+    pthread_mutex_unlock(&strings.lock);
+    return handle;
+}
+
+// stringAt returns the text of a handle. Chunks never move, so it needs no lock.
+const char *stringAt(StringHandle handle) {
+    if (handle == 0) return "";
+    return strings.chunks[handle >> STRING_CHUNK_BITS] + (handle & (STRING_CHUNK_SIZE - 1));
+}
+
+// compareNames orders names ignoring case, so "bur" finds "Burger" and "burrito" next to each other
+int compareNames(const char *a, const char *b) {
+    while (*a != '\0' && tolower((unsigned char) *a) == tolower((unsigned char) *b)) {
+        a++;
+        b++;
+    }
+    return tolower((unsigned char) *a) - tolower((unsigned char) *b);
+}
+
+// compareNameEntries breaks ties between names that differ only in case by the exact name,
+// and between equal names by the node, so every entry has one place and can be found to be removed
+int compareNameEntries(const void *a, const void *b) {
+    const NameEntry *first = a, *second = b;
+    int result = compareNames(first->name, second->name);
+    if (result == 0) result = strcmp(first->name, second->name);
+    if (result == 0) result = (uintptr_t) first->value < (uintptr_t) second->value ? -1 :
+                              (uintptr_t) first->value > (uintptr_t) second->value;
+    return result;
+}
+
+// nameIndexSettle sorts the names added since the last lookup and merges them into the sorted part,
+// dropping the removed names on the way
+void nameIndexSettle(NameIndex *index) {
+    if (index->sortedLength == index->length && index->removed * 2 <= index->length) return;
+
+    NameEntry *pending = index->entries + index->sortedLength;
+    const int pendingLength = index->length - index->sortedLength;
+    qsort(pending, pendingLength, sizeof(NameEntry), compareNameEntries);
+
+    NameEntry *merged = malloc(sizeof(NameEntry) * index->capacity);
+    if (merged == NULL) return;
+    int length = 0, i = 0, j = 0;
+    while (i < index->sortedLength || j < pendingLength) {
+        NameEntry *entry;
+        const bool takeSorted = j == pendingLength ||
+                                (i < index->sortedLength && compareNameEntries(&index->entries[i], &pending[j]) <= 0);
+        if (takeSorted) {
+            entry = &index->entries[i++];
+        } else {
+            entry = &pending[j++];
+        }
+        if (!entry->removed) merged[length++] = *entry;
+    }
+
+    free(index->entries);
+    index->entries = merged;
+    index->length = length;
+    index->sortedLength = length;
+    index->removed = 0;
+}
+
+// nameIndexLowerBound returns the first sorted entry not before key, comparing only the names ignoring case
+// when ignoreCase is set
+int nameIndexLowerBound(const NameIndex *index, const NameEntry *key, bool ignoreCase) {
+    int low = 0, high = index->sortedLength;
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const NameEntry *entry = &index->entries[middle];
+        const int result = ignoreCase ? compareNames(entry->name, key->name) : compareNameEntries(entry, key);
+        if (result < 0) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+// nameIndexPut adds a name that lives as long as the program, a string from the arena
+void nameIndexPut(NameIndex *index, const char *name, void *value) {
+    if (index->length == index->capacity) {
+        const int capacity = index->capacity == 0 ? 64 : index->capacity * 2;
+        NameEntry *entries = realloc(index->entries, sizeof(NameEntry) * capacity);
+        if (entries == NULL) return;
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    index->entries[index->length++] = (NameEntry) {name, value, false};
+}
+
+void nameIndexRemove(NameIndex *index, const char *name, const void *value) {
+    nameIndexSettle(index);
+    const NameEntry key = {name, (void *) value, false};
+    // a node freed and reused under the same name has a removed entry next to its live one
+    for (int i = nameIndexLowerBound(index, &key, false); i < index->sortedLength; i++) {
+        NameEntry *entry = &index->entries[i];
+        if (compareNameEntries(entry, &key) != 0) return;
+        if (!entry->removed) {
+            entry->removed = true;
+            index->removed++;
+            return;
+        }
+    }
+}
+
+// nameIndexGet returns the node with exactly this name, matching case
+void *nameIndexGet(NameIndex *index, const char *name) {
+    nameIndexSettle(index);
+    const NameEntry key = {name, NULL, false};
+    for (int i = nameIndexLowerBound(index, &key, false); i < index->sortedLength; i++) {
+        const NameEntry *entry = &index->entries[i];
+        if (strcmp(entry->name, name) != 0) break;
+        if (!entry->removed) return entry->value;
+    }
+    return NULL;
+}
+
+// nameIndexFind fills values with up to max nodes whose name starts with prefix, ignoring case, in name order
+int nameIndexFind(NameIndex *index, const char *prefix, void *values[], int max) {
+    nameIndexSettle(index);
+    const NameEntry key = {prefix, NULL, false};
+    const size_t prefixLength = strlen(prefix);
+    int count = 0;
+    for (int i = nameIndexLowerBound(index, &key, true); i < index->sortedLength && count < max; i++) {
+        const NameEntry *entry = &index->entries[i];
+        bool matches = true;
+        for (size_t j = 0; j < prefixLength && matches; j++) {
+            matches = tolower((unsigned char) entry->name[j]) == tolower((unsigned char) prefix[j]);
+        }
+        if (!matches) break;
+        if (!entry->removed) values[count++] = entry->value;
+    }
+    return count;
+}
+
+void *slabAlloc(Slab *slab) {
+    if (slab->freeList != NULL) {
+        void *node = slab->freeList;
+        slab->freeList = *(void **) node;
+        slab->allocated++;
+        return node;
+    }
+
+    if (slab->cursor == slab->end) {
+        // round the node size up so every node in the chunk stays aligned
+        const size_t alignment = _Alignof(max_align_t);
+        slab->nodeSize = (slab->nodeSize + alignment - 1) / alignment * alignment;
+
+        SlabChunk *chunk = malloc(offsetof(SlabChunk, align) + slab->nodeSize * slab->nodesPerChunk);
+        if (chunk == NULL) return NULL;
+        chunk->next = slab->chunks;
+        slab->chunks = chunk;
+        slab->cursor = (char *) &chunk->align;
+        slab->end = slab->cursor + slab->nodeSize * slab->nodesPerChunk;
+    }
+
+    void *node = slab->cursor;
+    slab->cursor += slab->nodeSize;
+    slab->allocated++;
+    return node;
+}
+
+void slabFree(Slab *slab, void *node) {
+    if (node == NULL) return;
+    *(void **) node = slab->freeList;
+    slab->freeList = node;
+    slab->allocated--;
+}
+
+void slabReset(Slab *slab) {
+    while (slab->chunks != NULL) {
+        SlabChunk *next = slab->chunks->next;
+        free(slab->chunks);
+        slab->chunks = next;
+    }
+    slab->freeList = NULL;
+    slab->cursor = NULL;
+    slab->end = NULL;
+    slab->allocated = 0;
+}
+
+// createOrder makes an order with a new id, the id is 0 if none could be handed out and the order can't be added
+Order *createOrder(int cashierId, PaymentType paymentType) {
+    Order *order = slabAlloc(&orderSlab);
+    order->id = nextId(ORDER_ID);
+    order->cashierId = cashierId;
+    order->paymentType = paymentType;
+    order->orderStatus = WAITING;
+    initOrderItems(order);
+    order->total = 0;
+    order->settledAt = 0;
+    order->next = NULL;
+    order->prev = NULL;
+    order->statusNext = NULL;
+    order->statusPrev = NULL;
+    order->inKitchen = false;
+    return order;
+}
+
+void initOrderItems(Order *order) {
+    order->items = order->inlineItems;
+    order->itemCount = 0;
+    order->itemCapacity = ORDER_INLINE_ITEMS;
+}
+
+// growOrderItems makes room for capacity items, moving them to the heap once the inline ones run out
+bool growOrderItems(Order *order, int capacity) {
+    if (capacity <= order->itemCapacity) return true;
+    Item *items = order->items == order->inlineItems ? malloc(sizeof(Item) * capacity)
+                                                     : realloc(order->items, sizeof(Item) * capacity);
+    if (items == NULL) return false;
+    if (order->items == order->inlineItems) memcpy(items, order->inlineItems, sizeof(Item) * order->itemCount);
+    order->items = items;
+    order->itemCapacity = capacity;
+    return true;
+}
+
+// appendItem adds a line with a new id to the order, it returns NULL if there is no memory for a bigger array
+// or no id
+Item *appendItem(Order *order, int stockId, int quantity) {
+    if (order->itemCount == order->itemCapacity && !growOrderItems(order, order->itemCapacity * 2)) return NULL;
+    const int id = nextId(ITEM_ID);
+    if (id == 0) return NULL;
+    Item *item = &order->items[order->itemCount++];
+    item->id = id;
+    item->stockId = stockId;
+    item->quantity = quantity;
+    item->price = 0;
+    item->use = NULL;
+    return item;
+}
+
+Item *findOrderItem(Order *order, int stockId) {
+    for (int i = 0; i < order->itemCount; i++) {
+        if (order->items[i].stockId == stockId) return &order->items[i];
+    }
+    return NULL;
+}
+
+void freeOrderItems(Order *order) {
+    if (order->items != order->inlineItems) free(order->items);
+    initOrderItems(order);
+}
+
+Order *findOrder(int id) {
+    return indexGet(&orders.index, id);
+}
+
+// linkOrderStatus appends the order to the list of its status, with salesLock held
+void linkOrderStatus(Order *order) {
+    const OrderStatus status = order->orderStatus;
+    order->statusNext = NULL;
+    order->statusPrev = orders.statusTails[status];
+    if (order->statusPrev != NULL) order->statusPrev->statusNext = order;
+    else orders.statusHeads[status] = order;
+    orders.statusTails[status] = order;
+    orders.statusLengths[status]++;
+}
+
+void unlinkOrderStatus(Order *order) {
+    const OrderStatus status = order->orderStatus;
+    if (order->statusPrev != NULL) order->statusPrev->statusNext = order->statusNext;
+    else orders.statusHeads[status] = order->statusNext;
+    if (order->statusNext != NULL) order->statusNext->statusPrev = order->statusPrev;
+    else orders.statusTails[status] = order->statusPrev;
+    orders.statusLengths[status]--;
+}
+
+void addOrder(Order *order) {
+    const long long started = metricStart();
+    if (!journalWrite(JOURNAL_ADD_ORDER,
+                      (int32_t[4]) {order->id, order->cashierId, order->paymentType, order->orderStatus}, NULL, 0)) {
+        metricEnd(METRIC_ADD_ORDER, started);
+        return;
+    }
+    // orders loaded from disk come with their items already attached. The units of a waiting one
+    // were taken out of the stock quantity when they were reserved, so they only count as reserved again.
+    order->total = 0;
+    order->settledAt = order->orderStatus == WAITING ? 0 : wallNanos();
+    for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+        order->total += (long long) item->quantity * item->price;
+        Stock *stock = order->orderStatus == WAITING ? findStock(item->stockId) : NULL;
+        if (stock != NULL) atomic_fetch_add(&stock->reserved, item->quantity);
+    }
+    // the list changes under the lock too, an open snapshot walks it from another thread
+    pthread_mutex_lock(&salesLock);
+    recordOrder(&sales, order, 1);
+    for (Item *item = order->items; item < order->items + order->itemCount; item++) linkStockUse(order, item);
+    linkOrderStatus(order);
+    order->addedIn = snapshot.version;
+    order->savedIn = 0;
+    order->next = NULL;
+    order->prev = NULL;
+    if (orders.head == NULL) {
+        orders.head = order;
+        orders.tail = order;
+        orders.length = 1;
+    } else {
+        orders.tail->next = order;
+        order->prev = orders.tail;
+        orders.tail = order;
+        orders.length++;
+    }
+    // the order is found by id before the change is noted, so a server sending the change finds it
+    indexPut(&orders.index, order->id, order);
+    noteChange(CHANGE_ORDER, order->id);
+    pthread_mutex_unlock(&salesLock);
+    metricEnd(METRIC_ADD_ORDER, started);
+}
+
+void removeOrder(int id) {
+    Order *order = findOrder(id);
+    if (order == NULL) return;
+    if (!journalWrite(JOURNAL_REMOVE_ORDER, (int32_t[4]) {id}, NULL, 0)) return;
+    if (order->orderStatus == WAITING) settleOrderStock(order, CANCELLED);
+    pthread_mutex_lock(&salesLock);
+    preserveOrder(order);
+    recordOrder(&sales, order, -1);
+    detachOrder(order);
+    indexRemove(&orders.index, order->id, order);
+    noteOrderChange(order, order->orderStatus == WAITING);
+    const bool retired = retireOrder(order);
+    pthread_mutex_unlock(&salesLock);
+    if (!retired) freeOrder(order);
+}
+
+// unlinkOrder takes an order out of memory without touching the sales totals, e.g. when it is archived
+void unlinkOrder(Order *order) {
+    pthread_mutex_lock(&salesLock);
+    preserveOrder(order);
+    detachOrder(order);
+    indexRemove(&orders.index, order->id, order);
+    noteChange(CHANGE_ORDER, order->id);
+    const bool retired = retireOrder(order);
+    pthread_mutex_unlock(&salesLock);
+    if (!retired) freeOrder(order);
+}
+
+// detachOrder takes an order out of the lists, with salesLock held. Its own next pointer is left as it is
+// so a snapshot reader standing on it can still step to the rest of the list.
+void detachOrder(Order *order) {
+    for (Item *item = order->items; item < order->items + order->itemCount; item++) unlinkStockUse(order, item);
+    unlinkOrderStatus(order);
+    if (order->prev != NULL) order->prev->next = order->next;
+    else orders.head = order->next;
+    if (order->next != NULL) order->next->prev = order->prev;
+    else orders.tail = order->prev;
+    orders.length--;
+}
+
+void freeOrder(Order *order) {
+    freeOrderItems(order);
+    slabFree(&orderSlab, order);
+}
+
+// clearOrders releases every order and item at once, e.g. at shift close. What waiting orders reserved goes back.
+// No snapshot may be open, it would be left reading freed orders.
+void clearOrders() {
+    for (Stock *stock = stocks.head; stock != NULL; stock = stock->next) {
+        atomic_fetch_add(&stock->quantity, atomic_exchange(&stock->reserved, 0));
+    }
+    // only orders that outgrew their inline items have anything to free besides the slab.
+    // Shared stocks also hold other processes' reservations, so this process gives back just its own.
+    for (Order *order = orders.head; order != NULL; order = order->next) {
+        for (const Item *item = order->items; order->orderStatus == WAITING && item < order->items + order->itemCount;
+             item++) {
+            const Stock *stock = findStock(item->stockId);
+            if (stock != NULL && stock->shared != NULL) sharedRelease(stock->shared, item->quantity);
+        }
+        if (order->items != order->inlineItems) free(order->items);
+    }
+    orders.head = NULL;
+    orders.tail = NULL;
+    orders.length = 0;
+    memset(orders.statusHeads, 0, sizeof(orders.statusHeads));
+    memset(orders.statusTails, 0, sizeof(orders.statusTails));
+    memset(orders.statusLengths, 0, sizeof(orders.statusLengths));
+    if (orders.index.entries != NULL) memset(orders.index.entries, 0, orders.index.capacity * sizeof(IndexEntry));
+    orders.index.length = 0;
+    slabReset(&orderSlab);
+    pthread_mutex_lock(&salesLock);
+    clearSales(&sales);
+    clearSales(&archivedSales);
+    clearStockUses();
+    pthread_mutex_unlock(&salesLock);
+}
+
+// findItemFromOrder copies the item of some order with units of the stock into found, preferring waiting orders,
+// and returns whether there is one. The order may change or go once the lock is released, so only a copy is
+// handed out, without the item's stock use.
+bool findItemFromOrder(int stockId, Item *found) {
+    const Item *item = NULL;
+    pthread_mutex_lock(&salesLock);
+    const StockUses *entry = indexGet(&stockUses.stocks, stockId);
+    for (int status = 0; entry != NULL && item == NULL && status < ORDER_STATUS_COUNT; status++) {
+        if (entry->heads[status] != NULL) item = findOrderItem(entry->heads[status]->order, stockId);
+    }
+    if (item != NULL) {
+        *found = *item;
+        found->use = NULL;
+    }
+    pthread_mutex_unlock(&salesLock);
+    return item != NULL;
+}
+
+// addItemToOrder reserves the units for a waiting order first, and fails if the stock can't cover them
+// or the quantity isn't positive
+bool addItemToOrder(Order *order, int stockId, int quantity) {
+    const long long started = metricStart();
+    Stock *stock = quantity > 0 ? findStock(stockId) : NULL;
+    if (stock == NULL || order->inKitchen) return metricResult(METRIC_ADD_ITEM, started, false);
+    const bool reserving = order->orderStatus == WAITING;
+    if (reserving && !reserveStock(stock, quantity)) return metricResult(METRIC_ADD_ITEM, started, false);
+
+    // a stock already on the order only gets more units, a new one needs its line before the record is written.
+    // The line is added under the lock since growing the items may move them while a snapshot copies them.
+    pthread_mutex_lock(&salesLock);
+    preserveOrder(order);
+    Item *found = findOrderItem(order, stockId);
+    const bool appended = found == NULL;
+    if (appended && (found = appendItem(order, stockId, 0)) != NULL) found->price = stock->price;
+    pthread_mutex_unlock(&salesLock);
+    if (found == NULL || !journalWrite(JOURNAL_ADD_ITEM, (int32_t[4]) {order->id, stockId, quantity}, NULL, 0)) {
+        if (found != NULL && appended) {
+            pthread_mutex_lock(&salesLock);
+            order->itemCount--;
+            pthread_mutex_unlock(&salesLock);
+        }
+        if (reserving) releaseStock(stock, quantity);
+        return metricResult(METRIC_ADD_ITEM, started, false);
+    }
+
+    pthread_mutex_lock(&salesLock);
+    found->quantity += quantity;
+    order->total += (long long) quantity * found->price;
+    recordSale(&sales, order, found, quantity);
+    linkStockUse(order, found);
+    noteChange(CHANGE_ORDER, order->id);
+    if (reserving) noteChange(CHANGE_STOCK, stockId);
+    pthread_mutex_unlock(&salesLock);
+    return metricResult(METRIC_ADD_ITEM, started, true);
+}
+
+// modifyItemOnOrder reserves the extra units when a waiting order's item grows and releases them when it shrinks,
+// a quantity of zero empties the line and a negative one is refused
+bool modifyItemOnOrder(Order *order, int stockId, int quantity) {
+    Item *item = order->inKitchen || quantity < 0 ? NULL : findOrderItem(order, stockId);
+    if (item == NULL) return false;
+
+    const int difference = quantity - item->quantity;
+    Stock *stock = order->orderStatus == WAITING ? findStock(stockId) : NULL;
+    if (stock != NULL && difference > 0 && !reserveStock(stock, difference)) return false;
+    if (!journalWrite(JOURNAL_MODIFY_ITEM, (int32_t[4]) {order->id, stockId, quantity}, NULL, 0)) {
+        if (stock != NULL && difference > 0) releaseStock(stock, difference);
+        return false;
+    }
+    if (stock != NULL && difference < 0) releaseStock(stock, -difference);
+
+    pthread_mutex_lock(&salesLock);
+    preserveOrder(order);
+    order->total += (long long) difference * item->price;
+    recordSale(&sales, order, item, difference);
+    item->quantity = quantity;
+    // an item taken down to no units no longer needs the stock
+    if (quantity > 0) linkStockUse(order, item);
+    else unlinkStockUse(order, item);
+    noteChange(CHANGE_ORDER, order->id);
+    if (stock != NULL) noteChange(CHANGE_STOCK, stockId);
+    pthread_mutex_unlock(&salesLock);
+    return true;
+}
+
+void setOrderStatus(Order *order, OrderStatus orderStatus) {
+    const long long started = metricStart();
+    if (!journalWrite(JOURNAL_SET_ORDER_STATUS, (int32_t[4]) {order->id, orderStatus}, NULL, 0)) {
+        metricEnd(METRIC_SET_STATUS, started);
+        return;
+    }
+    const bool settling = order->orderStatus == WAITING && orderStatus != WAITING;
+    if (settling) settleOrderStock(order, orderStatus);
+    // the order moves from the totals of its old status to those of the new one
+    pthread_mutex_lock(&salesLock);
+    preserveOrder(order);
+    recordOrder(&sales, order, -1);
+    moveStockUses(order, order->orderStatus, orderStatus);
+    unlinkOrderStatus(order);
+    order->orderStatus = orderStatus;
+    order->settledAt = orderStatus == WAITING ? 0 : wallNanos();
+    linkOrderStatus(order);
+    recordOrder(&sales, order, 1);
+    noteOrderChange(order, settling && orderStatus != COMPLETED);
+    pthread_mutex_unlock(&salesLock);
+    metricEnd(METRIC_SET_STATUS, started);
+}
+
+// claimOrder hands a waiting order to a chef, it returns false if it isn't waiting or another chef has it.
+// Orders are only claimed by the thread that owns the data, so the items don't change once it is claimed.
+bool claimOrder(Order *order) {
+    pthread_mutex_lock(&salesLock);
+    const bool claimed = order->orderStatus == WAITING && !order->inKitchen;
+    if (claimed) order->inKitchen = true;
+    pthread_mutex_unlock(&salesLock);
+    return claimed;
+}
+
+// unclaimOrder gives back an order no chef could take after all, e.g. when the kitchen is full
+void unclaimOrder(Order *order) {
+    pthread_mutex_lock(&salesLock);
+    order->inKitchen = false;
+    pthread_mutex_unlock(&salesLock);
+}
+
+// noteOrderChange notes a change to the order with salesLock held, with released also to the stocks
+// its units went back to
+void noteOrderChange(Order *order, bool released) {
+    noteChange(CHANGE_ORDER, order->id);
+    for (const Item *item = order->items; released && item < order->items + order->itemCount; item++) {
+        noteChange(CHANGE_STOCK, item->stockId);
+    }
+}
+
+SalesTotal *salesTotal(Sales *target, IdIndex *index, int id) {
+    SalesTotal *total = indexGet(index, id);
+    if (total == NULL) {
+        total = slabAlloc(&target->totals);
+        memset(total, 0, sizeof(SalesTotal));
+        total->id = id;
+        indexPut(index, id, total);
+    }
+    return total;
+}
+
+// recordSale adds quantity units of an item to the totals of the order's status, a negative quantity takes them away
+void recordSale(Sales *target, const Order *order, const Item *item, int quantity) {
+    const long long value = (long long) quantity * item->price;
+    target->summary.statusTotals[order->orderStatus] += value;
+    if (order->orderStatus == COMPLETED) {
+        target->summary.paymentRevenue[order->paymentType] += value;
+        salesTotal(target, &target->cashiers, order->cashierId)->revenue += value;
+        SalesTotal *stock = salesTotal(target, &target->stocks, item->stockId);
+        stock->quantity += quantity;
+        stock->revenue += value;
+    } else if (order->orderStatus == WAITING) {
+        salesTotal(target, &target->stocks, item->stockId)->waiting += quantity;
+    }
+}
+
+// recordOrder adds a whole order to the totals of its status when sign is 1, and takes it away when sign is -1
+void recordOrder(Sales *target, const Order *order, int sign) {
+    target->summary.orderCounts[order->orderStatus] += sign;
+    if (order->orderStatus == COMPLETED) salesTotal(target, &target->cashiers, order->cashierId)->orders += sign;
+    for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+        recordSale(target, order, item, sign * item->quantity);
+    }
+}
+
+void clearSales(Sales *target) {
+    memset(&target->summary, 0, sizeof(SalesSummary));
+    IdIndex *indexes[] = {&target->cashiers, &target->stocks};
+    for (int i = 0; i < 2; i++) {
+        if (indexes[i]->entries != NULL) memset(indexes[i]->entries, 0, indexes[i]->capacity * sizeof(IndexEntry));
+        indexes[i]->length = 0;
+    }
+    slabReset(&target->totals);
+}
+
+// mergeSales adds every total of source to target
+void mergeSales(Sales *target, const Sales *source) {
+    for (int i = 0; i < ORDER_STATUS_COUNT; i++) {
+        target->summary.orderCounts[i] += source->summary.orderCounts[i];
+        target->summary.statusTotals[i] += source->summary.statusTotals[i];
+    }
+    for (int i = 0; i < PAYMENT_TYPE_COUNT; i++) {
+        target->summary.paymentRevenue[i] += source->summary.paymentRevenue[i];
+    }
+    const IdIndex *sourceIndexes[] = {&source->cashiers, &source->stocks};
+    IdIndex *targetIndexes[] = {&target->cashiers, &target->stocks};
+    for (int i = 0; i < 2; i++) {
+        for (int j = 0; j < sourceIndexes[i]->capacity; j++) {
+            const SalesTotal *total = sourceIndexes[i]->entries[j].value;
+            if (total == NULL) continue;
+            SalesTotal *merged = salesTotal(target, targetIndexes[i], total->id);
+            merged->orders += total->orders;
+            merged->quantity += total->quantity;
+            merged->waiting += total->waiting;
+            merged->revenue += total->revenue;
+        }
+    }
+}
+
+void getSalesSummary(SalesSummary *summary) {
+    pthread_mutex_lock(&salesLock);
+    *summary = sales.summary;
+    pthread_mutex_unlock(&salesLock);
+}
+
+SalesTotal getCashierSales(int cashierId) {
+    pthread_mutex_lock(&salesLock);
+    const SalesTotal *total = indexGet(&sales.cashiers, cashierId);
+    const SalesTotal copy = total != NULL ? *total : (SalesTotal) {cashierId, 0, 0, 0, 0};
+    pthread_mutex_unlock(&salesLock);
+    return copy;
+}
+
+SalesTotal getStockSales(int stockId) {
+    pthread_mutex_lock(&salesLock);
+    const SalesTotal *total = indexGet(&sales.stocks, stockId);
+    const SalesTotal copy = total != NULL ? *total : (SalesTotal) {stockId, 0, 0, 0, 0};
+    pthread_mutex_unlock(&salesLock);
+    return copy;
+}
+
+// salesTotalsDiffer reports the first total of actual that doesn't match expected, a missing total counts as zero
+int salesTotalsDiffer(const IdIndex *actual, const IdIndex *expected, const char *kind, char report[], size_t size) {
+    for (int i = 0; i < actual->capacity; i++) {
+        const SalesTotal *total = actual->entries[i].value;
+        if (total == NULL) continue;
+        const SalesTotal *other = indexGet(expected, total->id);
+        const SalesTotal zero = {total->id, 0, 0, 0, 0};
+        if (other == NULL) other = &zero;
+        if (total->orders != other->orders || total->quantity != other->quantity ||
+            total->waiting != other->waiting || total->revenue != other->revenue) {
+            snprintf(report, size, "%s %d: revenue %lld, expected %lld", kind, total->id, total->revenue,
+                     other->revenue);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// checkSales recomputes every total from the orders and what archived orders added, and compares it with
+// the running totals. It returns how many totals are off and describes the first one in report. It walks
+// the order list, so it runs on the thread that adds and removes orders, the lock keeps the kitchen's status
+// changes out.
+int checkSales(char report[], size_t size) {
+    Sales expected = {
+        {{0}, {0}, {0}}, {NULL, 0, 0}, {NULL, 0, 0}, {sizeof(SalesTotal), 256, NULL, NULL, NULL, NULL, 0}
+    };
+    int mismatches = 0;
+    snprintf(report, size, "all totals match");
+
+    pthread_mutex_lock(&salesLock);
+    mergeSales(&expected, &archivedSales);
+    for (const Order *order = orders.head; order != NULL; order = order->next) {
+        recordOrder(&expected, order, 1);
+        long long total = 0;
+        for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+            total += (long long) item->quantity * item->price;
+        }
+        if (total != order->total && mismatches++ == 0) {
+            snprintf(report, size, "order %d: total %lld, expected %lld", order->id, order->total, total);
+        }
+    }
+
+    if (memcmp(&expected.summary, &sales.summary, sizeof(SalesSummary)) != 0 && mismatches++ == 0) {
+        snprintf(report, size, "revenue %lld, expected %lld", sales.summary.statusTotals[COMPLETED],
+                 expected.summary.statusTotals[COMPLETED]);
+    }
+    // each side is checked against the other so totals missing from either one are found
+    const IdIndex *pairs[4][2] = {
+        {&sales.cashiers, &expected.cashiers}, {&expected.cashiers, &sales.cashiers},
+        {&sales.stocks, &expected.stocks}, {&expected.stocks, &sales.stocks}
+    };
+    for (int i = 0; i < 4; i++) {
+        char first[128];
+        if (salesTotalsDiffer(pairs[i][0], pairs[i][1], i < 2 ? "cashier" : "stock", first, sizeof(first)) &&
+            mismatches++ == 0) {
+            snprintf(report, size, "%s", first);
+        }
+    }
+    pthread_mutex_unlock(&salesLock);
+
+    free(expected.cashiers.entries);
+    free(expected.stocks.entries);
+    slabReset(&expected.totals);
+    return mismatches;
+}
+
+StockUses *stockUsesOf(int stockId) {
+    StockUses *entry = indexGet(&stockUses.stocks, stockId);
+    if (entry == NULL) {
+        entry = slabAlloc(&stockUses.entries);
+        memset(entry, 0, sizeof(StockUses));
+        entry->stockId = stockId;
+        indexPut(&stockUses.stocks, stockId, entry);
+    }
+    return entry;
+}
+
+void pushStockUse(StockUses *entry, OrderStatus orderStatus, StockUse *use) {
+    use->prev = NULL;
+    use->next = entry->heads[orderStatus];
+    if (use->next != NULL) use->next->prev = use;
+    entry->heads[orderStatus] = use;
+    entry->counts[orderStatus]++;
+}
+
+void dropStockUse(StockUses *entry, OrderStatus orderStatus, StockUse *use) {
+    if (use->prev != NULL) use->prev->next = use->next;
+    else entry->heads[orderStatus] = use->next;
+    if (use->next != NULL) use->next->prev = use->prev;
+    entry->counts[orderStatus]--;
+}
+
+// linkStockUse adds an item with units to the uses of its stock, an item already there stays where it is
+void linkStockUse(Order *order, Item *item) {
+    if (item->use != NULL || item->quantity <= 0) return;
+    StockUse *use = slabAlloc(&stockUses.uses);
+    use->order = order;
+    pushStockUse(stockUsesOf(item->stockId), order->orderStatus, use);
+    item->use = use;
+}
+
+void unlinkStockUse(Order *order, Item *item) {
+    if (item->use == NULL) return;
+    dropStockUse(indexGet(&stockUses.stocks, item->stockId), order->orderStatus, item->use);
+    slabFree(&stockUses.uses, item->use);
+    item->use = NULL;
+}
+
+// moveStockUses moves the uses of an order's items to the lists of its new status
+void moveStockUses(Order *order, OrderStatus from, OrderStatus to) {
+    if (from == to) return;
+    for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+        if (item->use == NULL) continue;
+        StockUses *entry = indexGet(&stockUses.stocks, item->stockId);
+        dropStockUse(entry, from, item->use);
+        pushStockUse(entry, to, item->use);
+    }
+}
+
+// dropStockUses takes every use of a stock out of the index when the stock is removed, with salesLock held.
+// The items stay on their orders without a use.
+void dropStockUses(int stockId) {
+    StockUses *entry = indexGet(&stockUses.stocks, stockId);
+    if (entry == NULL) return;
+    for (int status = 0; status < ORDER_STATUS_COUNT; status++) {
+        for (StockUse *use = entry->heads[status], *next; use != NULL; use = next) {
+            next = use->next;
+            for (Item *item = use->order->items; item < use->order->items + use->order->itemCount; item++) {
+                if (item->use == use) item->use = NULL;
+            }
+            slabFree(&stockUses.uses, use);
+        }
+    }
+    indexRemove(&stockUses.stocks, stockId, entry);
+    slabFree(&stockUses.entries, entry);
+}
+
+// clearStockUses empties the index along with the orders, the items it pointed to are gone with them
+void clearStockUses() {
+    if (stockUses.stocks.entries != NULL) {
+        memset(stockUses.stocks.entries, 0, stockUses.stocks.capacity * sizeof(IndexEntry));
+    }
+    stockUses.stocks.length = 0;
+    slabReset(&stockUses.entries);
+    slabReset(&stockUses.uses);
+}
+
+int countStockUses(int stockId, OrderStatus orderStatus) {
+    pthread_mutex_lock(&salesLock);
+    const StockUses *entry = indexGet(&stockUses.stocks, stockId);
+    const int count = entry != NULL ? entry->counts[orderStatus] : 0;
+    pthread_mutex_unlock(&salesLock);
+    return count;
+}
+
+// findOrdersUsingStock fills found with up to max orders of the given status that have units of the stock,
+// e.g. the waiting orders hit by a stock running out. It costs the orders returned, not the orders there are.
+int findOrdersUsingStock(int stockId, OrderStatus orderStatus, Order *found[], int max) {
+    int count = 0;
+    pthread_mutex_lock(&salesLock);
+    const StockUses *entry = indexGet(&stockUses.stocks, stockId);
+    for (const StockUse *use = entry != NULL ? entry->heads[orderStatus] : NULL; use != NULL && count < max;
+         use = use->next) {
+        found[count++] = use->order;
+    }
+    pthread_mutex_unlock(&salesLock);
+    return count;
+}
+
+// checkStockUses compares the stock use index with the items of every order, the same way checkSales
+// does for the totals. It returns how many things are off and describes the first one in report.
+int checkStockUses(char report[], size_t size) {
+    int mismatches = 0;
+    long long linked = 0, listed = 0;
+    snprintf(report, size, "all stock uses match");
+
+    pthread_mutex_lock(&salesLock);
+    for (const Order *order = orders.head; order != NULL; order = order->next) {
+        for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+            const bool indexed = item->use != NULL && item->use->order == order;
+            // the items of a removed stock left the index with it, until a restart adds them again
+            if (indexed != (item->quantity > 0) && findStock(item->stockId) != NULL && mismatches++ == 0) {
+                snprintf(report, size, "order %d: stock %d is %s the stock use index", order->id, item->stockId,
+                         indexed ? "wrongly in" : "missing from");
+            }
+            linked += item->use != NULL;
+        }
+    }
+    for (int i = 0; i < stockUses.stocks.capacity; i++) {
+        const StockUses *entry = stockUses.stocks.entries[i].value;
+        for (int status = 0; entry != NULL && status < ORDER_STATUS_COUNT; status++) {
+            int count = 0;
+            for (const StockUse *use = entry->heads[status]; use != NULL; use = use->next, count++) {
+                if (use->order->orderStatus != (OrderStatus) status && mismatches++ == 0) {
+                    snprintf(report, size, "order %d: listed under stock %d as %s", use->order->id,
+                             entry->stockId, getOrderStatusName(status));
+                }
+            }
+            if (count != entry->counts[status] && mismatches++ == 0) {
+                snprintf(report, size, "stock %d: %d %s uses, counted %d", entry->stockId, count,
+                         getOrderStatusName(status), entry->counts[status]);
+            }
+            listed += count;
+        }
+    }
+    if (linked != listed && mismatches++ == 0) {
+        snprintf(report, size, "stock use index lists %lld uses, the orders have %lld", listed, linked);
+    }
+    pthread_mutex_unlock(&salesLock);
+    return mismatches;
+}
+
+Stock *findStock(int id) {
+    const long long started = metricStart();
+    pthread_rwlock_rdlock(&stocks.lock);
+    Stock *stock = indexGet(&stocks.index, id);
+    pthread_rwlock_unlock(&stocks.lock);
+    metricEnd(METRIC_FIND_STOCK, started);
+    return stock;
+}
+
+void addStock(Stock *stock) {
+    const char *name = stringAt(stock->name);
+    if (!journalWrite(JOURNAL_ADD_STOCK, (int32_t[4]) {stock->id, stock->price, stock->quantity}, name,
+                      strlen(name) + 1))
+        return;
+    linkStock(stock);
+}
+
+// linkStock puts a stock in the list and its indexes, for callers that wrote its journal record themselves
+void linkStock(Stock *stock) {
+    stock->shared = publishSharedStock(&sharedStocks, stock);
+    pthread_rwlock_wrlock(&stocks.lock);
+    indexPut(&stocks.index, stock->id, stock);
+    pthread_rwlock_unlock(&stocks.lock);
+    nameIndexPut(&stocks.names, stringAt(stock->name), stock);
+    stock->next = NULL;
+    stock->prev = NULL;
+    if (stocks.head == NULL) {
+        stocks.head = stock;
+        stocks.tail = stock;
+        stocks.length = 1;
+    } else {
+        stocks.tail->next = stock;
+        stock->prev = stocks.tail;
+        stocks.tail = stock;
+        stocks.length++;
+    }
+    noteChange(CHANGE_STOCK, stock->id);
+}
+
+// updateStock replaces what a stock is called, costs and has left, quantity is what can still be ordered
+// and doesn't touch what waiting orders reserved
+void updateStock(Stock *stock, const char *name, int price, int quantity) {
+    if (!journalWrite(JOURNAL_UPDATE_STOCK, (int32_t[4]) {stock->id, price, quantity}, name, strlen(name) + 1))
+        return;
+    const StringHandle handle = internString(name, NAME_SIZE);
+    if (handle != stock->name) {
+        nameIndexRemove(&stocks.names, stringAt(stock->name), stock);
+        stock->name = handle;
+        nameIndexPut(&stocks.names, stringAt(handle), stock);
+    }
+    stock->price = price;
+    setStockQuantity(stock, quantity);
+}
+
+// setStockQuantity sets what can still be ordered. A shared stock's record is set in one step, what other
+// processes reserved stays reserved.
+void setStockQuantity(Stock *stock, int quantity) {
+    if (stock->shared != NULL) sharedSetQuantity(stock->shared, quantity);
+    else atomic_store(&stock->quantity, quantity);
+    noteChange(CHANGE_STOCK, stock->id);
+}
+
+// removeStock refuses to take out a stock that waiting orders hold units of, they are cancelled or cooked first.
+// The settled orders keep their items but leave the stock use index, and a shared stock leaves the table.
+bool removeStock(Stock *stock) {
+    pthread_mutex_lock(&salesLock);
+    const StockUses *entry = indexGet(&stockUses.stocks, stock->id);
+    const bool waiting = entry != NULL && entry->counts[WAITING] > 0;
+    pthread_mutex_unlock(&salesLock);
+    if (waiting || !journalWrite(JOURNAL_REMOVE_STOCK, (int32_t[4]) {stock->id}, NULL, 0)) return false;
+    pthread_mutex_lock(&salesLock);
+    dropStockUses(stock->id);
+    pthread_mutex_unlock(&salesLock);
+    if (stock->shared != NULL) unpublishSharedStock(&sharedStocks, stock->shared);
+    pthread_rwlock_wrlock(&stocks.lock);
+    indexRemove(&stocks.index, stock->id, stock);
+    pthread_rwlock_unlock(&stocks.lock);
+    nameIndexRemove(&stocks.names, stringAt(stock->name), stock);
+    if (stock->prev != NULL) stock->prev->next = stock->next;
+    else stocks.head = stock->next;
+    if (stock->next != NULL) stock->next->prev = stock->prev;
+    else stocks.tail = stock->prev;
+    noteChange(CHANGE_STOCK, stock->id);
+    slabFree(&stockSlab, stock);
+    stocks.length--;
+    return true;
+}
+
+Stock *findStockByName(const char *name) {
+    return nameIndexGet(&stocks.names, name);
+}
+
+// findStocksByPrefix is the autocomplete of the order entry screen, it costs the prefix and the matches returned
+// rather than the size of the catalog
+int findStocksByPrefix(const char *prefix, Stock *found[], int max) {
+    const long long started = metricStart();
+    const int count = nameIndexFind(&stocks.names, prefix, (void **) found, max);
+    metricEnd(METRIC_SEARCH_STOCKS, started);
+    return count;
+}
+
+void incrementQuantity(int stockId, int quantity) {
+    Stock *stock = findStock(stockId);
+    if (stock == NULL) return;
+    if (!journalWrite(JOURNAL_INCREMENT_QUANTITY, (int32_t[4]) {stockId, quantity}, NULL, 0)) return;
+    if (stock->shared != NULL) sharedRestock(stock->shared, quantity);
+    else atomic_fetch_add(&stock->quantity, quantity);
+    noteChange(CHANGE_STOCK, stockId);
+}
+
+// decrementQuantity fails instead of taking the quantity below zero, or for a quantity that isn't positive.
+// Units are taken before the record is written and added after it, so a replayed journal never takes units
+// that weren't there.
+bool decrementQuantity(int stockId, int quantity) {
+    Stock *stock = quantity > 0 ? findStock(stockId) : NULL;
+    if (stock == NULL || !reserveStock(stock, quantity)) return false;
+    if (!journalWrite(JOURNAL_DECREMENT_QUANTITY, (int32_t[4]) {stockId, quantity}, NULL, 0)) {
+        releaseStock(stock, quantity);
+        return false;
+    }
+    commitStock(stock, quantity);
+    noteChange(CHANGE_STOCK, stockId);
+    return true;
+}
+
+// reserveStock moves units from quantity to reserved, the compare-and-swap retries if another thread
+// changed the quantity in between and gives up once it is too low. Only a positive quantity can be reserved,
+// a negative one would add units.
+bool reserveStock(Stock *stock, int quantity) {
+    if (quantity <= 0) return false;
+    if (stock->shared != NULL) return sharedReserve(stock->shared, quantity);
+    int available = atomic_load_explicit(&stock->quantity, memory_order_relaxed);
+    do {
+        if (available < quantity) return false;
+    } while (!atomic_compare_exchange_weak(&stock->quantity, &available, available - quantity));
+    atomic_fetch_add(&stock->reserved, quantity);
+    return true;
+}
+
+// commitStock uses up reserved units, e.g. when the order is cooked
+void commitStock(Stock *stock, int quantity) {
+    if (stock->shared != NULL) sharedCommit(stock->shared, quantity);
+    else atomic_fetch_sub(&stock->reserved, quantity);
+}
+
+// releaseStock gives reserved units back, e.g. when the order is cancelled
+void releaseStock(Stock *stock, int quantity) {
+    if (stock->shared != NULL) {
+        sharedRelease(stock->shared, quantity);
+        return;
+    }
+    atomic_fetch_add(&stock->quantity, quantity);
+    atomic_fetch_sub(&stock->reserved, quantity);
+}
+
+// settleOrderStock commits what a waiting order reserved when it is completed, and releases it otherwise
+void settleOrderStock(const Order *order, OrderStatus orderStatus) {
+    for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+        Stock *stock = findStock(item->stockId);
+        if (stock == NULL) continue;
+        if (orderStatus == COMPLETED) commitStock(stock, item->quantity);
+        else releaseStock(stock, item->quantity);
+    }
+}
+
+User *createUser(char name[], char hashedPassword[], UserType type) {
+    User *user = slabAlloc(&userSlab);
+    user->id = nextId(USER_ID);
+    user->name = internString(name, NAME_SIZE);
+    user->hashedPassword = internString(hashedPassword, HASHED_PASSWORD_SIZE);
+    user->type = type;
+    user->next = NULL;
+    user->prev = NULL;
+    return user;
+}
+
+User *findUser(int id) {
+    return indexGet(&users.index, id);
+}
+
+void addUser(User *user) {
+    // the text holds the name and the hashed password, each with its terminator
+    char text[NAME_SIZE + HASHED_PASSWORD_SIZE];
+    const char *name = stringAt(user->name), *hashedPassword = stringAt(user->hashedPassword);
+    const size_t nameLength = strlen(name) + 1;
+    const size_t passwordLength = strlen(hashedPassword) + 1;
+    memcpy(text, name, nameLength);
+    memcpy(text + nameLength, hashedPassword, passwordLength);
+    if (!journalWrite(JOURNAL_ADD_USER, (int32_t[4]) {user->id, user->type}, text, nameLength + passwordLength))
+        return;
+    indexPut(&users.index, user->id, user);
+    nameIndexPut(&users.names, name, user);
+    user->next = NULL;
+    user->prev = NULL;
+    if (users.head == NULL) {
+        users.head = user;
+        users.tail = user;
+        users.length = 1;
+    } else {
+        users.tail->next = user;
+        user->prev = users.tail;
+        users.tail = user;
+        users.length++;
+    }
+    noteChange(CHANGE_USER, user->id);
+}
+
+void removeUser(User *user) {
+    if (!journalWrite(JOURNAL_REMOVE_USER, (int32_t[4]) {user->id}, NULL, 0)) return;
+    indexRemove(&users.index, user->id, user);
+    nameIndexRemove(&users.names, stringAt(user->name), user);
+    if (user->prev != NULL) user->prev->next = user->next;
+    else users.head = user->next;
+    if (user->next != NULL) user->next->prev = user->prev;
+    else users.tail = user->prev;
+    noteChange(CHANGE_USER, user->id);
+    slabFree(&userSlab, user);
+    users.length--;
+}
+
+void changePassword(User *user, char hashedPassword[]) {
+    if (!journalWrite(JOURNAL_CHANGE_PASSWORD, (int32_t[4]) {user->id}, hashedPassword, strlen(hashedPassword) + 1))
+        return;
+    user->hashedPassword = internString(hashedPassword, HASHED_PASSWORD_SIZE);
+}
+
+// registerUser adds a new user, nothing is added if no id could be handed out
+void registerUser(char name[], char password[], UserType type) {
+    char hashed[HASHED_PASSWORD_SIZE];
+    hashPassword(password, hashed);
+    User *user = createUser(name, hashed, type);
+    if (user->id == 0) {
+        slabFree(&userSlab, user);
+        return;
+    }
+    addUser(user);
+}
+
+void hashPassword(char password[], char hashedPassword[]) {
+    // let's say abc, where a = 97, b = 98, c = 99
+    int passwordLength = strlen(password);
+    for (int i = 0; i < passwordLength; i++) {
+        hashedPassword[i] = password[i] + (i * 7) % 26;
+        // a = 97 + (0 * 7) % 26 = 97 + (0 * 7) = 97
+        // b = 98 + (1 * 7) % 26 = 98 + (1 * 7) = 105
+        // c = 99 + (2 * 7) % 26 = 99 + (2 * 7) = 106
+    }
+    hashedPassword[passwordLength] = '\0';
+}
+
+bool verifyPassword(User *user, char password[]) {
+    const long long started = metricStart();
+    char hashedPassword[HASHED_PASSWORD_SIZE];
+    hashPassword(password, hashedPassword);
+    return metricResult(METRIC_LOGIN, started, strcmp(stringAt(user->hashedPassword), hashedPassword) == 0);
+}
+
+User *findUserByName(const char *name) {
+    return nameIndexGet(&users.names, name);
+}
+
+bool isLogged() {
+    return loggedUser != NULL;
+}
+
+// getItemNames writes the items as "name xN, name xN" into buffer, cut off at its size
+char *getItemNames(const Order *order, char buffer[], size_t size) {
+    size_t length = 0;
+    buffer[0] = '\0';
+    for (const Item *item = order->items; item < order->items + order->itemCount && length < size; item++) {
+        const Stock *stock = findStock(item->stockId);
+        const int written = snprintf(buffer + length, size - length, "%s%s x%d", item == order->items ? "" : ", ",
+                                     stock != NULL ? stringAt(stock->name) : "?", item->quantity);
+        if (written < 0) break;
+        length += written;
+    }
+    return buffer;
+}
+
+// formatOrderRow writes the row of an order on the order board into buffer
+char *formatOrderRow(const Order *order, char buffer[], size_t size) {
+    char items[128];
+    const User *cashier = findUser(order->cashierId);
+    snprintf(buffer, size, "| %-5d | %-10s | %-10s | %-10s | %-25s |", order->id,
+             cashier != NULL ? stringAt(cashier->name) : "-", getPaymentName(order->paymentType),
+             getOrderStatusName(order->orderStatus), getItemNames(order, items, sizeof(items)));
+    return buffer;
+}
+
+void initOrderBoard(OrderBoard *board, int rows, int statusFilter) {
+    board->topId = 0;
+    board->selectedId = 0;
+    board->statusFilter = statusFilter;
+    board->rows = rows > 0 ? rows : 1;
+}
+
+bool boardMatches(const OrderBoard *board, const Order *order) {
+    return board->statusFilter == BOARD_ALL_STATUSES || order->orderStatus == (OrderStatus) board->statusFilter;
+}
+
+// boardStep returns the next order shown on the board after order, or before it if direction is negative.
+// A filtered board follows the list of its status, only an order the filter hides walks the whole list.
+Order *boardStep(const OrderBoard *board, Order *order, int direction) {
+    if (board->statusFilter != BOARD_ALL_STATUSES && boardMatches(board, order)) {
+        return direction < 0 ? order->statusPrev : order->statusNext;
+    }
+    do {
+        order = direction < 0 ? order->prev : order->next;
+    } while (order != NULL && !boardMatches(board, order));
+    return order;
+}
+
+// boardResolve finds the order remembered by id. If it is filtered out the nearest shown order is used,
+// and if it was removed the first shown order is used
+Order *boardResolve(const OrderBoard *board, int id) {
+    Order *order = id != 0 ? findOrder(id) : NULL;
+    if (order == NULL && board->statusFilter != BOARD_ALL_STATUSES) return orders.statusHeads[board->statusFilter];
+    if (order == NULL) order = orders.head;
+    if (order == NULL || boardMatches(board, order)) return order;
+    Order *next = boardStep(board, order, 1);
+    return next != NULL ? next : boardStep(board, order, -1);
+}
+
+Order *boardTop(OrderBoard *board) {
+    Order *top = boardResolve(board, board->topId);
+    board->topId = top != NULL ? top->id : 0;
+    return top;
+}
+
+Order *boardSelected(OrderBoard *board) {
+    Order *selected = boardResolve(board, board->selectedId);
+    board->selectedId = selected != NULL ? selected->id : 0;
+    return selected;
+}
+
+// boardScrollTo moves the window so the selected order is on it, at the top when scrolling up
+// and at the bottom when scrolling down
+void boardScrollTo(OrderBoard *board, Order *selected, int direction) {
+    Order *order = boardTop(board);
+    for (int row = 0; order != NULL && row < board->rows; row++, order = boardStep(board, order, 1)) {
+        if (order == selected) return;
+    }
+
+    Order *top = selected;
+    for (int row = 1; direction > 0 && row < board->rows; row++) {
+        Order *previous = boardStep(board, top, -1);
+        if (previous == NULL) break;
+        top = previous;
+    }
+    board->topId = top->id;
+}
+
+// boardMove moves the selection by delta rows, scrolling the window along with it
+void boardMove(OrderBoard *board, int delta) {
+    Order *selected = boardSelected(board);
+    if (selected == NULL) return;
+    for (int i = 0; i < abs(delta); i++) {
+        Order *next = boardStep(board, selected, delta);
+        if (next == NULL) break;
+        selected = next;
+    }
+    board->selectedId = selected->id;
+    boardScrollTo(board, selected, delta);
+}
+
+void boardHome(OrderBoard *board) {
+    Order *first = board->statusFilter == BOARD_ALL_STATUSES ? orders.head : orders.statusHeads[board->statusFilter];
+    board->topId = first != NULL ? first->id : 0;
+    board->selectedId = board->topId;
+}
+
+void boardEnd(OrderBoard *board) {
+    Order *last = board->statusFilter == BOARD_ALL_STATUSES ? orders.tail : orders.statusTails[board->statusFilter];
+    if (last == NULL) return;
+    board->selectedId = last->id;
+    boardScrollTo(board, last, 1);
+}
+
+// boardJump selects the order with the given id and scrolls it to the top, the filter is dropped if it hides the order
+bool boardJump(OrderBoard *board, int id) {
+    Order *order = findOrder(id);
+    if (order == NULL) return false;
+    if (!boardMatches(board, order)) board->statusFilter = BOARD_ALL_STATUSES;
+    board->selectedId = order->id;
+    board->topId = order->id;
+    return true;
+}
+
+// boardSetFilter shows only orders with the given status, keeping the selection near where it was
+void boardSetFilter(OrderBoard *board, int statusFilter) {
+    board->statusFilter = statusFilter;
+    Order *selected = boardSelected(board);
+    board->topId = selected != NULL ? selected->id : 0;
+}
+
+// boardVisible fills visible with the orders on the window, at most board->rows of them, and returns how many
+int boardVisible(OrderBoard *board, Order *visible[]) {
+    int count = 0;
+    for (Order *order = boardTop(board); order != NULL && count < board->rows; order = boardStep(board, order, 1)) {
+        visible[count++] = order;
+    }
+    return count;
+}
+
+char *getPaymentName(PaymentType paymentType) {
+    switch (paymentType) {
+        case PAYPAL: return "PayPal";
+        case CREDIT_CARD: return "Credit Card";
+        case DEBIT_CARD: return "Debit Card";
+        case CASH: return "Cash";
+        default: return "Unknown";
+    }
+}
+
+// getStockQuantity reads what can still be ordered, from the shared table when the stock is on it
+int getStockQuantity(const Stock *stock) {
+    return stock->shared != NULL ? sharedQuantity(stock->shared) : atomic_load(&stock->quantity);
+}
+
+int getStockReserved(const Stock *stock) {
+    return stock->shared != NULL ? sharedReserved(stock->shared) : atomic_load(&stock->reserved);
+}
+
+char *getOrderStatusName(OrderStatus orderStatus) {
+    switch (orderStatus) {
+        case WAITING: return "Waiting";
+        case CANCELLED: return "Cancelled";
+        case COMPLETED: return "Completed";
+        default: return "Unknown";
+    }
+}
+
+Stock *createStock(char *name, int price, int quantity) {
+    Stock *stock = slabAlloc(&stockSlab);
+    stock->id = nextId(STOCK_ID);
+    stock->name = internString(name, NAME_SIZE);
+    stock->price = price;
+    stock->quantity = quantity;
+    stock->reserved = 0;
+    stock->shared = NULL;
+    stock->next = NULL;
+    stock->prev = NULL;
+    return stock;
+}
+
+// openChangeLog starts noting changes, capacity is a power of two
+bool openChangeLog(uint32_t capacity) {
+    if (changes.entries != NULL) return true;
+    changes.entries = malloc(sizeof(ChangeEntry) * capacity);
+    if (changes.entries == NULL) return false;
+    changes.capacity = capacity;
+    changes.end = 1;
+    return true;
+}
+
+void noteChange(ChangeKind kind, int id) {
+    if (changes.entries == NULL) return;
+    pthread_mutex_lock(&changes.lock);
+    changes.entries[changes.end & (changes.capacity - 1)] = (ChangeEntry) {kind, id};
+    changes.end++;
+    pthread_mutex_unlock(&changes.lock);
+}
+
+// changeLogStart is the oldest version the log still has the changes after
+uint32_t changeLogStart() {
+    pthread_mutex_lock(&changes.lock);
+    const uint32_t start = changes.end > changes.capacity ? changes.end - changes.capacity : 1;
+    pthread_mutex_unlock(&changes.lock);
+    return start;
+}
+
+// changeAt reads the change that made the version after the given one, false if the log doesn't have it anymore
+bool changeAt(uint32_t version, ChangeEntry *entry) {
+    pthread_mutex_lock(&changes.lock);
+    const bool kept = changes.end - version <= changes.capacity && version != changes.end;
+    if (kept) *entry = changes.entries[version & (changes.capacity - 1)];
+    pthread_mutex_unlock(&changes.lock);
+    return kept;
+}
+
+uint32_t changeLogEnd() {
+    pthread_mutex_lock(&changes.lock);
+    const uint32_t end = changes.end;
+    pthread_mutex_unlock(&changes.lock);
+    return end;
+}
+
+long long nowNanos() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart * 1000000000LL / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+}
+
+// wallNanos is the time of day since 1970, for times that are compared across restarts
+long long wallNanos() {
+#ifdef _WIN32
+    FILETIME time;
+    GetSystemTimeAsFileTime(&time);
+    const long long ticks = (long long) time.dwHighDateTime << 32 | time.dwLowDateTime;
+    return (ticks - 116444736000000000LL) * 100;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+}
+
+int compareInts(const void *a, const void *b) {
+    const int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+int compareLongLongs(const void *a, const void *b) {
+    const long long x = *(const long long *) a, y = *(const long long *) b;
+    return (x > y) - (x < y);
+}
@@ -0,0 +1,584 @@
+#ifndef RESTAURANT_H
+#define RESTAURANT_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+// most orders have a handful of lines, they are stored inside the order up to this many
+#define ORDER_INLINE_ITEMS 8
+
+// ids are claimed from the shared sequence in blocks per thread, and leased from ids.dat in larger steps
+#define ID_BLOCK_SIZE 64
+#define ID_LEASE_SIZE 65536
+
+// the longest names and hashed passwords kept, with their terminator
+#define NAME_SIZE 101
+#define HASHED_PASSWORD_SIZE 201
+
+// the lengths a new user's name and password must have, in the terminal and over the server
+#define USER_NAME_MIN 4
+#define USER_NAME_MAX 20
+#define USER_PASSWORD_MIN 6
+#define USER_PASSWORD_MAX 50
+
+// the string arena grows in chunks of this many bytes, a handle is the chunk in its high 16 bits
+// and the offset in the chunk in its low 16 bits
+#define STRING_CHUNK_BITS 16
+#define STRING_CHUNK_SIZE (1 << STRING_CHUNK_BITS)
+#define STRING_MAX_CHUNKS 4096
+
+typedef enum { PAYPAL, CREDIT_CARD, DEBIT_CARD, CASH } PaymentType;
+
+typedef enum { WAITING, CANCELLED, COMPLETED } OrderStatus;
+
+typedef enum { CHANGE_ORDER, CHANGE_STOCK, CHANGE_USER } ChangeKind;
+
+#define PAYMENT_TYPE_COUNT 4
+#define ORDER_STATUS_COUNT 3
+
+typedef enum { CHEF, CASHIER, ADMIN } UserType;
+
+typedef enum { ORDER_ID, ITEM_ID, STOCK_ID, USER_ID, ID_KIND_COUNT } IdKind;
+
+typedef struct Order Order;
+typedef struct Item Item;
+typedef struct Stock Stock;
+typedef struct SharedStock SharedStock;
+typedef struct User User;
+typedef struct StockUse StockUse;
+
+// StringHandle is a string in the string arena, 0 is the empty string
+typedef uint32_t StringHandle;
+
+// Item is one line of an order, an order has at most one line per stock
+struct Item {
+    int id;
+    int stockId;
+    int quantity;
+    // price is the stock price when the item was first ordered
+    int price;
+    // use is the item's entry in the stock use index, NULL while the item isn't in it
+    StockUse *use;
+};
+
+// Order is a struct that contains the information of an order.
+// Its items are an array that starts in inlineItems and moves to the heap once the order outgrows it,
+// orders never move so items can point into the order itself.
+struct Order {
+    int id;
+    int cashierId;
+    PaymentType paymentType;
+    OrderStatus orderStatus;
+    Item *items;
+    int itemCount;
+    int itemCapacity;
+    // total is the value of the items, kept up to date as they change
+    long long total;
+    // settledAt is when the order left WAITING, or when it was loaded if it had already, by wallNanos
+    long long settledAt;
+
+    Order *next;
+    Order *prev;
+    // statusNext and statusPrev link the orders with the same status, in the order they got it
+    Order *statusNext;
+    Order *statusPrev;
+    // addedIn is the last snapshot opened before the order was added, savedIn the last one that has its state
+    unsigned int addedIn;
+    unsigned int savedIn;
+    // inKitchen is set once the order is placed and a chef has it, its items don't change after that
+    bool inKitchen;
+
+    Item inlineItems[ORDER_INLINE_ITEMS];
+};
+
+// quantity is what can still be ordered, reserved is what waiting orders hold until they are cooked or cancelled.
+// Both change through compare-and-swap and atomic adds so cashiers on several threads can't oversell.
+// shared is the stock's record when terminals share the stock table, its units are then the ones that count.
+// The name is only read for display and lookups by name, so it lives in the string arena and the node keeps
+// what walking the list touches.
+struct Stock {
+    int id;
+    int price;
+    _Atomic int quantity;
+    _Atomic int reserved;
+    StringHandle name;
+    SharedStock *shared;
+
+    Stock *next;
+    Stock *prev;
+};
+
+// name and hashedPassword are in the string arena, like a stock's name
+struct User {
+    int id;
+    UserType type;
+    StringHandle name;
+    StringHandle hashedPassword;
+
+    User *next;
+    User *prev;
+};
+
+struct Buyer {
+    int id;
+
+};
+
+// IndexEntry is a slot of an open addressing hash index, an empty slot has a NULL value
+typedef struct {
+    int id;
+    void *value;
+} IndexEntry;
+
+// IdIndex maps an id to its list node so lookups don't walk the list
+typedef struct {
+    IndexEntry *entries;
+    int capacity;
+    int length;
+} IdIndex;
+
+// NameEntry is a name in a name index. The name is the node's string in the arena, which outlives the node,
+// so a removed entry can still be compared until it is dropped.
+typedef struct {
+    const char *name;
+    void *value;
+    bool removed;
+} NameEntry;
+
+// NameIndex keeps names sorted, ignoring case, for exact and prefix lookups. New names are appended
+// and merged into the sorted part on the next lookup, removed names are marked and dropped on a later merge.
+typedef struct {
+    NameEntry *entries;
+    int length;
+    int sortedLength;
+    int removed;
+    int capacity;
+} NameIndex;
+
+// OrderList links every order in the order it was added, and the orders of each status in their own list
+// so views of one status and the archiver never walk past the others
+typedef struct {
+    Order *head;
+    Order *tail;
+    int length;
+    IdIndex index;
+    Order *statusHeads[ORDER_STATUS_COUNT];
+    Order *statusTails[ORDER_STATUS_COUNT];
+    int statusLengths[ORDER_STATUS_COUNT];
+} OrderList;
+
+// StockList is changed by the thread that owns the data, chefs on other threads look stocks up
+// by id while they settle orders, so the id index changes under the lock
+typedef struct {
+    Stock *head;
+    Stock *tail;
+    int length;
+    IdIndex index;
+    NameIndex names;
+    pthread_rwlock_t lock;
+} StockList;
+
+typedef struct {
+    User *head;
+    User *tail;
+    int length;
+    IdIndex index;
+    NameIndex names;
+} UserList;
+
+// StringArena keeps every interned string once, in chunks that never move so a string can be read
+// without the lock. Strings are never freed, a removed name stays until the program exits and is
+// reused if the name comes back. The slots are an open addressing hash of the handles, 0 is an empty slot.
+typedef struct {
+    char *chunks[STRING_MAX_CHUNKS];
+    int chunkCount;
+    uint32_t used;
+    StringHandle *slots;
+    int capacity;
+    int length;
+    size_t bytes;
+    pthread_mutex_t lock;
+} StringArena;
+
+typedef struct SlabChunk SlabChunk;
+
+// SlabChunk is a contiguous block of nodes, the nodes are laid out right after the header
+struct SlabChunk {
+    SlabChunk *next;
+    max_align_t align;
+};
+
+// Slab hands out fixed size nodes from contiguous chunks and recycles freed nodes through a free list
+typedef struct {
+    size_t nodeSize;
+    int nodesPerChunk;
+    SlabChunk *chunks;
+    void *freeList;
+    char *cursor;
+    char *end;
+    int allocated;
+} Slab;
+
+// SalesTotal is the running total of one cashier or one stock. Cashiers count completed orders,
+// stocks count units on completed orders (quantity) and on waiting ones (waiting).
+typedef struct {
+    int id;
+    int orders;
+    long long quantity;
+    long long waiting;
+    long long revenue;
+} SalesTotal;
+
+// SalesSummary holds the totals that don't grow with the data, so a report can copy them at once
+typedef struct {
+    int orderCounts[ORDER_STATUS_COUNT];
+    long long statusTotals[ORDER_STATUS_COUNT];
+    long long paymentRevenue[PAYMENT_TYPE_COUNT];
+} SalesSummary;
+
+// Sales is updated on every order and item change, so reports never walk the orders.
+// Revenue only counts completed orders.
+typedef struct {
+    SalesSummary summary;
+    IdIndex cashiers;
+    IdIndex stocks;
+    Slab totals;
+} Sales;
+
+// StockUse is an order with units of a stock on it, in the list of the stock's uses for the order's status
+struct StockUse {
+    Order *order;
+    StockUse *next;
+    StockUse *prev;
+};
+
+// StockUses lists the orders with units of one stock, one list per order status
+typedef struct {
+    int stockId;
+    StockUse *heads[ORDER_STATUS_COUNT];
+    int counts[ORDER_STATUS_COUNT];
+} StockUses;
+
+// StockUseIndex answers which orders need a stock without walking the orders. An item is in it while
+// its order is in the order list and it has units, it changes with the sales totals under salesLock.
+typedef struct {
+    IdIndex stocks;
+    Slab entries;
+    Slab uses;
+} StockUseIndex;
+
+// IdSequence hands out ids of one kind, every id below leased is recorded in ids.dat
+// so ids handed out before a restart are never handed out again
+typedef struct {
+    _Atomic int64_t next;
+    _Atomic int64_t leased;
+} IdSequence;
+
+// OrderBoard is a window over the order list, drawing it only visits the orders inside the window.
+// It remembers ids instead of nodes so orders removed meanwhile don't leave it dangling.
+typedef struct {
+    int topId;
+    int selectedId;
+    int statusFilter;
+    int rows;
+} OrderBoard;
+
+// statusFilter of a board that shows every order
+#define BOARD_ALL_STATUSES (-1)
+
+typedef struct {
+    int32_t kind;
+    int32_t id;
+} ChangeEntry;
+
+// ChangeLog lists which orders, stocks and users changed, in the order they changed, so a server only sends
+// a replica what changed since its version. Versions count the changes from 1, end is the version after the
+// last one and only the last capacity changes are kept. Order changes are noted under salesLock once they are
+// made, so the log and the orders read under the lock agree. Without openChangeLog nothing is noted.
+typedef struct {
+    ChangeEntry *entries;
+    uint32_t capacity;
+    uint32_t end;
+    pthread_mutex_t lock;
+} ChangeLog;
+
+extern Slab orderSlab;
+extern Slab stockSlab;
+extern Slab userSlab;
+
+extern StringArena strings;
+
+extern IdSequence idSequences[ID_KIND_COUNT];
+extern pthread_mutex_t idLeaseLock;
+
+extern OrderList orders;
+extern StockList stocks;
+extern UserList users;
+
+extern User *loggedUser;
+
+extern Sales sales;
+extern Sales archivedSales;
+extern pthread_mutex_t salesLock;
+
+extern StockUseIndex stockUses;
+
+extern ChangeLog changes;
+
+// id functions, every new order, item, stock and user gets its id from nextId
+int nextId(IdKind kind);
+
+bool leaseIds(IdKind kind, int64_t end);
+
+void reserveIds(IdKind kind, int64_t id);
+
+// slab allocator functions, every list node is allocated and freed through these
+void *slabAlloc(Slab *slab);
+
+void slabFree(Slab *slab, void *node);
+
+void slabReset(Slab *slab);
+
+// hash index functions, used by the lists to find a node by id
+unsigned int hashId(int id);
+
+void *indexGet(const IdIndex *index, int id);
+
+void indexGrow(IdIndex *index);
+
+void indexPut(IdIndex *index, int id, void *value);
+
+void indexRemove(IdIndex *index, int id, const void *value);
+
+// string arena functions, stock and user names and passwords are kept through these
+uint32_t hashString(const char *text, size_t length);
+
+bool growStrings();
+
+StringHandle internString(const char *text, size_t size);
+
+const char *stringAt(StringHandle handle);
+
+// name index functions, used by the stock and user lists to find nodes by name or name prefix
+int compareNames(const char *a, const char *b);
+
+int compareNameEntries(const void *a, const void *b);
+
+void nameIndexSettle(NameIndex *index);
+
+int nameIndexLowerBound(const NameIndex *index, const NameEntry *key, bool ignoreCase);
+
+void nameIndexPut(NameIndex *index, const char *name, void *value);
+
+void nameIndexRemove(NameIndex *index, const char *name, const void *value);
+
+void *nameIndexGet(NameIndex *index, const char *name);
+
+int nameIndexFind(NameIndex *index, const char *prefix, void *values[], int max);
+
+// linked list functions for orders
+Order *createOrder(int cashierId, PaymentType paymentType);
+
+void initOrderItems(Order *order);
+
+bool growOrderItems(Order *order, int capacity);
+
+Item *appendItem(Order *order, int stockId, int quantity);
+
+Item *findOrderItem(Order *order, int stockId);
+
+void freeOrderItems(Order *order);
+
+Order *findOrder(int id);
+
+void linkOrderStatus(Order *order);
+
+void unlinkOrderStatus(Order *order);
+
+void addOrder(Order *order);
+
+void detachOrder(Order *order);
+
+void freeOrder(Order *order);
+
+void unlinkOrder(Order *order);
+
+void removeOrder(int id);
+
+void clearOrders();
+
+bool findItemFromOrder(int stockId, Item *found);
+
+bool addItemToOrder(Order *order, int stockId, int quantity);
+
+bool modifyItemOnOrder(Order *order, int stockId, int quantity);
+
+void setOrderStatus(Order *order, OrderStatus orderStatus);
+
+bool claimOrder(Order *order);
+
+void unclaimOrder(Order *order);
+
+void noteOrderChange(Order *order, bool released);
+
+char *getItemNames(const Order *order, char buffer[], size_t size);
+
+char *formatOrderRow(const Order *order, char buffer[], size_t size);
+
+char *getPaymentName(PaymentType paymentType);
+
+char *getOrderStatusName(OrderStatus orderStatus);
+
+// order board functions, each costs the number of rows on the board rather than the number of orders
+void initOrderBoard(OrderBoard *board, int rows, int statusFilter);
+
+bool boardMatches(const OrderBoard *board, const Order *order);
+
+Order *boardStep(const OrderBoard *board, Order *order, int direction);
+
+Order *boardResolve(const OrderBoard *board, int id);
+
+Order *boardSelected(OrderBoard *board);
+
+Order *boardTop(OrderBoard *board);
+
+void boardScrollTo(OrderBoard *board, Order *selected, int direction);
+
+void boardMove(OrderBoard *board, int delta);
+
+void boardHome(OrderBoard *board);
+
+void boardEnd(OrderBoard *board);
+
+bool boardJump(OrderBoard *board, int id);
+
+void boardSetFilter(OrderBoard *board, int statusFilter);
+
+int boardVisible(OrderBoard *board, Order *visible[]);
+
+// sales functions, every order and item change records its difference to the totals under salesLock
+SalesTotal *salesTotal(Sales *target, IdIndex *index, int id);
+
+void recordSale(Sales *target, const Order *order, const Item *item, int quantity);
+
+void recordOrder(Sales *target, const Order *order, int sign);
+
+void clearSales(Sales *target);
+
+void mergeSales(Sales *target, const Sales *source);
+
+void getSalesSummary(SalesSummary *summary);
+
+SalesTotal getCashierSales(int cashierId);
+
+SalesTotal getStockSales(int stockId);
+
+int salesTotalsDiffer(const IdIndex *actual, const IdIndex *expected, const char *kind, char report[], size_t size);
+
+int checkSales(char report[], size_t size);
+
+// stock use index functions, the callers hold salesLock except for the queries which take it themselves
+StockUses *stockUsesOf(int stockId);
+
+void pushStockUse(StockUses *entry, OrderStatus orderStatus, StockUse *use);
+
+void dropStockUse(StockUses *entry, OrderStatus orderStatus, StockUse *use);
+
+void linkStockUse(Order *order, Item *item);
+
+void unlinkStockUse(Order *order, Item *item);
+
+void moveStockUses(Order *order, OrderStatus from, OrderStatus to);
+
+void dropStockUses(int stockId);
+
+void clearStockUses();
+
+int countStockUses(int stockId, OrderStatus orderStatus);
+
+int findOrdersUsingStock(int stockId, OrderStatus orderStatus, Order *found[], int max);
+
+int checkStockUses(char report[], size_t size);
+
+// linked list functions for stocks
+Stock *createStock(char name[], int price, int quantity);
+
+Stock *findStock(int id);
+
+void addStock(Stock *stock);
+
+void linkStock(Stock *stock);
+
+void updateStock(Stock *stock, const char *name, int price, int quantity);
+
+void setStockQuantity(Stock *stock, int quantity);
+
+bool removeStock(Stock *stock);
+
+Stock *findStockByName(const char *name);
+
+int findStocksByPrefix(const char *prefix, Stock *found[], int max);
+
+void incrementQuantity(int id, int amount);
+
+bool decrementQuantity(int id, int amount);
+
+// stock reservation functions, an order reserves its items while waiting and commits or releases them when it leaves
+bool reserveStock(Stock *stock, int quantity);
+
+void commitStock(Stock *stock, int quantity);
+
+void releaseStock(Stock *stock, int quantity);
+
+void settleOrderStock(const Order *order, OrderStatus orderStatus);
+
+int getStockQuantity(const Stock *stock);
+
+int getStockReserved(const Stock *stock);
+
+// linked list functions for users
+User *createUser(char name[], char hashedPassword[], UserType type);
+
+User *findUser(int id);
+
+User *findUserByName(const char *name);
+
+void addUser(User *user);
+
+void removeUser(User *user);
+
+void changePassword(User *user, char hashedPassword[]);
+
+// functions for user management
+void registerUser(char name[], char password[], UserType type);
+
+void hashPassword(char password[], char hashedPassword[]);
+
+bool verifyPassword(User *user, char password[]);
+
+bool isLogged();
+
+// functions for the change log
+bool openChangeLog(uint32_t capacity);
+
+void noteChange(ChangeKind kind, int id);
+
+uint32_t changeLogStart();
+
+uint32_t changeLogEnd();
+
+bool changeAt(uint32_t version, ChangeEntry *entry);
+
+// utility functions
+long long nowNanos();
+
+long long wallNanos();
+
+int compareInts(const void *a, const void *b);
+
+int compareLongLongs(const void *a, const void *b);
+
+#endif
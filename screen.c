@@ -0,0 +1,179 @@
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "screen.h"
+
+// unchanged gaps up to this many cells are rewritten instead of jumping over them with a cursor move
+#define SCREEN_GAP_REWRITE 4
+
+bool initScreen(Screen *screen, int width, int height) {
+    freeScreen(screen);
+    screen->width = width > 0 ? width : 80;
+    screen->height = height > 0 ? height : 24;
+    screen->back = malloc(sizeof(ScreenCell) * screen->width * screen->height);
+    screen->front = malloc(sizeof(ScreenCell) * screen->width * screen->height);
+    if (screen->back == NULL || screen->front == NULL) {
+        freeScreen(screen);
+        return false;
+    }
+    screenClear(screen);
+    screenInvalidate(screen);
+    return true;
+}
+
+void freeScreen(Screen *screen) {
+    free(screen->back);
+    free(screen->front);
+    free(screen->output);
+    memset(screen, 0, sizeof(Screen));
+}
+
+// screenClear blanks the back buffer, the terminal only changes on the next flush
+void screenClear(Screen *screen) {
+    for (int i = 0; i < screen->width * screen->height; i++) {
+        screen->back[i].character = ' ';
+        screen->back[i].color = 0;
+    }
+    screen->cursorX = 0;
+    screen->cursorY = 0;
+    screen->color = 0;
+}
+
+// screenInvalidate forgets what is on the terminal so the next flush repaints everything
+void screenInvalidate(Screen *screen) {
+    screen->frontValid = false;
+}
+
+void screenMove(Screen *screen, int x, int y) {
+    screen->cursorX = x;
+    screen->cursorY = y;
+}
+
+// screenWrite puts text at the cursor. Newlines move to the next row, and ANSI color sequences
+// set the color of the following cells instead of being written. Text past the edges is dropped.
+void screenWrite(Screen *screen, const char *text) {
+    for (const char *c = text; *c != '\0'; c++) {
+        if (*c == '\033' && c[1] == '[') {
+            int code = 0;
+            const char *end = c + 2;
+            while (*end >= '0' && *end <= '9') code = code * 10 + *end++ - '0';
+            if (*end == 'm') {
+                screen->color = code >= 30 && code <= 37 ? code : 0;
+                c = end;
+                continue;
+            }
+        }
+        if (*c == '\n') {
+            screen->cursorX = 0;
+            screen->cursorY++;
+            continue;
+        }
+        if (*c == '\r') {
+            screen->cursorX = 0;
+            continue;
+        }
+
+        if (screen->cursorX >= 0 && screen->cursorX < screen->width && screen->cursorY >= 0 &&
+            screen->cursorY < screen->height) {
+            ScreenCell *cell = &screen->back[screen->cursorY * screen->width + screen->cursorX];
+            cell->character = (unsigned char) *c < ' ' ? ' ' : *c;
+            cell->color = screen->color;
+        }
+        screen->cursorX++;
+    }
+}
+
+int screenPrintf(Screen *screen, const char *format, ...) {
+    char text[1024];
+    va_list arguments;
+    va_start(arguments, format);
+    const int length = vsnprintf(text, sizeof(text), format, arguments);
+    va_end(arguments);
+    screenWrite(screen, text);
+    return length;
+}
+
+void screenEmit(Screen *screen, const char *data, size_t length) {
+    if (screen->outputLength + length > screen->outputCapacity) {
+        size_t capacity = screen->outputCapacity == 0 ? 4096 : screen->outputCapacity;
+        while (screen->outputLength + length > capacity) capacity *= 2;
+        char *output = realloc(screen->output, capacity);
+        if (output == NULL) return;
+        screen->output = output;
+        screen->outputCapacity = capacity;
+    }
+    memcpy(screen->output + screen->outputLength, data, length);
+    screen->outputLength += length;
+}
+
+// screenDiff builds the escape sequences that turn the front buffer into the back buffer
+// and makes the back buffer the new front. The result stays valid until the next diff.
+const char *screenDiff(Screen *screen, size_t *length) {
+    char sequence[32];
+    int terminalX = -1, terminalY = -1, terminalColor = -1;
+    screen->outputLength = 0;
+
+    if (!screen->frontValid) {
+        screenEmit(screen, "\033[0m\033[H\033[2J", 11);
+        for (int i = 0; i < screen->width * screen->height; i++) {
+            screen->front[i].character = ' ';
+            screen->front[i].color = 0;
+        }
+        terminalX = 0;
+        terminalY = 0;
+        terminalColor = 0;
+        screen->frontValid = true;
+    }
+
+    for (int y = 0; y < screen->height; y++) {
+        ScreenCell *back = &screen->back[y * screen->width];
+        ScreenCell *front = &screen->front[y * screen->width];
+        for (int x = 0; x < screen->width; x++) {
+            if (back[x].character == front[x].character && back[x].color == front[x].color) continue;
+
+            if (terminalY != y || terminalX > x || x - terminalX > SCREEN_GAP_REWRITE) {
+                const int written = snprintf(sequence, sizeof(sequence), "\033[%d;%dH", y + 1, x + 1);
+                screenEmit(screen, sequence, written);
+                terminalX = x;
+                terminalY = y;
+            }
+            // a short run of unchanged cells is cheaper to rewrite than to jump over
+            for (; terminalX <= x; terminalX++) {
+                const ScreenCell *cell = &back[terminalX];
+                if (cell->color != terminalColor) {
+                    const int written = snprintf(sequence, sizeof(sequence), "\033[%dm", cell->color);
+                    screenEmit(screen, sequence, written);
+                    terminalColor = cell->color;
+                }
+                screenEmit(screen, &cell->character, 1);
+                front[terminalX] = *cell;
+            }
+        }
+    }
+
+    // leave the terminal cursor where the next input is typed
+    if (terminalColor > 0) screenEmit(screen, "\033[0m", 4);
+    const int cursorX = screen->cursorX < screen->width ? screen->cursorX : screen->width - 1;
+    const int cursorY = screen->cursorY < screen->height ? screen->cursorY : screen->height - 1;
+    if (terminalX >= 0 || cursorX != screen->shownCursorX || cursorY != screen->shownCursorY) {
+        const int written = snprintf(sequence, sizeof(sequence), "\033[%d;%dH", cursorY + 1, cursorX + 1);
+        screenEmit(screen, sequence, written);
+        screen->shownCursorX = cursorX;
+        screen->shownCursorY = cursorY;
+    }
+
+    *length = screen->outputLength;
+    return screen->output;
+}
+
+// screenFlush writes the difference to the terminal and returns how many bytes that took
+size_t screenFlush(Screen *screen, FILE *out) {
+    size_t length;
+    const char *output = screenDiff(screen, &length);
+    if (length == 0) return 0;
+    fwrite(output, 1, length, out);
+    fflush(out);
+    screen->bytesWritten += length;
+    return length;
+}
@@ -0,0 +1,53 @@
+#ifndef SCREEN_H
+#define SCREEN_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// ScreenCell is one character on the screen with its ANSI foreground color, 0 is the default color
+typedef struct {
+    char character;
+    unsigned char color;
+} ScreenCell;
+
+// Screen keeps what should be on the terminal (back) and what already is (front),
+// a flush writes only the cells that differ between the two as escape sequences
+typedef struct {
+    int width;
+    int height;
+    ScreenCell *back;
+    ScreenCell *front;
+    bool frontValid;
+    int cursorX;
+    int cursorY;
+    int shownCursorX;
+    int shownCursorY;
+    unsigned char color;
+    char *output;
+    size_t outputLength;
+    size_t outputCapacity;
+    long long bytesWritten;
+} Screen;
+
+bool initScreen(Screen *screen, int width, int height);
+
+void freeScreen(Screen *screen);
+
+void screenClear(Screen *screen);
+
+void screenInvalidate(Screen *screen);
+
+void screenMove(Screen *screen, int x, int y);
+
+void screenWrite(Screen *screen, const char *text);
+
+int screenPrintf(Screen *screen, const char *format, ...);
+
+void screenEmit(Screen *screen, const char *data, size_t length);
+
+const char *screenDiff(Screen *screen, size_t *length);
+
+size_t screenFlush(Screen *screen, FILE *out);
+
+#endif
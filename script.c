@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "archive.h"
+#include "catalog.h"
+#include "export.h"
+#include "script.h"
+#include "storage.h"
+
+bool parsePaymentType(const char *name, PaymentType *paymentType) {
+    const char *names[] = {"paypal", "credit", "debit", "cash"};
+    for (int i = 0; i < 4; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *paymentType = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseUserType(const char *name, UserType *userType) {
+    const char *names[] = {"chef", "cashier", "admin"};
+    for (int i = 0; i < 3; i++) {
+        if (strcmp(name, names[i]) == 0) {
+            *userType = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+// scriptOrder resolves an order argument, either an order id or "last" for the last order created
+Order *scriptOrder(const char *argument, Order *lastOrder) {
+    if (strcmp(argument, "last") == 0) return lastOrder;
+    return findOrder(atoi(argument));
+}
+
+// runScript replays a command script without the terminal interface, one command per line:
+//   register <name> <password> <chef|cashier|admin>    login <name> <password>    logout
+//   stock <id> <name> <price> <quantity>                restock <stockId> <amount>
+//   order <paypal|credit|debit|cash>                    add|modify <stockId> <quantity>
+//   cook|cancel|remove <orderId|last>                  check    archive
+//   export <path> [columns|csv]                        import <path> [insert|upsert]
+// check fails if the running sales totals or the stock use index don't match a recount of every order.
+// add and modify apply to the last order created. The run is in memory only, nothing is loaded or saved,
+// so archive drops every settled order from memory and keeps only its totals.
+int runScript(const char *path) {
+    FILE *script = strcmp(path, "-") == 0 ? stdin : fopen(path, "r");
+    if (script == NULL) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return 1;
+    }
+    idsFilePath = NULL;
+
+    const char *commandNames[SCRIPT_COMMAND_COUNT] = {
+        "register", "login", "logout", "stock", "restock", "order", "add", "modify", "cook", "cancel", "remove",
+        "check", "archive", "export", "import"
+    };
+    ScriptStats stats[SCRIPT_COMMAND_COUNT];
+    memset(stats, 0, sizeof(stats));
+
+    Order *lastOrder = NULL;
+    char line[512];
+    int lineNumber = 0;
+    long long operations = 0, errors = 0;
+    const long long start = nowNanos();
+    while (fgets(line, sizeof(line), script) != NULL) {
+        lineNumber++;
+        char command[32], first[128], second[128], third[128], fourth[128];
+        const int fields = sscanf(line, "%31s %127s %127s %127s %127s", command, first, second, third, fourth);
+        if (fields <= 0 || command[0] == '#') continue;
+
+        int kind = 0;
+        while (kind < SCRIPT_COMMAND_COUNT && strcmp(command, commandNames[kind]) != 0) kind++;
+        if (kind == SCRIPT_COMMAND_COUNT) {
+            fprintf(stderr, "%s:%d: unknown command %s\n", path, lineNumber, command);
+            errors++;
+            continue;
+        }
+
+        const long long commandStart = nowNanos();
+        bool ok = true;
+        switch (kind) {
+            case SCRIPT_REGISTER: {
+                UserType userType;
+                ok = fields == 4 && parseUserType(third, &userType) && findUserByName(first) == NULL;
+                if (ok) registerUser(first, second, userType);
+                break;
+            }
+            case SCRIPT_LOGIN: {
+                User *user = fields == 3 ? findUserByName(first) : NULL;
+                ok = user != NULL && verifyPassword(user, second);
+                if (ok) loggedUser = user;
+                break;
+            }
+            case SCRIPT_LOGOUT:
+                loggedUser = NULL;
+                break;
+            case SCRIPT_STOCK: {
+                ok = fields == 5 && findStock(atoi(first)) == NULL;
+                if (ok) {
+                    Stock *stock = createStock(second, atoi(third), atoi(fourth));
+                    stock->id = atoi(first);
+                    addStock(stock);
+                }
+                break;
+            }
+            case SCRIPT_RESTOCK:
+                ok = fields == 3 && findStock(atoi(first)) != NULL;
+                if (ok) incrementQuantity(atoi(first), atoi(second));
+                break;
+            case SCRIPT_ORDER: {
+                PaymentType paymentType;
+                ok = fields == 2 && isLogged() && parsePaymentType(first, &paymentType);
+                if (ok) {
+                    lastOrder = createOrder(loggedUser->id, paymentType);
+                    ok = lastOrder->id != 0;
+                    if (ok) {
+                        addOrder(lastOrder);
+                    } else {
+                        freeOrder(lastOrder);
+                        lastOrder = NULL;
+                    }
+                }
+                break;
+            }
+            case SCRIPT_ADD:
+            case SCRIPT_MODIFY: {
+                // the numbers are read strictly, an add needs a positive quantity and a modify may empty the line
+                int32_t stockId, quantity;
+                ok = fields == 3 && lastOrder != NULL && parseCatalogNumber(first, &stockId) &&
+                     parseCatalogNumber(second, &quantity) && (quantity > 0 || kind == SCRIPT_MODIFY) &&
+                     findStock(stockId) != NULL;
+                // either fails when the stock can't cover the order
+                if (ok && kind == SCRIPT_ADD) ok = addItemToOrder(lastOrder, stockId, quantity);
+                if (ok && kind == SCRIPT_MODIFY) ok = modifyItemOnOrder(lastOrder, stockId, quantity);
+                break;
+            }
+            case SCRIPT_COOK:
+            case SCRIPT_CANCEL: {
+                Order *order = fields == 2 ? scriptOrder(first, lastOrder) : NULL;
+                ok = order != NULL && order->orderStatus == WAITING;
+                if (ok) setOrderStatus(order, kind == SCRIPT_COOK ? COMPLETED : CANCELLED);
+                break;
+            }
+            case SCRIPT_REMOVE: {
+                Order *order = fields == 2 ? scriptOrder(first, lastOrder) : NULL;
+                ok = order != NULL;
+                if (ok) {
+                    if (order == lastOrder) lastOrder = NULL;
+                    removeOrder(order->id);
+                }
+                break;
+            }
+            case SCRIPT_CHECK: {
+                char report[256];
+                ok = checkSales(report, sizeof(report)) == 0;
+                if (!ok) fprintf(stderr, "%s:%d: %s\n", path, lineNumber, report);
+                if (checkStockUses(report, sizeof(report)) != 0) {
+                    fprintf(stderr, "%s:%d: %s\n", path, lineNumber, report);
+                    ok = false;
+                }
+                break;
+            }
+            case SCRIPT_ARCHIVE:
+                if (lastOrder != NULL && lastOrder->orderStatus != WAITING) lastOrder = NULL;
+                archiveOrders(wallNanos());
+                break;
+            case SCRIPT_EXPORT: {
+                ExportFormat format = EXPORT_COLUMNS;
+                ok = fields >= 2 && (fields < 3 || parseExportFormat(second, &format)) &&
+                     exportSnapshot(first, format) >= 0;
+                break;
+            }
+            case SCRIPT_IMPORT: {
+                CatalogMode mode = CATALOG_INSERT;
+                CatalogResult result;
+                ok = fields >= 2 && (fields < 3 || parseCatalogMode(second, &mode)) &&
+                     importCatalog(first, mode, 0, &result);
+                if (fields >= 2 && !ok) reportCatalogErrors(stderr, first, &result);
+                break;
+            }
+        }
+        const long long elapsed = nowNanos() - commandStart;
+
+        ScriptStats *stat = &stats[kind];
+        if (stat->length == stat->capacity) {
+            stat->capacity = stat->capacity == 0 ? 1024 : stat->capacity * 2;
+            stat->latencies = realloc(stat->latencies, sizeof(long long) * stat->capacity);
+        }
+        stat->latencies[stat->length++] = elapsed;
+        operations++;
+        if (!ok) {
+            stat->failures++;
+            errors++;
+            fprintf(stderr, "%s:%d: %s failed\n", path, lineNumber, command);
+        }
+    }
+    const long long elapsed = nowNanos() - start;
+    if (script != stdin) fclose(script);
+
+    fprintf(stdout, "%lld operations in %.3f ms, %.0f ops/sec, %lld errors\n", operations, elapsed / 1e6,
+            elapsed > 0 ? operations * 1e9 / elapsed : 0, errors);
+    fprintf(stdout, "%-10s %-10s %-10s %-10s %-10s %-10s %-10s\n", "command", "count", "failed", "mean ns", "p50 ns",
+            "p99 ns", "max ns");
+    for (int kind = 0; kind < SCRIPT_COMMAND_COUNT; kind++) {
+        ScriptStats *stat = &stats[kind];
+        if (stat->length == 0) continue;
+        long long total = 0;
+        for (long long i = 0; i < stat->length; i++) total += stat->latencies[i];
+        qsort(stat->latencies, stat->length, sizeof(long long), compareLongLongs);
+        fprintf(stdout, "%-10s %-10lld %-10lld %-10lld %-10lld %-10lld %-10lld\n", commandNames[kind], stat->length,
+                stat->failures, total / stat->length, stat->latencies[stat->length / 2],
+                stat->latencies[stat->length * 99 / 100], stat->latencies[stat->length - 1]);
+        free(stat->latencies);
+    }
+    return errors == 0 ? 0 : 2;
+}
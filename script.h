@@ -0,0 +1,42 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include "restaurant.h"
+
+// functions for the headless mode, which replays a command script against the core functions
+typedef enum {
+    SCRIPT_REGISTER,
+    SCRIPT_LOGIN,
+    SCRIPT_LOGOUT,
+    SCRIPT_STOCK,
+    SCRIPT_RESTOCK,
+    SCRIPT_ORDER,
+    SCRIPT_ADD,
+    SCRIPT_MODIFY,
+    SCRIPT_COOK,
+    SCRIPT_CANCEL,
+    SCRIPT_REMOVE,
+    SCRIPT_CHECK,
+    SCRIPT_ARCHIVE,
+    SCRIPT_EXPORT,
+    SCRIPT_IMPORT,
+    SCRIPT_COMMAND_COUNT
+} ScriptCommand;
+
+// ScriptStats collects the latency of every run of one command
+typedef struct {
+    long long *latencies;
+    long long length;
+    long long capacity;
+    long long failures;
+} ScriptStats;
+
+bool parsePaymentType(const char *name, PaymentType *paymentType);
+
+bool parseUserType(const char *name, UserType *userType);
+
+Order *scriptOrder(const char *argument, Order *lastOrder);
+
+int runScript(const char *path);
+
+#endif
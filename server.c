@@ -0,0 +1,585 @@
+// accept4 is a GNU extension
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// epoll is Linux only, elsewhere the terminals keep their own data
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "kitchen.h"
+#include "metrics.h"
+#include "server.h"
+#include "storage.h"
+
+#ifdef __linux__
+
+// stoppingServer is the server a SIGINT or SIGTERM stops
+Server *stoppingServer = NULL;
+
+void stopOnSignal(int signalNumber) {
+    (void) signalNumber;
+    if (stoppingServer != NULL) requestStop(stoppingServer);
+}
+
+// startServer listens on path. A socket left behind by a server that is gone is replaced,
+// one that a running server answers on is not.
+bool startServer(Server *server, const char *path) {
+    struct sockaddr_un address = {0};
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) return false;
+    strcpy(address.sun_path, path);
+    if (!openChangeLog(SERVER_CHANGE_LOG_CAPACITY)) return false;
+
+    const int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0) return false;
+    const bool taken = connect(probe, (struct sockaddr *) &address, sizeof(address)) == 0;
+    close(probe);
+    if (taken) return false;
+    unlink(path);
+
+    server->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (server->listenFd < 0) return false;
+    if (bind(server->listenFd, (struct sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(server->listenFd, SOMAXCONN) != 0) {
+        close(server->listenFd);
+        return false;
+    }
+
+    server->epollFd = epoll_create1(EPOLL_CLOEXEC);
+    // the listening socket is the only one registered without a client
+    struct epoll_event event = {EPOLLIN, {.ptr = NULL}};
+    if (server->epollFd < 0 || epoll_ctl(server->epollFd, EPOLL_CTL_ADD, server->listenFd, &event) != 0) {
+        if (server->epollFd >= 0) close(server->epollFd);
+        close(server->listenFd);
+        unlink(path);
+        return false;
+    }
+    server->path = path;
+    // nowNanos counts from boot, so a restarted server has another epoch
+    server->epoch = (int32_t) (nowNanos() & 0x7fffffff) | 1;
+    server->clients = NULL;
+    server->clientCount = 0;
+    server->requests = 0;
+    server->lastArchive = nowNanos();
+    atomic_store(&server->running, true);
+    return true;
+}
+
+// serveRequests handles whatever the terminals sent until the server is asked to stop. Requests are handled
+// one after the other on this thread, the kitchen's chefs only complete the orders placed with them.
+// The journal records of every request in one round of events are made durable with a single flush,
+// and only then are their responses sent.
+void serveRequests(Server *server) {
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    ServerClient *answered[SERVER_MAX_EVENTS];
+    while (atomic_load(&server->running)) {
+        const int count = epoll_wait(server->epollFd, events, SERVER_MAX_EVENTS, SERVER_TICK_MILLIS);
+        int answeredCount = 0;
+        journalDeferred = true;
+        for (int i = 0; i < count; i++) {
+            ServerClient *client = events[i].data.ptr;
+            if (client == NULL) {
+                acceptClients(server);
+                continue;
+            }
+            // responses from earlier rounds are durable and go out first, the new ones wait for the flush
+            bool open = true;
+            if (events[i].events & EPOLLOUT) open = writeClient(server, client);
+            if (open && (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) open = readClient(server, client);
+            if (!open) closeClient(server, client);
+            else if (client->outLength > client->outSent) answered[answeredCount++] = client;
+        }
+        journalDeferred = false;
+
+        // a client isn't told a change went through that the journal couldn't keep
+        const bool durable = flushJournal();
+        for (int i = 0; i < answeredCount; i++) {
+            if (!durable || !writeClient(server, answered[i])) closeClient(server, answered[i]);
+        }
+
+        // settled orders go to the archive the way they do in a terminal of its own
+        const long long now = nowNanos();
+        if (archiver.running && now - server->lastArchive >= ARCHIVE_INTERVAL_MILLIS * 1000000LL) {
+            server->lastArchive = now;
+            archiveOrders(wallNanos() - archiver.minimumAge);
+        }
+    }
+}
+
+void requestStop(Server *server) {
+    atomic_store(&server->running, false);
+}
+
+// stopServer disconnects every terminal and removes the socket
+void stopServer(Server *server) {
+    while (server->clients != NULL) closeClient(server, server->clients);
+    close(server->epollFd);
+    close(server->listenFd);
+    unlink(server->path);
+}
+
+// runServer loads the data and serves it on path until SIGINT or SIGTERM, then writes a checkpoint
+int runServer(const char *path) {
+    if (!loadData()) return 1;
+    atexit(saveData);
+    if (startArchiver(ARCHIVE_MIN_AGE_SECONDS * 1000000000LL)) atexit(stopArchiver);
+    // the chefs stop before the archive and the checkpoint are written, so the orders they have are in them
+    if (openKitchen()) atexit(closeKitchen);
+
+    static Server server;
+    if (!startServer(&server, path)) {
+        fprintf(stderr, "cannot listen on %s\n", path);
+        return 1;
+    }
+    stoppingServer = &server;
+    // the server has no screen to turn metrics on from, it records from the start and writes them out when it stops
+    atomic_store(&metricsEnabled, true);
+    struct sigaction action = {0};
+    action.sa_handler = stopOnSignal;
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("serving on %s\n", path);
+    fflush(stdout);
+    serveRequests(&server);
+    stopServer(&server);
+    printf("%lld requests served\n", server.requests);
+    if (!writeMetricsToFile(metricsFilePath)) fprintf(stderr, "failed to write %s\n", metricsFilePath);
+    return 0;
+}
+
+void acceptClients(Server *server) {
+    while (1) {
+        const int fd = accept4(server->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+
+        ServerClient *client = calloc(1, sizeof(ServerClient));
+        char *in = malloc(SERVER_MAX_REQUEST * 4);
+        struct epoll_event event = {EPOLLIN, {.ptr = client}};
+        if (client == NULL || in == NULL || epoll_ctl(server->epollFd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            free(client);
+            free(in);
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->events = EPOLLIN;
+        client->in = in;
+        client->inCapacity = SERVER_MAX_REQUEST * 4;
+        client->next = server->clients;
+        if (client->next != NULL) client->next->prev = client;
+        server->clients = client;
+        server->clientCount++;
+    }
+}
+
+// readClient handles every whole request the client sent and queues the responses, serveRequests sends them
+// once the journal has the changes. It returns false once the client hung up or broke the protocol.
+bool readClient(Server *server, ServerClient *client) {
+    // a few reads per wakeup, a busy client gets back in line behind the others
+    for (int reads = 0; reads < 16 && client->outLength - client->outSent < SERVER_MAX_BACKLOG; reads++) {
+        const ssize_t received = recv(client->fd, client->in + client->inLength,
+                                      client->inCapacity - client->inLength, 0);
+        if (received == 0) return false;
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        client->inLength += received;
+
+        size_t offset = 0;
+        while (client->inLength - offset >= sizeof(RequestHeader)) {
+            RequestHeader request;
+            memcpy(&request, client->in + offset, sizeof(request));
+            if (request.size < sizeof(RequestHeader) || request.size > SERVER_MAX_REQUEST) return false;
+            if (client->inLength - offset < request.size) break;
+            const long long started = metricStart();
+            const bool handled = handleRequest(server, client, &request, client->in + offset + sizeof(RequestHeader),
+                                               request.size - sizeof(RequestHeader));
+            metricEnd(METRIC_REQUEST, started);
+            if (!handled) return false;
+            offset += request.size;
+        }
+        memmove(client->in, client->in + offset, client->inLength - offset);
+        client->inLength -= offset;
+    }
+    return true;
+}
+
+// writeClient sends what the socket takes of the pending responses and waits for room for the rest
+bool writeClient(Server *server, ServerClient *client) {
+    while (client->outSent < client->outLength) {
+        const ssize_t sent = send(client->fd, client->out + client->outSent, client->outLength - client->outSent,
+                                  MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return false;
+        }
+        client->outSent += sent;
+    }
+    if (client->outSent == client->outLength) {
+        client->outSent = 0;
+        client->outLength = 0;
+    }
+    return watchClient(server, client);
+}
+
+// watchClient waits for the client's requests unless it is behind on its responses, and for room to send them
+bool watchClient(Server *server, ServerClient *client) {
+    const size_t backlog = client->outLength - client->outSent;
+    const uint32_t events = (backlog < SERVER_MAX_BACKLOG ? EPOLLIN : 0) | (backlog > 0 ? EPOLLOUT : 0);
+    if (events == client->events) return true;
+    struct epoll_event event = {events, {.ptr = client}};
+    if (epoll_ctl(server->epollFd, EPOLL_CTL_MOD, client->fd, &event) != 0) return false;
+    client->events = events;
+    return true;
+}
+
+void closeClient(Server *server, ServerClient *client) {
+    epoll_ctl(server->epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    if (client->prev != NULL) client->prev->next = client->next;
+    else server->clients = client->next;
+    if (client->next != NULL) client->next->prev = client->prev;
+    free(client->in);
+    free(client->out);
+    free(client->list);
+    free(client);
+    server->clientCount--;
+}
+
+#else
+
+int runServer(const char *path) {
+    fprintf(stderr, "cannot serve %s, server mode needs epoll\n", path);
+    return 1;
+}
+
+#endif
+
+// reserveOutput makes room for size more bytes of responses
+bool reserveOutput(ServerClient *client, size_t size) {
+    if (client->outLength + size <= client->outCapacity) return true;
+    size_t capacity = client->outCapacity == 0 ? 4096 : client->outCapacity;
+    while (client->outLength + size > capacity) capacity *= 2;
+    char *out = realloc(client->out, capacity);
+    if (out == NULL) return false;
+    client->out = out;
+    client->outCapacity = capacity;
+    return true;
+}
+
+bool appendResponse(ServerClient *client, ResponseStatus status, const int32_t args[4], const void *payload,
+                    size_t length) {
+    if (!reserveOutput(client, sizeof(ResponseHeader) + length)) return false;
+    ResponseHeader response = {sizeof(ResponseHeader) + length, status, {args[0], args[1], args[2], args[3]}};
+    memcpy(client->out + client->outLength, &response, sizeof(response));
+    if (length > 0) memcpy(client->out + client->outLength + sizeof(response), payload, length);
+    client->outLength += sizeof(response) + length;
+    return true;
+}
+
+// parseCredentials splits the text of a login or register request into the name and the password
+bool parseCredentials(const char *text, size_t textLength, const char **name, const char **password) {
+    const char *nameEnd = memchr(text, '\0', textLength);
+    if (nameEnd == NULL) return false;
+    const char *passwordEnd = memchr(nameEnd + 1, '\0', text + textLength - nameEnd - 1);
+    if (passwordEnd == NULL) return false;
+    *name = text;
+    *password = nameEnd + 1;
+    // both go into fixed size fields of the user
+    return nameEnd - text > 0 && nameEnd - text <= 100 && passwordEnd - nameEnd - 1 <= 100;
+}
+
+// listedSize looks up what changed and returns how many bytes it takes in a list, node is NULL if it was removed
+size_t listedSize(ChangeKind kind, int id, const void **node) {
+    if (kind == CHANGE_STOCK) {
+        *node = findStock(id);
+        return *node != NULL ? sizeof(StockRecord) : 0;
+    }
+    if (kind == CHANGE_USER) {
+        *node = findUser(id);
+        return *node != NULL ? sizeof(UserRecord) : 0;
+    }
+    const Order *order = findOrder(id);
+    *node = order;
+    return order != NULL ? sizeof(OrderRecord) + sizeof(ListItem) * order->itemCount : 0;
+}
+
+// writeListed writes a stock, user or order as a list has it and returns the end of what it wrote
+char *writeListed(char *out, ChangeKind kind, const void *node) {
+    if (kind == CHANGE_STOCK) {
+        const Stock *stock = node;
+        StockRecord record = {stock->id, stock->price, getStockQuantity(stock), {0}};
+        strncpy(record.name, stringAt(stock->name), sizeof(record.name) - 1);
+        memcpy(out, &record, sizeof(record));
+        return out + sizeof(record);
+    }
+    if (kind == CHANGE_USER) {
+        const User *user = node;
+        UserRecord record = {user->id, user->type, {0}, {0}};
+        strncpy(record.name, stringAt(user->name), sizeof(record.name) - 1);
+        memcpy(out, &record, sizeof(record));
+        return out + sizeof(record);
+    }
+    const Order *order = node;
+    const OrderRecord record = {order->id, order->cashierId, order->paymentType, order->orderStatus, order->itemCount};
+    memcpy(out, &record, sizeof(record));
+    out += sizeof(record);
+    for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+        const ListItem listed = {item->id, item->stockId, item->quantity, item->price};
+        memcpy(out, &listed, sizeof(listed));
+        out += sizeof(listed);
+    }
+    return out;
+}
+
+// buildList copies every stock, user and order into the client's full list. The chefs move orders between
+// the status lists meanwhile, so it is made under salesLock and has the version the log had then.
+bool buildList(ServerClient *client) {
+    pthread_mutex_lock(&salesLock);
+    size_t size = sizeof(ListCounts) + sizeof(StockRecord) * stocks.length + sizeof(UserRecord) * users.length +
+                  sizeof(OrderRecord) * orders.length;
+    for (const Order *order = orders.head; order != NULL; order = order->next) {
+        size += sizeof(ListItem) * order->itemCount;
+    }
+    free(client->list);
+    client->list = malloc(size);
+    client->listLength = client->list != NULL ? size : 0;
+    if (client->list == NULL) {
+        pthread_mutex_unlock(&salesLock);
+        return false;
+    }
+
+    const ListCounts counts = {orders.length, stocks.length, users.length};
+    memcpy(client->list, &counts, sizeof(counts));
+    char *out = client->list + sizeof(counts);
+    for (const Stock *stock = stocks.head; stock != NULL; stock = stock->next) {
+        out = writeListed(out, CHANGE_STOCK, stock);
+    }
+    for (const User *user = users.head; user != NULL; user = user->next) out = writeListed(out, CHANGE_USER, user);
+    for (const Order *order = orders.head; order != NULL; order = order->next) {
+        out = writeListed(out, CHANGE_ORDER, order);
+    }
+    client->listVersion = (int32_t) changeLogEnd();
+    pthread_mutex_unlock(&salesLock);
+    return true;
+}
+
+// appendChanges sends what changed since the client's version, up to a page of it. Something that changed
+// several times is sent once as it is now, and again on a later page if it changes after that.
+bool appendChanges(Server *server, ServerClient *client, uint32_t since) {
+    IdIndex sent[3] = {{NULL, 0, 0}, {NULL, 0, 0}, {NULL, 0, 0}};
+    pthread_mutex_lock(&salesLock);
+    const uint32_t end = changeLogEnd();
+    const size_t start = client->outLength;
+    size_t length = 0;
+    uint32_t version = since;
+    bool ok = true;
+    ChangeEntry entry;
+    // a replica that fell out of the log meanwhile is sent the full list next time
+    for (; version != end && changeAt(version, &entry); version++) {
+        if (indexGet(&sent[entry.kind], entry.id) != NULL) continue;
+        const void *node;
+        const size_t size = sizeof(ListChange) + listedSize(entry.kind, entry.id, &node);
+        if (length > 0 && length + size > SERVER_MAX_PAGE) break;
+        if (!(ok = reserveOutput(client, sizeof(ResponseHeader) + length + size))) break;
+
+        char *out = client->out + start + sizeof(ResponseHeader) + length;
+        const ListChange change = {entry.kind, entry.id, node == NULL};
+        memcpy(out, &change, sizeof(change));
+        if (node != NULL) writeListed(out + sizeof(change), entry.kind, node);
+        length += size;
+        indexPut(&sent[entry.kind], entry.id, sent);
+    }
+    pthread_mutex_unlock(&salesLock);
+    for (int i = 0; i < 3; i++) free(sent[i].entries);
+    if (!ok || !reserveOutput(client, sizeof(ResponseHeader) + length)) return false;
+
+    const ResponseHeader response = {
+        sizeof(ResponseHeader) + length, RESPONSE_CHANGES, {(int32_t) version, server->epoch, version != end}
+    };
+    memcpy(client->out + start, &response, sizeof(response));
+    client->outLength += sizeof(ResponseHeader) + length;
+    return true;
+}
+
+// appendList answers a list with what changed since the client's version, or with a page of the full list
+// when the client is new, from another server or further behind than the change log goes back
+bool appendList(Server *server, ServerClient *client, const int32_t args[4]) {
+    const uint32_t since = (uint32_t) args[0];
+    const uint32_t end = changeLogEnd();
+    if (args[1] == server->epoch && args[2] == 0 && since >= changeLogStart() && since <= end) {
+        if (since == end) return appendResponse(client, RESPONSE_UNCHANGED, (int32_t[4]) {args[0], args[1]}, NULL, 0);
+        return appendChanges(server, client, since);
+    }
+
+    const size_t offset = args[2] > 0 ? (size_t) args[2] : 0;
+    if (offset == 0 && !buildList(client)) return false;
+    if (client->list == NULL || offset >= client->listLength) {
+        return appendResponse(client, RESPONSE_BAD_REQUEST, (int32_t[4]) {0}, NULL, 0);
+    }
+    const size_t length = client->listLength - offset < SERVER_MAX_PAGE ? client->listLength - offset
+                                                                         : SERVER_MAX_PAGE;
+    const int32_t reply[4] = {client->listVersion, server->epoch, (int32_t) offset, (int32_t) client->listLength};
+    if (!appendResponse(client, RESPONSE_OK, reply, client->list + offset, length)) return false;
+    // the last page is sent, the copy isn't needed anymore
+    if (offset + length == client->listLength) {
+        free(client->list);
+        client->list = NULL;
+        client->listLength = 0;
+    }
+    return true;
+}
+
+// allowedRequest applies the menus' rules to a request: anyone can log in, register and list, cashiers take
+// orders, chefs cook them and admins restock. Only an admin registers another admin, handleRequest checks that.
+bool allowedRequest(const User *user, RequestType type) {
+    switch (type) {
+        case REQUEST_LOGIN:
+        case REQUEST_REGISTER:
+        case REQUEST_LIST:
+            return true;
+        case REQUEST_CREATE_ORDER:
+        case REQUEST_ADD_ITEM:
+        case REQUEST_PLACE:
+            return user != NULL && user->type == CASHIER;
+        case REQUEST_COOK:
+            return user != NULL && user->type == CHEF;
+        case REQUEST_RESTOCK:
+            return user != NULL && user->type == ADMIN;
+        default:
+            return user != NULL;
+    }
+}
+
+// handleRequest runs one request and queues its response. Everything but logging in, registering and listing
+// needs a logged in user whose role allowedRequest lets make it, orders are created for that user and only they
+// add to and place them. It returns false if there is no memory for the response.
+bool handleRequest(Server *server, ServerClient *client, const RequestHeader *request, const char *text,
+                   size_t textLength) {
+    const int32_t *args = request->args;
+    int32_t reply[4] = {0};
+    ResponseStatus status = RESPONSE_OK;
+    server->requests++;
+
+    const User *user = client->userId != 0 ? findUser(client->userId) : NULL;
+    if (!allowedRequest(user, request->type)) return appendResponse(client, RESPONSE_DENIED, reply, NULL, 0);
+
+    switch (request->type) {
+        case REQUEST_LOGIN: {
+            const char *name, *password;
+            User *found = parseCredentials(text, textLength, &name, &password) ? findUserByName(name) : NULL;
+            if (found == NULL || !verifyPassword(found, (char *) password)) {
+                status = RESPONSE_DENIED;
+                break;
+            }
+            client->userId = found->id;
+            reply[0] = found->id;
+            reply[1] = found->type;
+            break;
+        }
+        case REQUEST_REGISTER: {
+            // the same lengths as the register screen, and a client that isn't an admin registers chefs and cashiers
+            const char *name, *password;
+            if (!parseCredentials(text, textLength, &name, &password) || args[0] < CHEF || args[0] > ADMIN ||
+                strlen(name) < USER_NAME_MIN || strlen(name) > USER_NAME_MAX || strlen(password) < USER_PASSWORD_MIN ||
+                strlen(password) > USER_PASSWORD_MAX) {
+                status = RESPONSE_BAD_REQUEST;
+                break;
+            }
+            if (args[0] == ADMIN && (user == NULL || user->type != ADMIN)) {
+                status = RESPONSE_DENIED;
+                break;
+            }
+            if (findUserByName(name) != NULL) {
+                status = RESPONSE_FAILED;
+                break;
+            }
+            registerUser((char *) name, (char *) password, args[0]);
+            const User *registered = findUserByName(name);
+            if (registered == NULL) {
+                status = RESPONSE_FAILED;
+                break;
+            }
+            reply[0] = registered->id;
+            break;
+        }
+        case REQUEST_CREATE_ORDER: {
+            if (args[0] < PAYPAL || args[0] > CASH) {
+                status = RESPONSE_BAD_REQUEST;
+                break;
+            }
+            Order *order = createOrder(user->id, args[0]);
+            if (order->id == 0) {
+                freeOrder(order);
+                status = RESPONSE_FAILED;
+                break;
+            }
+            addOrder(order);
+            if (findOrder(order->id) != order) {
+                status = RESPONSE_FAILED;
+                break;
+            }
+            reply[0] = order->id;
+            break;
+        }
+        case REQUEST_ADD_ITEM: {
+            Order *order = findOrder(args[0]);
+            if (order == NULL || order->cashierId != user->id || args[2] <= 0) {
+                status = RESPONSE_BAD_REQUEST;
+                break;
+            }
+            // the stock ran out, or isn't there
+            if (!addItemToOrder(order, args[1], args[2])) status = RESPONSE_FAILED;
+            reply[0] = (int32_t) order->total;
+            break;
+        }
+        case REQUEST_COOK: {
+            Order *order = findOrder(args[0]);
+            if (order == NULL) status = RESPONSE_BAD_REQUEST;
+            else if (!claimOrder(order)) status = RESPONSE_FAILED;
+            else {
+                cookClaimedOrder(order);
+            }
+            break;
+        }
+        case REQUEST_RESTOCK: {
+            Stock *stock = findStock(args[0]);
+            if (stock == NULL || args[1] <= 0) {
+                status = RESPONSE_BAD_REQUEST;
+                break;
+            }
+            incrementQuantity(stock->id, args[1]);
+            reply[0] = getStockQuantity(stock);
+            break;
+        }
+        case REQUEST_PLACE: {
+            Order *order = findOrder(args[0]);
+            if (order == NULL || order->cashierId != user->id) status = RESPONSE_BAD_REQUEST;
+            else if (!placeOrder(order)) status = RESPONSE_FAILED;
+            break;
+        }
+        case REQUEST_LIST:
+            return appendList(server, client, args);
+        default:
+            status = RESPONSE_BAD_REQUEST;
+            break;
+    }
+    return appendResponse(client, status, reply, NULL, 0);
+}
@@ -0,0 +1,176 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "restaurant.h"
+#include "storage.h"
+
+// terminals connect to this socket in the working directory unless told otherwise
+#define SERVER_SOCKET_PATH "restaurant.sock"
+
+// a request can't be longer than this, a client that sends one is disconnected
+#define SERVER_MAX_REQUEST 4096
+#define SERVER_MAX_EVENTS 64
+// the server wakes up this often without requests, to archive and to notice it was asked to stop
+#define SERVER_TICK_MILLIS 250
+// a client with this much output it hasn't read isn't read from until it catches up
+#define SERVER_MAX_BACKLOG (1 << 20)
+// a list is sent in pages so that no answer is longer than the backlog
+#define SERVER_MAX_PAGE (SERVER_MAX_BACKLOG - sizeof(ResponseHeader))
+// the server remembers this many changes, a replica further behind is sent the full list again
+#define SERVER_CHANGE_LOG_CAPACITY (1 << 18)
+
+typedef enum {
+    REQUEST_LOGIN,
+    REQUEST_REGISTER,
+    REQUEST_CREATE_ORDER,
+    REQUEST_ADD_ITEM,
+    REQUEST_COOK,
+    REQUEST_RESTOCK,
+    REQUEST_LIST,
+    REQUEST_PLACE,
+    REQUEST_TYPE_COUNT
+} RequestType;
+
+typedef enum {
+    RESPONSE_OK,
+    RESPONSE_FAILED,
+    RESPONSE_DENIED,
+    RESPONSE_BAD_REQUEST,
+    RESPONSE_UNCHANGED,
+    RESPONSE_CHANGES
+} ResponseStatus;
+
+// RequestHeader starts every request, followed by size - sizeof(RequestHeader) bytes of text.
+//   login       text "name\0password\0"                  args[0] user id, args[1] user type
+//   register    args[0] user type, text as for login     args[0] user id
+//   create      args[0] payment type                     args[0] order id
+//   add         args order id, stock id, quantity        args[0] order total
+//   cook        args[0] order id
+//   restock     args stock id, amount                    args[0] quantity
+//   list        args version and epoch the client has,   args version, epoch, more or offset, size
+//               offset of the full list it has so far
+//   place       args[0] order id, fails if the kitchen is full and a chef has to cook it by hand
+// A list answers unchanged when nothing changed since the client's version. When the server still has every
+// change since then it answers changes, a ListChange for each order, stock or user that changed followed by
+// what it is now unless it was removed, with more set if the page was full. Otherwise it answers with the
+// full list from offset on, a ListCounts and then every stock, user and order. The full list is a copy made for
+// its first page, size is its length in bytes. Stocks are StockRecords, users UserRecords without the password,
+// orders an OrderRecord followed by its items as ListItems. epoch tells servers apart, a version of another one
+// means nothing.
+typedef struct {
+    uint32_t size;
+    int32_t type;
+    int32_t args[4];
+} RequestHeader;
+
+// ResponseHeader starts every response, followed by size - sizeof(ResponseHeader) bytes of payload
+typedef struct {
+    uint32_t size;
+    int32_t status;
+    int32_t args[4];
+} ResponseHeader;
+
+// ListItem is an item in a list, with the price it was sold at
+typedef struct {
+    int32_t id;
+    int32_t stockId;
+    int32_t quantity;
+    int32_t price;
+} ListItem;
+
+// ListChange starts an order, stock or user in a list of changes, kind is a ChangeKind
+typedef struct {
+    int32_t kind;
+    int32_t id;
+    int32_t removed;
+} ListChange;
+
+typedef struct {
+    int32_t orders;
+    int32_t stocks;
+    int32_t users;
+} ListCounts;
+
+typedef struct ServerClient ServerClient;
+
+// ServerClient is one connected terminal, with what it sent that wasn't handled yet and what wasn't sent back yet.
+// events is what the server waits for on its socket.
+struct ServerClient {
+    int fd;
+    int userId;
+    uint32_t events;
+    char *in;
+    size_t inLength;
+    size_t inCapacity;
+    char *out;
+    size_t outLength;
+    size_t outSent;
+    size_t outCapacity;
+    // list is the full list the client is reading a page at a time, listVersion the version it has
+    char *list;
+    size_t listLength;
+    int32_t listVersion;
+
+    ServerClient *next;
+    ServerClient *prev;
+};
+
+// Server owns the data and serves every terminal from one thread, waiting on all of their sockets with epoll.
+// Its version is the end of the change log, a terminal gets what changed since its own version.
+typedef struct {
+    int listenFd;
+    int epollFd;
+    const char *path;
+    _Atomic bool running;
+    int32_t epoch;
+    ServerClient *clients;
+    int clientCount;
+    long long requests;
+    long long lastArchive;
+} Server;
+
+// functions for the server, serveRequests runs until requestStop is called, which is safe from a signal handler
+bool startServer(Server *server, const char *path);
+
+void serveRequests(Server *server);
+
+void requestStop(Server *server);
+
+void stopServer(Server *server);
+
+int runServer(const char *path);
+
+// functions for one connection
+void acceptClients(Server *server);
+
+bool readClient(Server *server, ServerClient *client);
+
+bool writeClient(Server *server, ServerClient *client);
+
+bool watchClient(Server *server, ServerClient *client);
+
+void closeClient(Server *server, ServerClient *client);
+
+bool reserveOutput(ServerClient *client, size_t size);
+
+bool appendResponse(ServerClient *client, ResponseStatus status, const int32_t args[4], const void *payload,
+                    size_t length);
+
+bool parseCredentials(const char *text, size_t textLength, const char **name, const char **password);
+
+size_t listedSize(ChangeKind kind, int id, const void **node);
+
+char *writeListed(char *out, ChangeKind kind, const void *node);
+
+bool buildList(ServerClient *client);
+
+bool appendChanges(Server *server, ServerClient *client, uint32_t since);
+
+bool appendList(Server *server, ServerClient *client, const int32_t args[4]);
+
+bool allowedRequest(const User *user, RequestType type);
+
+bool handleRequest(Server *server, ServerClient *client, const RequestHeader *request, const char *text,
+                   size_t textLength);
+
+#endif
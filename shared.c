@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include "shared.h"
+
+#define UNITS_QUANTITY(units) ((int32_t) (uint32_t) (units))
+#define UNITS_RESERVED(units) ((int32_t) (uint32_t) ((units) >> 32))
+#define UNITS(quantity, reserved) ((uint64_t) (uint32_t) (quantity) | (uint64_t) (uint32_t) (reserved) << 32)
+
+const char *sharedStocksPath = SHARED_STOCKS_PATH;
+
+SharedStocks sharedStocks = {-1, NULL, NULL, 0, 0, 0};
+
+#ifndef _WIN32
+
+// openSharedStocks maps the shared table, creating it with room for twice stockCount stocks if this is the first
+// process to open it, and otherwise at the size the first process made it. The file lock keeps two first
+// processes from both setting it up.
+bool openSharedStocks(SharedStocks *table, const char *path, int stockCount) {
+    uint32_t capacity = SHARED_STOCKS_CAPACITY;
+    while (capacity < (uint32_t) stockCount * 2 && capacity < (1u << 30)) capacity *= 2;
+    const int fd = open(path, O_RDWR | O_CREAT, 0666);
+    if (fd < 0) return false;
+    if (flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return false;
+    }
+
+    struct stat status;
+    bool ok = fstat(fd, &status) == 0;
+    size_t size = ok && status.st_size > 0 ? (size_t) status.st_size
+                                           : sizeof(SharedStocksHeader) + sizeof(SharedStock) * capacity;
+    ok = ok && size >= sizeof(SharedStocksHeader) && (status.st_size > 0 || ftruncate(fd, (off_t) size) == 0);
+    void *data = ok ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    ok = data != MAP_FAILED;
+    SharedStocksHeader *header = data;
+    // the magic is written last, a process that died setting the table up leaves it to be set up again
+    if (ok && memcmp(header->magic, "\0\0\0\0", 4) == 0) {
+        header->capacity = (uint32_t) ((size - sizeof(SharedStocksHeader)) / sizeof(SharedStock));
+        header->recordSize = sizeof(SharedStock);
+        memcpy(header->magic, "CSTK", 4);
+    }
+    if (ok && (memcmp(header->magic, "CSTK", 4) != 0 || header->recordSize != sizeof(SharedStock) ||
+               header->capacity < SHARED_STOCKS_CAPACITY || (header->capacity & (header->capacity - 1)) != 0 ||
+               size != sizeof(SharedStocksHeader) + sizeof(SharedStock) * header->capacity)) {
+        fprintf(stderr, "%s: not a stock table of this version\n", path);
+        munmap(data, size);
+        ok = false;
+    }
+    flock(fd, LOCK_UN);
+    if (!ok) {
+        close(fd);
+        return false;
+    }
+
+    table->fd = fd;
+    table->header = header;
+    table->records = (SharedStock *) (header + 1);
+    table->size = size;
+    table->capacity = header->capacity;
+    table->overflows = 0;
+    return true;
+}
+
+void closeSharedStocks(SharedStocks *table) {
+    if (table->header == NULL) return;
+    // the stocks keep the units they have now, e.g. for the checkpoint written at exit, and hold what
+    // this process's waiting orders reserved rather than what every process did
+    for (Stock *stock = stocks.head; stock != NULL; stock = stock->next) {
+        if (stock->shared == NULL) continue;
+        stock->quantity = sharedQuantity(stock->shared);
+        stock->reserved = 0;
+    }
+    for (const Order *order = orders.statusHeads[WAITING]; order != NULL; order = order->statusNext) {
+        for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+            Stock *stock = findStock(item->stockId);
+            if (stock != NULL && stock->shared != NULL) stock->reserved += item->quantity;
+        }
+    }
+    for (Stock *stock = stocks.head; stock != NULL; stock = stock->next) stock->shared = NULL;
+    munmap(table->header, table->size);
+    close(table->fd);
+    table->fd = -1;
+    table->header = NULL;
+    table->records = NULL;
+    table->capacity = 0;
+}
+
+// stopSharingStocks closes the process's own table, for atexit
+void stopSharingStocks() {
+    closeSharedStocks(&sharedStocks);
+}
+
+#else
+
+bool openSharedStocks(SharedStocks *table, const char *path, int stockCount) {
+    (void) table;
+    (void) path;
+    (void) stockCount;
+    return false;
+}
+
+void closeSharedStocks(SharedStocks *table) {
+    (void) table;
+}
+
+void stopSharingStocks() {
+}
+
+#endif
+
+// findSharedStock returns the record of a stock, or NULL if no process shared it. A record another process
+// is still filling in is left out until it is ready, and a removed one for good.
+SharedStock *findSharedStock(const SharedStocks *table, int id) {
+    if (table->records == NULL || id <= 0) return NULL;
+    const unsigned int mask = table->capacity - 1;
+    unsigned int slot = hashId(id) & mask;
+    for (uint32_t probes = 0; probes < table->capacity; probes++, slot = (slot + 1) & mask) {
+        SharedStock *record = &table->records[slot];
+        const int32_t recordId = atomic_load_explicit(&record->id, memory_order_acquire);
+        if (recordId == 0) return NULL;
+        if (recordId != id) continue;
+        return atomic_load_explicit(&record->ready, memory_order_acquire) == SHARED_STOCK_READY ? record : NULL;
+    }
+    return NULL;
+}
+
+// publishSharedStock returns the record of a stock, adding it with the stock's units if no process shared it yet.
+// Records are only added under the file lock, so a record that is still filling was left by a process that
+// died adding it, and is filled in again. A removed stock isn't brought back, the processes that had it may
+// still use its record, and neither is a record of another stock with the same id. NULL is returned for both,
+// as it is when the table is full, which is counted in overflows.
+SharedStock *publishSharedStock(SharedStocks *table, const Stock *stock) {
+    if (table->records == NULL || stock->id <= 0) return NULL;
+#ifndef _WIN32
+    if (flock(table->fd, LOCK_EX) != 0) return NULL;
+#endif
+    SharedStock *found = NULL;
+    const unsigned int mask = table->capacity - 1;
+    unsigned int slot = hashId(stock->id) & mask;
+    uint32_t probes = 0;
+    for (; probes < table->capacity; probes++, slot = (slot + 1) & mask) {
+        SharedStock *record = &table->records[slot];
+        const int32_t recordId = atomic_load(&record->id);
+        if (recordId != 0 && recordId != stock->id) continue;
+        const int32_t state = recordId == stock->id ? atomic_load(&record->ready) : SHARED_STOCK_FILLING;
+        if (state == SHARED_STOCK_REMOVED) break;
+        if (state == SHARED_STOCK_READY) {
+            if (strncmp(record->name, stringAt(stock->name), sizeof(record->name)) == 0) found = record;
+            break;
+        }
+        strncpy(record->name, stringAt(stock->name), sizeof(record->name) - 1);
+        record->name[sizeof(record->name) - 1] = '\0';
+        record->price = stock->price;
+        atomic_store(&record->units, UNITS(stock->quantity, 0));
+        if (recordId == 0) {
+            atomic_store(&record->id, stock->id);
+            atomic_fetch_add(&table->header->used, 1);
+        }
+        atomic_store(&record->ready, SHARED_STOCK_READY);
+        found = record;
+        break;
+    }
+    if (probes == table->capacity) table->overflows++;
+#ifndef _WIN32
+    flock(table->fd, LOCK_UN);
+#endif
+    return found;
+}
+
+// unpublishSharedStock marks the record of a removed stock, so no process adopts or publishes it again. The record
+// stays for the probes and the processes that already have the stock keep using it.
+void unpublishSharedStock(SharedStocks *table, SharedStock *record) {
+#ifndef _WIN32
+    if (flock(table->fd, LOCK_EX) != 0) return;
+#endif
+    atomic_store(&record->ready, SHARED_STOCK_REMOVED);
+#ifndef _WIN32
+    flock(table->fd, LOCK_UN);
+#endif
+}
+
+// attachSharedStocks moves every stock of this process onto the shared table and returns how many are shared.
+// A stock another process shared first takes that process's units, so restarting a process doesn't reset them.
+int attachSharedStocks(SharedStocks *table) {
+    int shared = 0;
+    for (Stock *stock = stocks.head; stock != NULL; stock = stock->next) {
+        stock->shared = publishSharedStock(table, stock);
+        if (stock->shared != NULL) shared++;
+    }
+    return shared + adoptSharedStocks(table);
+}
+
+// adoptSharedStocks adds the stocks other processes shared that this process doesn't have, and returns how many
+int adoptSharedStocks(SharedStocks *table) {
+    if (table->records == NULL || atomic_load(&table->header->used) == 0) return 0;
+    int adopted = 0;
+    for (SharedStock *record = table->records; record < table->records + table->capacity; record++) {
+        const int32_t id = atomic_load_explicit(&record->id, memory_order_acquire);
+        const bool ready = atomic_load_explicit(&record->ready, memory_order_acquire) == SHARED_STOCK_READY;
+        if (id <= 0 || !ready || findStock(id) != NULL) continue;
+        Stock *stock = createStock(record->name, record->price, sharedQuantity(record));
+        stock->id = id;
+        addStock(stock);
+        if (stock->shared != NULL) adopted++;
+    }
+    return adopted;
+}
+
+int sharedQuantity(const SharedStock *record) {
+    return UNITS_QUANTITY(atomic_load(&record->units));
+}
+
+int sharedReserved(const SharedStock *record) {
+    return UNITS_RESERVED(atomic_load(&record->units));
+}
+
+// sharedReserve moves units from quantity to reserved in one compare-and-swap, which gives up once it is too low
+bool sharedReserve(SharedStock *record, int quantity) {
+    uint64_t units = atomic_load_explicit(&record->units, memory_order_relaxed);
+    do {
+        if (UNITS_QUANTITY(units) < quantity) return false;
+    } while (!atomic_compare_exchange_weak(&record->units, &units,
+                                           UNITS(UNITS_QUANTITY(units) - quantity, UNITS_RESERVED(units) + quantity)));
+    return true;
+}
+
+void sharedCommit(SharedStock *record, int quantity) {
+    atomic_fetch_sub(&record->units, UNITS(0, quantity));
+}
+
+// wakeSharedStock tells the processes waiting for units that some came back.
+// Only the table's waiter count is checked, so a release with nobody waiting costs no system call.
+void wakeSharedStock(SharedStock *record) {
+    atomic_fetch_add(&record->restocks, 1);
+    if (atomic_load(&sharedStocks.header->waiters) == 0) return;
+#ifdef __linux__
+    syscall(SYS_futex, &record->restocks, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+void sharedRelease(SharedStock *record, int quantity) {
+    uint64_t units = atomic_load_explicit(&record->units, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(&record->units, &units,
+                                         UNITS(UNITS_QUANTITY(units) + quantity, UNITS_RESERVED(units) - quantity)));
+    wakeSharedStock(record);
+}
+
+// sharedRestock adds units, or takes them away when quantity is negative, without touching what is reserved
+void sharedRestock(SharedStock *record, int quantity) {
+    uint64_t units = atomic_load_explicit(&record->units, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(&record->units, &units,
+                                         UNITS(UNITS_QUANTITY(units) + quantity, UNITS_RESERVED(units))));
+    if (quantity > 0) wakeSharedStock(record);
+}
+
+// sharedSetQuantity sets the quantity in one compare-and-swap, so units other processes reserve, release or
+// restock meanwhile are not written over
+void sharedSetQuantity(SharedStock *record, int quantity) {
+    uint64_t units = atomic_load_explicit(&record->units, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak(&record->units, &units, UNITS(quantity, UNITS_RESERVED(units))));
+    if (quantity > UNITS_QUANTITY(units)) wakeSharedStock(record);
+}
+
+// waitSharedStock waits until the record has at least quantity units or timeoutMillis pass, and returns whether
+// it has them. The futex sleeps only if no units came back since restocks was read, so a wake-up can't be missed.
+bool waitSharedStock(SharedStock *record, int quantity, int timeoutMillis) {
+#ifndef _WIN32
+    struct timespec now, deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeoutMillis / 1000;
+    deadline.tv_nsec += (long) (timeoutMillis % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    atomic_fetch_add(&sharedStocks.header->waiters, 1);
+    bool enough = false;
+    while (1) {
+        const uint32_t restocks = atomic_load(&record->restocks);
+        enough = sharedQuantity(record) >= quantity;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (enough || now.tv_sec > deadline.tv_sec ||
+            (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec))
+            break;
+        struct timespec remaining = {deadline.tv_sec - now.tv_sec, deadline.tv_nsec - now.tv_nsec};
+        if (remaining.tv_nsec < 0) {
+            remaining.tv_sec--;
+            remaining.tv_nsec += 1000000000L;
+        }
+#ifdef __linux__
+        syscall(SYS_futex, &record->restocks, FUTEX_WAIT, restocks, &remaining, NULL, 0);
+#else
+        (void) restocks;
+        const struct timespec pause = {0, 1000000L};
+        nanosleep(&pause, NULL);
+#endif
+    }
+    atomic_fetch_sub(&sharedStocks.header->waiters, 1);
+    return enough;
+#else
+    (void) timeoutMillis;
+    return sharedQuantity(record) >= quantity;
+#endif
+}
@@ -0,0 +1,97 @@
+#ifndef SHARED_H
+#define SHARED_H
+
+#include <stdint.h>
+
+#include "restaurant.h"
+
+// terminals on the same machine share the stock table through this file unless told otherwise
+#define SHARED_STOCKS_PATH "stocks.shm"
+// a power of two, the smallest table. The first process makes it twice as large as its stocks need and it never
+// grows after that, a stock that doesn't fit is counted and stays with its own process.
+#define SHARED_STOCKS_CAPACITY 4096
+
+// the states of a record: being filled in, or left half filled in by a process that died, in use, and removed
+#define SHARED_STOCK_FILLING 0
+#define SHARED_STOCK_READY 1
+#define SHARED_STOCK_REMOVED 2
+
+// SharedStock is one fixed-size record of the shared table. units holds quantity in its low half and reserved in
+// its high half, so moving units between them is one atomic step and a process killed half way through a
+// reservation can't lose any. restocks changes whenever units are given back, processes waiting for units
+// sleep on it with a futex. ready is one of the SHARED_STOCK_ states. What a process that dies has reserved
+// stays in reserved: its waiting orders hold those units again when it restarts from its journal. Units it reserved
+// for an order that never reached the journal stay counted as reserved, since nothing records whose they were.
+struct SharedStock {
+    _Atomic int32_t id;
+    _Atomic int32_t ready;
+    int32_t price;
+    _Atomic uint32_t restocks;
+    _Atomic uint64_t units;
+    char name[104];
+};
+
+// SharedStocksHeader starts the shared file, the records follow it on the next cache line. Records are found by
+// hashing the id and probing forward, a record is never freed so a probe never skips one that is in use.
+// waiters counts the processes sleeping on a record, one killed while asleep only costs needless wake-ups.
+typedef struct {
+    char magic[4];
+    uint32_t capacity;
+    uint32_t recordSize;
+    _Atomic uint32_t used;
+    _Atomic uint32_t waiters;
+    char padding[44];
+} SharedStocksHeader;
+
+// SharedStocks is this process's mapping of the shared table. The quantities are changed with atomics only,
+// the file lock is taken just to add records, and the kernel drops it if its holder dies. overflows counts
+// the stocks this process couldn't share because the table was full.
+typedef struct {
+    int fd;
+    SharedStocksHeader *header;
+    SharedStock *records;
+    size_t size;
+    uint32_t capacity;
+    int overflows;
+} SharedStocks;
+
+extern const char *sharedStocksPath;
+extern SharedStocks sharedStocks;
+
+// functions for the shared table
+bool openSharedStocks(SharedStocks *table, const char *path, int stockCount);
+
+void closeSharedStocks(SharedStocks *table);
+
+void stopSharingStocks();
+
+SharedStock *findSharedStock(const SharedStocks *table, int id);
+
+SharedStock *publishSharedStock(SharedStocks *table, const Stock *stock);
+
+void unpublishSharedStock(SharedStocks *table, SharedStock *record);
+
+int attachSharedStocks(SharedStocks *table);
+
+int adoptSharedStocks(SharedStocks *table);
+
+// functions for the units of one record, they mirror the stock reservation functions
+int sharedQuantity(const SharedStock *record);
+
+int sharedReserved(const SharedStock *record);
+
+bool sharedReserve(SharedStock *record, int quantity);
+
+void sharedCommit(SharedStock *record, int quantity);
+
+void sharedRelease(SharedStock *record, int quantity);
+
+void sharedRestock(SharedStock *record, int quantity);
+
+void sharedSetQuantity(SharedStock *record, int quantity);
+
+void wakeSharedStock(SharedStock *record);
+
+bool waitSharedStock(SharedStock *record, int quantity, int timeoutMillis);
+
+#endif
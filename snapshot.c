@@ -0,0 +1,202 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sched.h>
+
+#include "snapshot.h"
+
+Snapshot snapshot = {
+    false, false, 0, {{0}, {0}, {0}}, NULL, 0, NULL, false, {NULL, 0, 0, NULL, 0, 0}, 0, NULL, NULL, 0, false
+};
+
+// preserveOrder saves an order as it was when the snapshot opened, before its first change or its removal.
+// Orders the reader already copied and orders added after the snapshot opened are left alone. An order the reader
+// claimed is being copied without the lock, so the writer waits for that copy instead, which takes one batch.
+void preserveOrder(Order *order) {
+    if (!snapshot.open || order->savedIn == snapshot.version || order->addedIn >= snapshot.version) return;
+    if (order->savedIn == snapshot.version + 1) {
+        while (atomic_load_explicit(&snapshot.copying, memory_order_acquire)) sched_yield();
+        return;
+    }
+    if (!snapshotAppend(&snapshot.saved, order)) snapshot.failed = true;
+    order->savedIn = snapshot.version;
+}
+
+// retireOrder keeps a removed order until the snapshot closes, since the reader may be on it or about to step
+// through it. It returns false when no snapshot is open and the order can be freed right away.
+bool retireOrder(Order *order) {
+    if (!snapshot.open) return false;
+    // the order is out of its status list, so statusNext is free to chain the retired orders
+    order->statusNext = snapshot.retired;
+    snapshot.retired = order;
+    return true;
+}
+
+bool snapshotReserve(SnapshotBuffer *buffer, int orders, int items) {
+    if (buffer->length + orders > buffer->capacity) {
+        int capacity = buffer->capacity == 0 ? SNAPSHOT_BATCH_SIZE : buffer->capacity;
+        while (buffer->length + orders > capacity) capacity *= 2;
+        SnapshotOrder *grown = realloc(buffer->orders, sizeof(SnapshotOrder) * capacity);
+        if (grown == NULL) return false;
+        buffer->orders = grown;
+        buffer->capacity = capacity;
+    }
+    if (buffer->itemLength + items > buffer->itemCapacity) {
+        int capacity = buffer->itemCapacity == 0 ? SNAPSHOT_BATCH_SIZE * 4 : buffer->itemCapacity;
+        while (buffer->itemLength + items > capacity) capacity *= 2;
+        SnapshotItem *grown = realloc(buffer->items, sizeof(SnapshotItem) * capacity);
+        if (grown == NULL) return false;
+        buffer->items = grown;
+        buffer->itemCapacity = capacity;
+    }
+    return true;
+}
+
+bool snapshotAppend(SnapshotBuffer *buffer, const Order *order) {
+    if (!snapshotReserve(buffer, 1, order->itemCount)) return false;
+    buffer->orders[buffer->length++] = (SnapshotOrder) {
+        order->id, order->cashierId, order->paymentType, order->orderStatus, order->total, order->itemCount,
+        buffer->itemLength
+    };
+    for (const Item *item = order->items; item < order->items + order->itemCount; item++) {
+        buffer->items[buffer->itemLength++] = (SnapshotItem) {item->id, item->stockId, item->quantity, item->price};
+    }
+    return true;
+}
+
+void snapshotClearBuffer(SnapshotBuffer *buffer) {
+    buffer->length = 0;
+    buffer->itemLength = 0;
+}
+
+void snapshotFreeBuffer(SnapshotBuffer *buffer) {
+    free(buffer->orders);
+    free(buffer->items);
+    memset(buffer, 0, sizeof(SnapshotBuffer));
+}
+
+// openSnapshot fixes the point in time a report reads, it costs the stocks and not the orders.
+// It fails if another snapshot is still open.
+bool openSnapshot() {
+    SnapshotStock *stockCopies = malloc(sizeof(SnapshotStock) * (stocks.length > 0 ? stocks.length : 1));
+    Order **claimed = malloc(sizeof(Order *) * SNAPSHOT_BATCH_SIZE);
+    if (stockCopies == NULL || claimed == NULL) {
+        free(stockCopies);
+        free(claimed);
+        return false;
+    }
+
+    pthread_mutex_lock(&salesLock);
+    if (snapshot.open) {
+        pthread_mutex_unlock(&salesLock);
+        free(stockCopies);
+        free(claimed);
+        return false;
+    }
+    snapshot.open = true;
+    snapshot.failed = false;
+    snapshot.version += 2;
+    snapshot.summary = sales.summary;
+    snapshot.stockCount = 0;
+    for (const Stock *stock = stocks.head; stock != NULL; stock = stock->next) {
+        SnapshotStock *copy = &stockCopies[snapshot.stockCount++];
+        copy->id = stock->id;
+        strncpy(copy->name, stringAt(stock->name), sizeof(copy->name) - 1);
+        copy->name[sizeof(copy->name) - 1] = '\0';
+        copy->price = stock->price;
+        copy->quantity = getStockQuantity(stock);
+        copy->reserved = getStockReserved(stock);
+    }
+    snapshot.stocks = stockCopies;
+    snapshot.cursor = orders.head;
+    snapshot.listDone = orders.head == NULL;
+    snapshotClearBuffer(&snapshot.saved);
+    snapshot.savedRead = 0;
+    snapshot.retired = NULL;
+    snapshot.claimed = claimed;
+    snapshot.claimedLength = 0;
+    atomic_store(&snapshot.copying, false);
+    pthread_mutex_unlock(&salesLock);
+    return true;
+}
+
+// readSnapshot fills batch with the next orders of the snapshot and returns how many, 0 once every order
+// was read and -1 if saving an order ran out of memory. The live list comes first, then what writers saved.
+int readSnapshot(SnapshotBuffer *batch) {
+    snapshotClearBuffer(batch);
+    pthread_mutex_lock(&salesLock);
+    // the last batch was copied, so its orders count as saved and writers no longer wait for them
+    for (int i = 0; i < snapshot.claimedLength; i++) snapshot.claimed[i]->savedIn = snapshot.version;
+    snapshot.claimedLength = 0;
+    while (snapshot.open && !snapshot.failed && !snapshot.listDone && snapshot.claimedLength < SNAPSHOT_BATCH_SIZE) {
+        Order *order = snapshot.cursor;
+        // orders are only ever appended, so the first one added after the snapshot opened ends the walk
+        if (order == NULL || order->addedIn >= snapshot.version) {
+            snapshot.listDone = true;
+            break;
+        }
+        if (order->savedIn != snapshot.version) {
+            order->savedIn = snapshot.version + 1;
+            snapshot.claimed[snapshot.claimedLength++] = order;
+        }
+        snapshot.cursor = order->next;
+    }
+    if (snapshot.claimedLength > 0) {
+        // the claimed orders are copied without the lock, a removed one is retired and stays readable
+        Order **claimed = snapshot.claimed;
+        const int claimedLength = snapshot.claimedLength;
+        atomic_store_explicit(&snapshot.copying, true, memory_order_relaxed);
+        pthread_mutex_unlock(&salesLock);
+        bool copied = true;
+        for (int i = 0; i < claimedLength && copied; i++) copied = snapshotAppend(batch, claimed[i]);
+        atomic_store_explicit(&snapshot.copying, false, memory_order_release);
+        if (copied) return batch->length;
+        pthread_mutex_lock(&salesLock);
+        snapshot.failed = true;
+        pthread_mutex_unlock(&salesLock);
+        return -1;
+    }
+    while (snapshot.open && !snapshot.failed && snapshot.listDone && snapshot.savedRead < snapshot.saved.length &&
+           batch->length < SNAPSHOT_BATCH_SIZE) {
+        const SnapshotOrder *saved = &snapshot.saved.orders[snapshot.savedRead++];
+        if (!snapshotReserve(batch, 1, saved->itemCount)) {
+            snapshot.failed = true;
+            break;
+        }
+        SnapshotOrder *copy = &batch->orders[batch->length++];
+        *copy = *saved;
+        copy->firstItem = batch->itemLength;
+        memcpy(batch->items + batch->itemLength, snapshot.saved.items + saved->firstItem,
+               sizeof(SnapshotItem) * saved->itemCount);
+        batch->itemLength += saved->itemCount;
+    }
+    const int count = snapshot.failed ? -1 : batch->length;
+    pthread_mutex_unlock(&salesLock);
+    return count;
+}
+
+// closeSnapshot frees the orders removed while it was open, the reader must be done with it
+void closeSnapshot() {
+    pthread_mutex_lock(&salesLock);
+    if (!snapshot.open) {
+        pthread_mutex_unlock(&salesLock);
+        return;
+    }
+    snapshot.open = false;
+    Order *retired = snapshot.retired;
+    snapshot.retired = NULL;
+    snapshot.cursor = NULL;
+    free(snapshot.claimed);
+    snapshot.claimed = NULL;
+    snapshot.claimedLength = 0;
+    snapshotFreeBuffer(&snapshot.saved);
+    free(snapshot.stocks);
+    snapshot.stocks = NULL;
+    snapshot.stockCount = 0;
+    pthread_mutex_unlock(&salesLock);
+
+    while (retired != NULL) {
+        Order *next = retired->statusNext;
+        freeOrder(retired);
+        retired = next;
+    }
+}
@@ -0,0 +1,96 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "restaurant.h"
+
+// a reader claims this many orders per hold of salesLock and copies them once it is released
+#define SNAPSHOT_BATCH_SIZE 256
+
+// SnapshotOrder is an order as it was when the snapshot opened, its items are in the items of the same buffer
+typedef struct {
+    int id;
+    int cashierId;
+    PaymentType paymentType;
+    OrderStatus orderStatus;
+    long long total;
+    int itemCount;
+    int firstItem;
+} SnapshotOrder;
+
+typedef struct {
+    int id;
+    int stockId;
+    int quantity;
+    int price;
+} SnapshotItem;
+
+// SnapshotStock is a stock as it was when the snapshot opened. quantity and reserved are read one after
+// the other, a reservation in flight may already be in them and not yet on its order.
+typedef struct {
+    int id;
+    char name[101];
+    int price;
+    int quantity;
+    int reserved;
+} SnapshotStock;
+
+// SnapshotBuffer is a growable run of orders with their items
+typedef struct {
+    SnapshotOrder *orders;
+    int length;
+    int capacity;
+    SnapshotItem *items;
+    int itemLength;
+    int itemCapacity;
+} SnapshotBuffer;
+
+// Snapshot is a point in time view of the orders that a report reads while the orders keep changing.
+// Nothing is copied when it opens. A writer about to change or remove an order the reader hasn't reached yet
+// saves the order as it was first, and removed orders are only freed when the snapshot closes, so the reader
+// can keep walking the live list. Every order is read once, from the list or from what was saved.
+// The reader claims a batch of the list under salesLock, marking each order with version + 1, and copies it
+// after the lock is released. A writer about to change a claimed order waits while copying is set.
+// Its fields change under salesLock, apart from copying.
+typedef struct {
+    bool open;
+    bool failed;
+    // version goes up by two, an order's savedIn is version once it is saved and version + 1 while claimed
+    unsigned int version;
+    SalesSummary summary;
+    SnapshotStock *stocks;
+    int stockCount;
+    Order *cursor;
+    bool listDone;
+    SnapshotBuffer saved;
+    int savedRead;
+    Order *retired;
+    Order **claimed;
+    int claimedLength;
+    _Atomic bool copying;
+} Snapshot;
+
+extern Snapshot snapshot;
+
+// functions for the writers, called with salesLock held
+void preserveOrder(Order *order);
+
+bool retireOrder(Order *order);
+
+// functions for the snapshot buffers
+bool snapshotReserve(SnapshotBuffer *buffer, int orders, int items);
+
+bool snapshotAppend(SnapshotBuffer *buffer, const Order *order);
+
+void snapshotClearBuffer(SnapshotBuffer *buffer);
+
+void snapshotFreeBuffer(SnapshotBuffer *buffer);
+
+// functions for a report. openSnapshot and closeSnapshot run on the thread that adds and removes orders
+// and stocks, readSnapshot can run on any thread in between.
+bool openSnapshot();
+
+int readSnapshot(SnapshotBuffer *batch);
+
+void closeSnapshot();
+
+#endif
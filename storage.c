@@ -0,0 +1,807 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "archive.h"
+#include "metrics.h"
+#include "storage.h"
+
+const char *ordersFilePath = "orders.dat";
+const char *stocksFilePath = "stocks.dat";
+const char *usersFilePath = "users.dat";
+const char *journalFilePath = "journal.dat";
+const char *idsFilePath = "ids.dat";
+
+uint32_t ordersGeneration = 0;
+uint32_t stocksGeneration = 0;
+uint32_t usersGeneration = 0;
+uint32_t checkpointGeneration = 0;
+
+Journal journal = {
+    -1, 0, true, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, NULL, 0, 0, NULL, 0, false, false, 0, 0, 0
+};
+_Thread_local bool journalDeferred = false;
+
+bool readIdsFromFile() {
+    MappedFile file;
+    if (idsFilePath == NULL || !mapFile(idsFilePath, &file)) return true;
+
+    IdFileHeader header;
+    if (file.size != sizeof(header)) {
+        fprintf(stderr, "%s: size mismatch\n", idsFilePath);
+        unmapFile(&file);
+        return false;
+    }
+    memcpy(&header, file.data, sizeof(header));
+    unmapFile(&file);
+    if (memcmp(header.magic, "CRID", 4) != 0 || header.version != ID_FILE_VERSION ||
+        checksumData(2166136261U, header.leased, sizeof(header.leased)) != header.checksum) {
+        fprintf(stderr, "%s: corrupt id file\n", idsFilePath);
+        return false;
+    }
+
+    for (int i = 0; i < ID_KIND_COUNT; i++) {
+        atomic_store(&idSequences[i].next, header.leased[i]);
+        atomic_store(&idSequences[i].leased, header.leased[i]);
+    }
+    return true;
+}
+
+bool writeIdsToFile(const int64_t leased[ID_KIND_COUNT]) {
+    // without a path ids are not persisted, e.g. in benchmarks and headless runs
+    if (idsFilePath == NULL) return true;
+
+    IdFileHeader header = {{'C', 'R', 'I', 'D'}, ID_FILE_VERSION, 0, 0, {0}};
+    memcpy(header.leased, leased, sizeof(header.leased));
+    header.checksum = checksumData(2166136261U, header.leased, sizeof(header.leased));
+
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", idsFilePath);
+#ifdef _WIN32
+    const int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+#else
+    const int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, (const char *) &header, sizeof(header)) && syncFile(fd);
+    ok = close(fd) == 0 && ok;
+#ifdef _WIN32
+    if (ok) remove(idsFilePath);
+#endif
+    if (ok) ok = rename(temporaryPath, idsFilePath) == 0;
+    if (!ok) remove(temporaryPath);
+    return ok;
+}
+
+bool mapFile(const char *path, MappedFile *file) {
+    file->data = NULL;
+    file->size = 0;
+#ifdef _WIN32
+    FILE *handle = fopen(path, "rb");
+    if (handle == NULL) return false;
+    fseek(handle, 0, SEEK_END);
+    file->size = ftell(handle);
+    fseek(handle, 0, SEEK_SET);
+    file->data = malloc(file->size > 0 ? file->size : 1);
+    if (file->data == NULL || fread(file->data, 1, file->size, handle) != file->size) {
+        free(file->data);
+        file->data = NULL;
+        fclose(handle);
+        return false;
+    }
+    fclose(handle);
+#else
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return false;
+    }
+    file->size = info.st_size;
+    if (file->size > 0) {
+        void *data = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+        madvise(data, file->size, MADV_SEQUENTIAL | MADV_WILLNEED);
+        file->data = data;
+    }
+    close(fd);
+#endif
+    return true;
+}
+
+void unmapFile(MappedFile *file) {
+#ifdef _WIN32
+    free(file->data);
+#else
+    if (file->data != NULL) munmap(file->data, file->size);
+#endif
+    file->data = NULL;
+    file->size = 0;
+}
+
+uint32_t checksumData(uint32_t checksum, const void *data, size_t size) {
+    // FNV-1a over 32 bit words, every record size is a multiple of 4
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+        uint32_t word;
+        memcpy(&word, bytes + i, 4);
+        checksum = (checksum ^ word) * 16777619U;
+    }
+    return checksum;
+}
+
+// validateDataFile returns NULL when the file is usable or the reason it was rejected
+const char *validateDataFile(const MappedFile *file, const char magic[4], size_t recordSize, size_t itemRecordSize) {
+    if (file->size < sizeof(DataFileHeader)) return "truncated header";
+
+    const DataFileHeader *header = (const DataFileHeader *) file->data;
+    if (memcmp(header->magic, magic, 4) != 0) return "bad magic";
+    if (header->version != DATA_FILE_VERSION) return "unsupported version";
+    if (header->recordSize != recordSize || header->itemRecordSize != itemRecordSize) return "record size mismatch";
+
+    const uint64_t payload = (uint64_t) file->size - sizeof(DataFileHeader);
+    if (header->count > payload / recordSize) return "truncated records";
+    const uint64_t itemPayload = payload - header->count * recordSize;
+    if (itemRecordSize == 0 ? header->itemCount != 0 : header->itemCount > itemPayload / itemRecordSize)
+        return "truncated items";
+    if (itemPayload != header->itemCount * itemRecordSize) return "size mismatch";
+
+    if (checksumData(2166136261U, file->data + sizeof(DataFileHeader), payload) != header->checksum)
+        return "checksum mismatch";
+    return NULL;
+}
+
+// beginDataFile opens a temporary file next to path and endDataFile completes it, commitDataFile then renames it
+// over path. A checkpoint only commits its files once all of them are complete.
+FILE *beginDataFile(const char *path, DataFileHeader *header, const char magic[4], size_t recordSize,
+                    size_t itemRecordSize) {
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+    FILE *file = fopen(temporaryPath, "wb");
+    if (file == NULL) return NULL;
+    setvbuf(file, NULL, _IOFBF, 1 << 20);
+
+    memset(header, 0, sizeof(DataFileHeader));
+    memcpy(header->magic, magic, 4);
+    header->version = DATA_FILE_VERSION;
+    header->recordSize = recordSize;
+    header->itemRecordSize = itemRecordSize;
+    header->checksum = 2166136261U;
+    header->journalGeneration = checkpointGeneration;
+    if (fwrite(header, sizeof(DataFileHeader), 1, file) != 1) {
+        fclose(file);
+        return NULL;
+    }
+    return file;
+}
+
+bool writeDataRecord(FILE *file, DataFileHeader *header, const void *record, size_t size) {
+    header->checksum = checksumData(header->checksum, record, size);
+    return fwrite(record, size, 1, file) == 1;
+}
+
+bool endDataFile(FILE *file, const char *path, DataFileHeader *header) {
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+
+    bool ok = fseek(file, 0, SEEK_SET) == 0 && fwrite(header, sizeof(DataFileHeader), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    if (!ok) remove(temporaryPath);
+    return ok;
+}
+
+bool commitDataFile(const char *path) {
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+#ifdef _WIN32
+    remove(path);
+#endif
+    const bool ok = rename(temporaryPath, path) == 0;
+    if (!ok) remove(temporaryPath);
+    return ok;
+}
+
+void discardDataFile(const char *path) {
+    char temporaryPath[512];
+    snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp", path);
+    remove(temporaryPath);
+}
+
+bool readOrdersFromFile() {
+    MappedFile file;
+    if (!mapFile(ordersFilePath, &file)) return true;
+
+    const char *error = validateDataFile(&file, "CROR", sizeof(OrderRecord), sizeof(ItemRecord));
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", ordersFilePath, error);
+        unmapFile(&file);
+        return false;
+    }
+
+    const DataFileHeader *header = (const DataFileHeader *) file.data;
+    ordersGeneration = header->journalGeneration;
+    const OrderRecord *orderRecords = (const OrderRecord *) (file.data + sizeof(DataFileHeader));
+    const ItemRecord *itemRecords = (const ItemRecord *) (orderRecords + header->count);
+
+    uint64_t nextItem = 0;
+    for (uint64_t i = 0; i < header->count; i++) {
+        const OrderRecord *record = &orderRecords[i];
+        if (record->itemCount < 0 || (uint64_t) record->itemCount > header->itemCount - nextItem) {
+            fprintf(stderr, "%s: item count out of range\n", ordersFilePath);
+            unmapFile(&file);
+            return false;
+        }
+        // both index arrays of the sales totals and the status lists
+        if (record->paymentType < 0 || record->paymentType >= PAYMENT_TYPE_COUNT || record->orderStatus < 0 ||
+            record->orderStatus >= ORDER_STATUS_COUNT) {
+            fprintf(stderr, "%s: order %d has an unknown payment type or status\n", ordersFilePath, record->id);
+            unmapFile(&file);
+            return false;
+        }
+
+        Order *order = slabAlloc(&orderSlab);
+        order->id = record->id;
+        order->cashierId = record->cashierId;
+        order->paymentType = record->paymentType;
+        order->orderStatus = record->orderStatus;
+        order->settledAt = 0;
+        order->statusNext = NULL;
+        order->statusPrev = NULL;
+        order->inKitchen = false;
+        initOrderItems(order);
+        if (!growOrderItems(order, record->itemCount)) {
+            fprintf(stderr, "%s: out of memory\n", ordersFilePath);
+            slabFree(&orderSlab, order);
+            unmapFile(&file);
+            return false;
+        }
+
+        for (int j = 0; j < record->itemCount; j++, nextItem++) {
+            Item *item = &order->items[order->itemCount++];
+            item->id = itemRecords[nextItem].id;
+            item->stockId = itemRecords[nextItem].stockId;
+            item->quantity = itemRecords[nextItem].quantity;
+            item->price = itemRecords[nextItem].price;
+            item->use = NULL;
+        }
+        addOrder(order);
+    }
+
+    unmapFile(&file);
+    return true;
+}
+
+bool readStocksFromFile() {
+    MappedFile file;
+    if (!mapFile(stocksFilePath, &file)) return true;
+
+    const char *error = validateDataFile(&file, "CRST", sizeof(StockRecord), 0);
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", stocksFilePath, error);
+        unmapFile(&file);
+        return false;
+    }
+
+    const DataFileHeader *header = (const DataFileHeader *) file.data;
+    stocksGeneration = header->journalGeneration;
+    const StockRecord *records = (const StockRecord *) (file.data + sizeof(DataFileHeader));
+    for (uint64_t i = 0; i < header->count; i++) {
+        Stock *stock = slabAlloc(&stockSlab);
+        stock->id = records[i].id;
+        stock->price = records[i].price;
+        stock->quantity = records[i].quantity;
+        stock->reserved = 0;
+        stock->name = internString(records[i].name, NAME_SIZE);
+        addStock(stock);
+    }
+
+    unmapFile(&file);
+    return true;
+}
+
+bool readUsersFromFile() {
+    MappedFile file;
+    if (!mapFile(usersFilePath, &file)) return true;
+
+    const char *error = validateDataFile(&file, "CRUS", sizeof(UserRecord), 0);
+    if (error != NULL) {
+        fprintf(stderr, "%s: %s\n", usersFilePath, error);
+        unmapFile(&file);
+        return false;
+    }
+
+    const DataFileHeader *header = (const DataFileHeader *) file.data;
+    usersGeneration = header->journalGeneration;
+    const UserRecord *records = (const UserRecord *) (file.data + sizeof(DataFileHeader));
+    for (uint64_t i = 0; i < header->count; i++) {
+        if (records[i].type < CHEF || records[i].type > ADMIN) {
+            fprintf(stderr, "%s: user %d has an unknown type\n", usersFilePath, records[i].id);
+            unmapFile(&file);
+            return false;
+        }
+        User *user = slabAlloc(&userSlab);
+        user->id = records[i].id;
+        user->type = records[i].type;
+        user->name = internString(records[i].name, NAME_SIZE);
+        user->hashedPassword = internString(records[i].hashedPassword, HASHED_PASSWORD_SIZE);
+        addUser(user);
+    }
+
+    unmapFile(&file);
+    return true;
+}
+
+bool writeOrdersToFile() {
+    DataFileHeader header;
+    FILE *file = beginDataFile(ordersFilePath, &header, "CROR", sizeof(OrderRecord), sizeof(ItemRecord));
+    if (file == NULL) return false;
+
+    bool ok = true;
+    for (Order *order = orders.head; order != NULL && ok; order = order->next) {
+        OrderRecord record = {order->id, order->cashierId, order->paymentType, order->orderStatus, order->itemCount};
+        ok = writeDataRecord(file, &header, &record, sizeof(record));
+        header.count++;
+        header.itemCount += record.itemCount;
+    }
+    for (Order *order = orders.head; order != NULL && ok; order = order->next) {
+        for (const Item *item = order->items; item < order->items + order->itemCount && ok; item++) {
+            ItemRecord record = {item->id, item->stockId, item->quantity, item->price};
+            ok = writeDataRecord(file, &header, &record, sizeof(record));
+        }
+    }
+
+    if (!ok) header.count = 0;
+    return endDataFile(file, ordersFilePath, &header) && ok;
+}
+
+bool writeStocksToFile() {
+    DataFileHeader header;
+    FILE *file = beginDataFile(stocksFilePath, &header, "CRST", sizeof(StockRecord), 0);
+    if (file == NULL) return false;
+
+    bool ok = true;
+    for (Stock *stock = stocks.head; stock != NULL && ok; stock = stock->next) {
+        StockRecord record;
+        memset(&record, 0, sizeof(record));
+        record.id = stock->id;
+        record.price = stock->price;
+        record.quantity = getStockQuantity(stock);
+        strncpy(record.name, stringAt(stock->name), sizeof(record.name) - 1);
+        ok = writeDataRecord(file, &header, &record, sizeof(record));
+        header.count++;
+    }
+
+    return endDataFile(file, stocksFilePath, &header) && ok;
+}
+
+bool writeUsersToFile() {
+    DataFileHeader header;
+    FILE *file = beginDataFile(usersFilePath, &header, "CRUS", sizeof(UserRecord), 0);
+    if (file == NULL) return false;
+
+    bool ok = true;
+    for (User *user = users.head; user != NULL && ok; user = user->next) {
+        UserRecord record;
+        memset(&record, 0, sizeof(record));
+        record.id = user->id;
+        record.type = user->type;
+        strncpy(record.name, stringAt(user->name), sizeof(record.name) - 1);
+        strncpy(record.hashedPassword, stringAt(user->hashedPassword), sizeof(record.hashedPassword) - 1);
+        ok = writeDataRecord(file, &header, &record, sizeof(record));
+        header.count++;
+    }
+
+    return endDataFile(file, usersFilePath, &header) && ok;
+}
+
+// loadData reads the last checkpoint, stocks and users first since orders refer to them,
+// then replays the journal on top of it and keeps the journal open for new mutations.
+// The archive comes last, it takes back out the orders archived since the checkpoint.
+bool loadData() {
+    if (!readIdsFromFile() || !readStocksFromFile() || !readUsersFromFile() || !readOrdersFromFile() ||
+        !replayJournal() || !readArchive())
+        return false;
+
+    // a checkpoint cut short left some files ahead of the journal. Records appended to it now would be skipped
+    // for those files on the next replay, so what was just rebuilt is checkpointed again before anything changes.
+    uint32_t generation = ordersGeneration;
+    if (stocksGeneration > generation) generation = stocksGeneration;
+    if (usersGeneration > generation) generation = usersGeneration;
+    if (generation > journal.generation && !writeCheckpoint()) {
+        fprintf(stderr, "%s is behind the checkpoint and a new checkpoint failed\n", journalFilePath);
+        return false;
+    }
+
+    // data written before ids.dat existed may carry ids past the leased ones
+    for (Order *order = orders.head; order != NULL; order = order->next) {
+        reserveIds(ORDER_ID, order->id);
+        for (int i = 0; i < order->itemCount; i++) reserveIds(ITEM_ID, order->items[i].id);
+    }
+    for (Stock *stock = stocks.head; stock != NULL; stock = stock->next) reserveIds(STOCK_ID, stock->id);
+    for (User *user = users.head; user != NULL; user = user->next) reserveIds(USER_ID, user->id);
+    return true;
+}
+
+void saveData() {
+    writeCheckpoint();
+}
+
+// writeCheckpoint writes every list and starts a new journal generation. The files are only renamed into place
+// once all of them are written, so a failed checkpoint leaves the last one and the journal as they were.
+bool writeCheckpoint() {
+    const long long started = metricStart();
+    uint32_t generation = journal.generation;
+    if (ordersGeneration > generation) generation = ordersGeneration;
+    if (stocksGeneration > generation) generation = stocksGeneration;
+    if (usersGeneration > generation) generation = usersGeneration;
+    checkpointGeneration = generation + 1;
+
+    bool ok = true;
+    if (!writeStocksToFile()) {
+        fprintf(stderr, "failed to write %s\n", stocksFilePath);
+        ok = false;
+    }
+    if (ok && !writeUsersToFile()) {
+        fprintf(stderr, "failed to write %s\n", usersFilePath);
+        ok = false;
+    }
+    // archived orders are only left out of the orders file once the archive has them
+    const bool flushed = ok && flushArchive();
+    const uint64_t archived = flushed ? archiveLength() : 0;
+    if (ok && !flushed) {
+        fprintf(stderr, "failed to write %s, keeping the last %s\n", archiveFilePath, ordersFilePath);
+        ok = false;
+    } else if (ok && !writeOrdersToFile()) {
+        fprintf(stderr, "failed to write %s\n", ordersFilePath);
+        ok = false;
+    }
+
+    if (ok) {
+        // a crash between the renames leaves the old journal, which still has everything the files that weren't
+        // renamed need. A rename that fails leaves the same state, so the journal takes no more records until
+        // the next start checkpoints again.
+        const char *paths[] = {stocksFilePath, usersFilePath, ordersFilePath};
+        uint32_t *generations[] = {&stocksGeneration, &usersGeneration, &ordersGeneration};
+        for (int i = 0; i < 3; i++) {
+            if (ok && commitDataFile(paths[i])) {
+                *generations[i] = checkpointGeneration;
+                continue;
+            }
+            if (ok) fprintf(stderr, "failed to rename %s\n", paths[i]);
+            if (ok && i > 0) {
+                pthread_mutex_lock(&journal.lock);
+                journal.failed = true;
+                pthread_mutex_unlock(&journal.lock);
+            }
+            ok = false;
+            discardDataFile(paths[i]);
+        }
+        // a mark left behind only costs the next start looking for more archived orders among the loaded ones
+        if (ok && !markArchiveCheckpoint(archived)) {
+            fprintf(stderr, "failed to mark the checkpoint in %s\n", archiveFilePath);
+        }
+    } else {
+        discardDataFile(stocksFilePath);
+        discardDataFile(usersFilePath);
+        discardDataFile(ordersFilePath);
+    }
+
+    // a clean shutdown gives the unused part of the lease back so ids stay dense across restarts
+    pthread_mutex_lock(&idLeaseLock);
+    int64_t leased[ID_KIND_COUNT];
+    for (int i = 0; i < ID_KIND_COUNT; i++) leased[i] = atomic_load(&idSequences[i].next);
+    if (writeIdsToFile(leased)) {
+        for (int i = 0; i < ID_KIND_COUNT; i++) atomic_store(&idSequences[i].leased, leased[i]);
+    } else {
+        fprintf(stderr, "failed to write %s\n", idsFilePath);
+    }
+    pthread_mutex_unlock(&idLeaseLock);
+
+    if (ok && journal.fd >= 0) {
+        closeJournal();
+        if (!openJournal(checkpointGeneration)) {
+            fprintf(stderr, "failed to reset %s\n", journalFilePath);
+            ok = false;
+        }
+    }
+    metricEnd(METRIC_SAVE, started);
+    return ok;
+}
+
+bool syncFile(int fd) {
+#ifdef _WIN32
+    return _commit(fd) == 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+bool writeAll(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        const long written = write(fd, data, size);
+        if (written <= 0) return false;
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+// journalWrite appends a record and returns once it is durable, or false if it could not be written.
+// A thread with journalDeferred set gets back as soon as the record is appended and calls flushJournal later.
+bool journalWrite(JournalRecordType type, const int32_t args[4], const char *text, size_t textLength) {
+    if (journal.fd < 0) return true;
+
+    const long long started = metricStart();
+    pthread_mutex_lock(&journal.lock);
+    const bool ok = !journal.failed && journalAppend(type, args, text, textLength) &&
+                    (journalDeferred || journalFlush(journal.appended));
+    pthread_mutex_unlock(&journal.lock);
+    return metricResult(METRIC_JOURNAL_WRITE, started, ok);
+}
+
+// journalAppend queues a record with the lock held and doesn't wait for it to be durable,
+// so a batch can append all its records and flush them once
+bool journalAppend(JournalRecordType type, const int32_t args[4], const char *text, size_t textLength) {
+    const size_t size = sizeof(JournalRecord) + (textLength + 3) / 4 * 4;
+    if (journal.pendingLength + size > journal.pendingCapacity) {
+        size_t capacity = journal.pendingCapacity == 0 ? 4096 : journal.pendingCapacity;
+        while (journal.pendingLength + size > capacity) capacity *= 2;
+        char *pending = realloc(journal.pending, capacity);
+        if (pending == NULL) return false;
+        journal.pending = pending;
+        journal.pendingCapacity = capacity;
+    }
+
+    char *data = journal.pending + journal.pendingLength;
+    JournalRecord record = {size, 0, type, {args[0], args[1], args[2], args[3]}};
+    memcpy(data, &record, sizeof(record));
+    memset(data + sizeof(record), 0, size - sizeof(record));
+    if (textLength > 0) memcpy(data + sizeof(record), text, textLength);
+    record.checksum = checksumData(2166136261U, data + 2 * sizeof(uint32_t), size - 2 * sizeof(uint32_t));
+    memcpy(data, &record, sizeof(record));
+    journal.pendingLength += size;
+    journal.appended += size;
+    return true;
+}
+
+// journalFlush waits, with the lock held, until every record up to lsn is durable.
+// With group commit the leader drops the lock while it syncs so other writers can queue up behind it.
+bool journalFlush(uint64_t lsn) {
+    while (journal.durable < lsn && !journal.failed) {
+        if (journal.syncing) {
+            pthread_cond_wait(&journal.flushed, &journal.lock);
+            continue;
+        }
+
+        // swap the buffers so writers keep appending while the leader writes this group out
+        char *data = journal.pending;
+        const size_t capacity = journal.pendingCapacity;
+        const size_t length = journal.pendingLength;
+        const uint64_t target = journal.appended;
+        journal.pending = journal.flushing;
+        journal.pendingCapacity = journal.flushingCapacity;
+        journal.pendingLength = 0;
+        journal.flushing = data;
+        journal.flushingCapacity = capacity;
+        journal.syncing = true;
+
+        if (journal.groupCommit) pthread_mutex_unlock(&journal.lock);
+        const bool ok = writeAll(journal.fd, data, length) && syncFile(journal.fd);
+        if (journal.groupCommit) pthread_mutex_lock(&journal.lock);
+
+        journal.syncs++;
+        if (ok) journal.durable = target;
+        else journal.failed = true;
+        journal.syncing = false;
+        pthread_cond_broadcast(&journal.flushed);
+    }
+    return !journal.failed;
+}
+
+// flushJournal makes every record appended so far durable, e.g. the deferred ones of a batch of requests
+bool flushJournal() {
+    if (journal.fd < 0) return true;
+    pthread_mutex_lock(&journal.lock);
+    const bool ok = journalFlush(journal.appended);
+    pthread_mutex_unlock(&journal.lock);
+    return ok;
+}
+
+// journalApply redoes a replayed record, skipping the ones the checkpoint of its list already contains
+bool journalApply(const JournalRecord *record, const char *text) {
+    const int32_t *args = record->args;
+    switch (record->type) {
+        case JOURNAL_ADD_ORDER:
+        case JOURNAL_REMOVE_ORDER:
+        case JOURNAL_ADD_ITEM:
+        case JOURNAL_MODIFY_ITEM:
+        case JOURNAL_SET_ORDER_STATUS:
+            if (ordersGeneration > journal.generation) return true;
+            break;
+        case JOURNAL_ADD_STOCK:
+        case JOURNAL_REMOVE_STOCK:
+        case JOURNAL_UPDATE_STOCK:
+        case JOURNAL_INCREMENT_QUANTITY:
+        case JOURNAL_DECREMENT_QUANTITY:
+            if (stocksGeneration > journal.generation) return true;
+            break;
+        default:
+            if (usersGeneration > journal.generation) return true;
+            break;
+    }
+
+    switch (record->type) {
+        case JOURNAL_ADD_ORDER: {
+            if (args[2] < 0 || args[2] >= PAYMENT_TYPE_COUNT || args[3] < 0 || args[3] >= ORDER_STATUS_COUNT) {
+                return false;
+            }
+            Order *order = createOrder(args[1], args[2]);
+            order->id = args[0];
+            order->orderStatus = args[3];
+            addOrder(order);
+            return true;
+        }
+        case JOURNAL_REMOVE_ORDER:
+            removeOrder(args[0]);
+            return true;
+        case JOURNAL_SET_ORDER_STATUS: {
+            Order *order = findOrder(args[0]);
+            if (order == NULL || args[1] < 0 || args[1] >= ORDER_STATUS_COUNT) return false;
+            setOrderStatus(order, args[1]);
+            return true;
+        }
+        case JOURNAL_ADD_ITEM:
+        case JOURNAL_MODIFY_ITEM: {
+            Order *order = findOrder(args[0]);
+            if (order == NULL) return false;
+            if (record->type == JOURNAL_ADD_ITEM) addItemToOrder(order, args[1], args[2]);
+            else modifyItemOnOrder(order, args[1], args[2]);
+            return true;
+        }
+        case JOURNAL_ADD_STOCK: {
+            Stock *stock = createStock((char *) text, args[1], args[2]);
+            stock->id = args[0];
+            addStock(stock);
+            return true;
+        }
+        case JOURNAL_REMOVE_STOCK: {
+            Stock *stock = findStock(args[0]);
+            return stock != NULL && removeStock(stock);
+        }
+        case JOURNAL_UPDATE_STOCK: {
+            Stock *stock = findStock(args[0]);
+            if (stock == NULL) return false;
+            updateStock(stock, text, args[1], args[2]);
+            return true;
+        }
+        case JOURNAL_INCREMENT_QUANTITY:
+            incrementQuantity(args[0], args[1]);
+            return true;
+        case JOURNAL_DECREMENT_QUANTITY:
+            decrementQuantity(args[0], args[1]);
+            return true;
+        case JOURNAL_ADD_USER: {
+            if (args[1] < CHEF || args[1] > ADMIN) return false;
+            User *user = createUser((char *) text, (char *) text + strlen(text) + 1, args[1]);
+            user->id = args[0];
+            addUser(user);
+            return true;
+        }
+        case JOURNAL_REMOVE_USER:
+        case JOURNAL_CHANGE_PASSWORD: {
+            User *user = findUser(args[0]);
+            if (user == NULL) return false;
+            if (record->type == JOURNAL_REMOVE_USER) removeUser(user);
+            else changePassword(user, (char *) text);
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// replayJournal redoes the journal on top of the loaded checkpoint, a torn record at the end
+// (a crash in the middle of an append) ends the replay and is cut off when the journal is reopened
+bool replayJournal() {
+    uint32_t generation = ordersGeneration;
+    if (stocksGeneration > generation) generation = stocksGeneration;
+    if (usersGeneration > generation) generation = usersGeneration;
+
+    MappedFile file;
+    size_t validLength = sizeof(JournalFileHeader);
+    if (mapFile(journalFilePath, &file)) {
+        const JournalFileHeader *header = (const JournalFileHeader *) file.data;
+        if (file.size < sizeof(JournalFileHeader) || memcmp(header->magic, "CRJL", 4) != 0 ||
+            header->version != JOURNAL_VERSION) {
+            fprintf(stderr, "%s: bad journal header\n", journalFilePath);
+            unmapFile(&file);
+            return false;
+        }
+
+        journal.generation = header->generation;
+        while (validLength + sizeof(JournalRecord) <= file.size) {
+            JournalRecord record;
+            memcpy(&record, file.data + validLength, sizeof(record));
+            if (record.size < sizeof(JournalRecord) || record.size % 4 != 0 ||
+                record.size > file.size - validLength)
+                break;
+            const char *data = file.data + validLength;
+            if (checksumData(2166136261U, data + 2 * sizeof(uint32_t), record.size - 2 * sizeof(uint32_t)) !=
+                record.checksum)
+                break;
+
+            // text fields are zero padded, make sure the last one is terminated before using it
+            char text[NAME_SIZE + HASHED_PASSWORD_SIZE] = {0};
+            const size_t textLength = record.size - sizeof(JournalRecord);
+            memcpy(text, data + sizeof(JournalRecord), textLength < sizeof(text) ? textLength : sizeof(text) - 1);
+            if (!journalApply(&record, text)) {
+                fprintf(stderr, "%s: record at %zu does not apply\n", journalFilePath, validLength);
+                unmapFile(&file);
+                return false;
+            }
+            validLength += record.size;
+        }
+        if (validLength < file.size) {
+            fprintf(stderr, "%s: dropped %zu bytes of a torn record\n", journalFilePath, file.size - validLength);
+        }
+        unmapFile(&file);
+        generation = journal.generation;
+
+#ifdef _WIN32
+        const int fd = open(journalFilePath, O_WRONLY | O_BINARY);
+        const bool truncated = fd >= 0 && _chsize(fd, validLength) == 0;
+#else
+        const int fd = open(journalFilePath, O_WRONLY);
+        const bool truncated = fd >= 0 && ftruncate(fd, validLength) == 0;
+#endif
+        if (fd >= 0) close(fd);
+        if (!truncated) return false;
+        journal.fd = open(journalFilePath, O_WRONLY | O_APPEND);
+        return journal.fd >= 0;
+    }
+
+    return openJournal(generation);
+}
+
+// openJournal starts an empty journal for the given generation
+bool openJournal(uint32_t generation) {
+#ifdef _WIN32
+    journal.fd = open(journalFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_BINARY, 0644);
+#else
+    journal.fd = open(journalFilePath, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+#endif
+    if (journal.fd < 0) return false;
+
+    JournalFileHeader header = {{'C', 'R', 'J', 'L'}, JOURNAL_VERSION, generation, 0};
+    journal.generation = generation;
+    journal.failed = false;
+    if (!writeAll(journal.fd, (const char *) &header, sizeof(header)) || !syncFile(journal.fd)) {
+        closeJournal();
+        return false;
+    }
+    return true;
+}
+
+void closeJournal() {
+    if (journal.fd < 0) return;
+    pthread_mutex_lock(&journal.lock);
+    journalFlush(journal.appended);
+    close(journal.fd);
+    journal.fd = -1;
+    pthread_mutex_unlock(&journal.lock);
+}
@@ -0,0 +1,201 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <stdio.h>
+
+#include "restaurant.h"
+
+#define DATA_FILE_VERSION 2
+#define JOURNAL_VERSION 1
+#define ID_FILE_VERSION 1
+
+// DataFileHeader starts every data file, the records follow it back to back.
+// Orders files store every order record first and then the items of all orders in the same order.
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t itemRecordSize;
+    uint64_t count;
+    uint64_t itemCount;
+    uint32_t checksum;
+    uint32_t journalGeneration;
+} DataFileHeader;
+
+typedef struct {
+    int32_t id;
+    int32_t cashierId;
+    int32_t paymentType;
+    int32_t orderStatus;
+    int32_t itemCount;
+} OrderRecord;
+
+typedef struct {
+    int32_t id;
+    int32_t stockId;
+    int32_t quantity;
+    int32_t price;
+} ItemRecord;
+
+typedef struct {
+    int32_t id;
+    int32_t price;
+    int32_t quantity;
+    char name[104];
+} StockRecord;
+
+typedef struct {
+    int32_t id;
+    int32_t type;
+    char name[104];
+    char hashedPassword[204];
+} UserRecord;
+
+// MappedFile is a read only view of a whole file
+typedef struct {
+    char *data;
+    size_t size;
+} MappedFile;
+
+typedef enum {
+    JOURNAL_ADD_ORDER,
+    JOURNAL_REMOVE_ORDER,
+    JOURNAL_ADD_ITEM,
+    JOURNAL_MODIFY_ITEM,
+    JOURNAL_ADD_STOCK,
+    JOURNAL_REMOVE_STOCK,
+    JOURNAL_INCREMENT_QUANTITY,
+    JOURNAL_DECREMENT_QUANTITY,
+    JOURNAL_ADD_USER,
+    JOURNAL_REMOVE_USER,
+    JOURNAL_CHANGE_PASSWORD,
+    JOURNAL_SET_ORDER_STATUS,
+    JOURNAL_UPDATE_STOCK
+} JournalRecordType;
+
+// JournalFileHeader starts the journal, generation tells which checkpoint the journal continues from
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t generation;
+    uint32_t reserved;
+} JournalFileHeader;
+
+// JournalRecord is one mutation, followed by size - sizeof(JournalRecord) bytes of zero padded text
+typedef struct {
+    uint32_t size;
+    uint32_t checksum;
+    int32_t type;
+    int32_t args[4];
+} JournalRecord;
+
+// Journal is the append only write-ahead log, appended records are made durable in groups:
+// the first writer to wait becomes the leader and syncs everything appended so far in one go.
+typedef struct {
+    int fd;
+    uint32_t generation;
+    bool groupCommit;
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;
+    char *pending;
+    size_t pendingLength;
+    size_t pendingCapacity;
+    char *flushing;
+    size_t flushingCapacity;
+    bool syncing;
+    bool failed;
+    uint64_t appended;
+    uint64_t durable;
+    uint64_t syncs;
+} Journal;
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t checksum;
+    uint32_t reserved;
+    int64_t leased[ID_KIND_COUNT];
+} IdFileHeader;
+
+extern const char *ordersFilePath;
+extern const char *stocksFilePath;
+extern const char *usersFilePath;
+extern const char *journalFilePath;
+extern const char *idsFilePath;
+
+// generations of the loaded data files, and the one written into the next checkpoint
+extern uint32_t ordersGeneration;
+extern uint32_t stocksGeneration;
+extern uint32_t usersGeneration;
+extern uint32_t checkpointGeneration;
+
+extern Journal journal;
+
+// journalDeferred makes this thread's journal writes return once appended, flushJournal then makes them durable
+extern _Thread_local bool journalDeferred;
+
+// functions for file management, the read functions return false when a file exists but is invalid
+bool mapFile(const char *path, MappedFile *file);
+
+void unmapFile(MappedFile *file);
+
+uint32_t checksumData(uint32_t checksum, const void *data, size_t size);
+
+const char *validateDataFile(const MappedFile *file, const char magic[4], size_t recordSize, size_t itemRecordSize);
+
+FILE *beginDataFile(const char *path, DataFileHeader *header, const char magic[4], size_t recordSize,
+                    size_t itemRecordSize);
+
+bool writeDataRecord(FILE *file, DataFileHeader *header, const void *record, size_t size);
+
+bool endDataFile(FILE *file, const char *path, DataFileHeader *header);
+
+bool commitDataFile(const char *path);
+
+void discardDataFile(const char *path);
+
+bool readOrdersFromFile();
+
+bool readStocksFromFile();
+
+bool readUsersFromFile();
+
+bool writeOrdersToFile();
+
+bool writeStocksToFile();
+
+bool writeUsersToFile();
+
+bool loadData();
+
+void saveData();
+
+bool writeCheckpoint();
+
+// functions for the write-ahead journal
+bool syncFile(int fd);
+
+bool writeAll(int fd, const char *data, size_t size);
+
+bool journalWrite(JournalRecordType type, const int32_t args[4], const char *text, size_t textLength);
+
+bool journalAppend(JournalRecordType type, const int32_t args[4], const char *text, size_t textLength);
+
+bool journalFlush(uint64_t lsn);
+
+bool flushJournal();
+
+bool journalApply(const JournalRecord *record, const char *text);
+
+bool replayJournal();
+
+bool openJournal(uint32_t generation);
+
+void closeJournal();
+
+// functions for the id file
+bool readIdsFromFile();
+
+bool writeIdsToFile(const int64_t leased[ID_KIND_COUNT]);
+
+#endif